@@ -978,6 +978,24 @@ cJSON_ParseWithOpts(
     const char * value,
     const char **return_parse_end,
     cJSON_bool   require_null_terminated)
+{
+    if (value == NULL) {
+        return NULL;
+    }
+
+    return cJSON_ParseWithLengthOpts(
+        value,
+        strlen(value) + sizeof(""),
+        return_parse_end,
+        require_null_terminated);
+}
+
+CJSON_PUBLIC(cJSON *)
+cJSON_ParseWithLengthOpts(
+    const char * value,
+    size_t       buffer_length,
+    const char **return_parse_end,
+    cJSON_bool   require_null_terminated)
 {
     parse_buffer buffer = {0, 0, 0, 0, {0, 0, 0}};
     cJSON *      item   = NULL;
@@ -986,12 +1004,12 @@ cJSON_ParseWithOpts(
     global_error.json     = NULL;
     global_error.position = 0;
 
-    if (value == NULL) {
+    if (value == NULL || buffer_length == 0) {
         goto fail;
     }
 
     buffer.content = (const unsigned char *)value;
-    buffer.length  = strlen((const char *)value) + sizeof("");
+    buffer.length  = buffer_length;
     buffer.offset  = 0;
     buffer.hooks   = global_hooks;
 
@@ -1879,10 +1897,10 @@ add_item_to_object(
     return add_item_to_array(object, item);
 }
 
-CJSON_PUBLIC(void)
+CJSON_PUBLIC(cJSON_bool)
 cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item)
 {
-    add_item_to_object(object, string, item, &global_hooks, false);
+    return add_item_to_object(object, string, item, &global_hooks, false);
 }
 
 /* Add an item to an object with constant string as key */
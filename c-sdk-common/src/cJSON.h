@@ -174,6 +174,14 @@ cJSON_ParseWithOpts(
     const char * value,
     const char **return_parse_end,
     cJSON_bool   require_null_terminated);
+/* As ParseWithOpts, but value need not be null terminated, at most
+ * buffer_length bytes are read. */
+CJSON_PUBLIC(cJSON *)
+cJSON_ParseWithLengthOpts(
+    const char * value,
+    size_t       buffer_length,
+    const char **return_parse_end,
+    cJSON_bool   require_null_terminated);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
@@ -255,7 +263,7 @@ CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char **strings, int count);
 
 /* Append item to the specified array/object. */
 CJSON_PUBLIC(void) cJSON_AddItemToArray(cJSON *array, cJSON *item);
-CJSON_PUBLIC(void)
+CJSON_PUBLIC(cJSON_bool)
 cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item);
 /* Use this when string is definitely const (i.e. a literal, or as good as), and
  * will definitely survive the cJSON object. WARNING: When this function was
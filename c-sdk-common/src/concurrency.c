@@ -40,6 +40,44 @@ LDi_thread_join_imp(ld_thread_t *const thread)
     return status == 0;
 }
 
+/* for a thread that will never be joined, releases it once it exits */
+static LDBoolean
+LDi_thread_detach_imp(ld_thread_t *const thread)
+{
+    int status;
+
+    LD_ASSERT(thread);
+
+#ifdef _WIN32
+    if ((status = (CloseHandle(*thread) != 0) != LDBooleanTrue)) {
+        LD_LOG(LD_LOG_CRITICAL, "CloseHandle failed");
+    }
+#else
+    if ((status = pthread_detach(*thread)) != 0) {
+        LD_LOG_1(
+            LD_LOG_CRITICAL, "pthread_detach failed: %s", strerror(status));
+    }
+#endif
+
+#ifdef LAUNCHDARKLY_CONCURRENCY_ABORT
+    LD_ASSERT(status == 0);
+#endif
+
+    return status == 0;
+}
+
+static LDBoolean
+LDi_thread_is_current_imp(const ld_thread_t *const thread)
+{
+    LD_ASSERT(thread);
+
+#ifdef _WIN32
+    return GetThreadId(*thread) == GetCurrentThreadId();
+#else
+    return pthread_equal(*thread, pthread_self()) != 0;
+#endif
+}
+
 static LDBoolean
 LDi_thread_create_imp(
     ld_thread_t *const thread,
@@ -784,8 +822,10 @@ ld_mutex_unary_t LDi_mutex_nl_destroy = LDi_mutex_destroy_nl_imp;
 ld_mutex_unary_t LDi_mutex_nl_lock    = LDi_mutex_lock_nl_imp;
 ld_mutex_unary_t LDi_mutex_nl_unlock  = LDi_mutex_unlock_nl_imp;
 
-ld_thread_join_t   LDi_thread_join   = LDi_thread_join_imp;
-ld_thread_create_t LDi_thread_create = LDi_thread_create_imp;
+ld_thread_join_t       LDi_thread_join       = LDi_thread_join_imp;
+ld_thread_create_t     LDi_thread_create     = LDi_thread_create_imp;
+ld_thread_detach_t     LDi_thread_detach     = LDi_thread_detach_imp;
+ld_thread_is_current_t LDi_thread_is_current = LDi_thread_is_current_imp;
 
 ld_rwlock_unary_t LDi_rwlock_init     = LDi_rwlock_init_imp;
 ld_rwlock_unary_t LDi_rwlock_destroy  = LDi_rwlock_destroy_imp;
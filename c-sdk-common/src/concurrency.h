@@ -43,6 +43,8 @@
 typedef LDBoolean (*ld_mutex_unary_t)(ld_mutex_t *const mutex);
 
 typedef LDBoolean (*ld_thread_join_t)(ld_thread_t *const thread);
+typedef LDBoolean (*ld_thread_detach_t)(ld_thread_t *const thread);
+typedef LDBoolean (*ld_thread_is_current_t)(const ld_thread_t *const thread);
 typedef LDBoolean (*ld_thread_create_t)(
     ld_thread_t *const thread,
     THREAD_RETURN (*const routine)(void *),
@@ -64,8 +66,10 @@ extern ld_mutex_unary_t LDi_mutex_nl_destroy;
 extern ld_mutex_unary_t LDi_mutex_nl_lock;
 extern ld_mutex_unary_t LDi_mutex_nl_unlock;
 
-extern ld_thread_join_t   LDi_thread_join;
-extern ld_thread_create_t LDi_thread_create;
+extern ld_thread_join_t       LDi_thread_join;
+extern ld_thread_create_t     LDi_thread_create;
+extern ld_thread_detach_t     LDi_thread_detach;
+extern ld_thread_is_current_t LDi_thread_is_current;
 
 extern ld_rwlock_unary_t LDi_rwlock_init;
 extern ld_rwlock_unary_t LDi_rwlock_destroy;
@@ -1,8 +1,11 @@
+#include <string.h>
+
 #include "cJSON.h"
 
 #include <launchdarkly/json.h>
 
 #include "assertion.h"
+#include "utility.h"
 
 struct LDJSON *
 LDNewNull(void)
@@ -676,3 +679,53 @@ LDJSONDeserialize(const char *const text)
 
     return (struct LDJSON *)cJSON_Parse(text);
 }
+
+struct LDJSON *
+LDi_JSONDeserializePrefix(
+    const char *const text, const size_t length, const char **const end)
+{
+    LD_ASSERT(text);
+    LD_ASSERT(end);
+
+    return (struct LDJSON *)cJSON_ParseWithLengthOpts(text, length, end, 0);
+}
+
+LDBoolean
+LDi_objectAppendKey(
+    struct LDJSON *const object,
+    const char *const    key,
+    struct LDJSON *const item)
+{
+    LD_ASSERT(object);
+    LD_ASSERT(cJSON_IsObject((cJSON *)object));
+    LD_ASSERT(key);
+    LD_ASSERT(item);
+
+    return cJSON_AddItemToObject((cJSON *)object, key, (cJSON *)item);
+}
+
+size_t
+LDi_JSONFootprint(const struct LDJSON *const rawJSON)
+{
+    const struct cJSON *const json = (const struct cJSON *)rawJSON;
+    const struct cJSON *      iter;
+    size_t                    bytes;
+
+    LD_ASSERT(json);
+
+    bytes = sizeof(struct cJSON);
+
+    if (json->string) {
+        bytes += strlen(json->string) + 1;
+    }
+
+    if (json->valuestring) {
+        bytes += strlen(json->valuestring) + 1;
+    }
+
+    for (iter = json->child; iter; iter = iter->next) {
+        bytes += LDi_JSONFootprint((const struct LDJSON *)iter);
+    }
+
+    return bytes;
+}
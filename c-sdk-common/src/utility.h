@@ -74,6 +74,21 @@ LDBoolean
 LDi_isDeleted(const struct LDJSON *const feature);
 LDBoolean
 LDi_textInArray(const struct LDJSON *const array, const char *const text);
+/* estimate of the heap bytes used by a JSON tree */
+size_t
+LDi_JSONFootprint(const struct LDJSON *const json);
+/* parse the value at the start of text, which may continue past it. at most
+length bytes are read, and end is set to the first byte after the value */
+struct LDJSON *
+LDi_JSONDeserializePrefix(
+    const char *const text, const size_t length, const char **const end);
+/* add a key to an object without checking for an existing one. on failure
+ownership of item stays with the caller */
+LDBoolean
+LDi_objectAppendKey(
+    struct LDJSON *const object,
+    const char *const    key,
+    struct LDJSON *const item);
 int
 LDi_strncasecmp(const char *const s1, const char *const s2, const size_t n);
 
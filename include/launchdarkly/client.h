@@ -123,3 +123,95 @@ LD_EXPORT(LDBoolean) LDClientIsOffline(struct LDClient *const client);
  * @return True if signalled, False on error.
  */
 LD_EXPORT(LDBoolean) LDClientFlush(struct LDClient *const client);
+
+/**
+ * @brief Estimate the memory used by the client's in memory flag store. The
+ * result is an object with an entry for `features` and `segments`, each holding
+ * the number of cached `items` and their estimated `bytes`. The `largestFlags`
+ * array lists the largest cached flags by `key` and `bytes`, largest first.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] largestCount How many of the largest flags to report.
+ * @return A JSON object, or `NULL` on failure.
+ */
+LD_EXPORT(struct LDJSON *)
+LDClientGetMemoryStats(
+    struct LDClient *const client, const unsigned int largestCount);
+
+/**
+ * @brief Report the progress of background writes to the feature store
+ * backend, see `LDConfigSetFeatureStoreBackendWriteBehind`. The result is an
+ * object with the number of changes `queued` or being written, the age of the
+ * oldest of them as `lagMilliseconds`, and the number of backend writes
+ * `written` and `failed` since the client started.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @return A JSON object, or `NULL` on failure.
+ */
+LD_EXPORT(struct LDJSON *)
+LDClientGetStoreWriteStats(struct LDClient *const client);
+
+/** @brief An interned flag key, see `LDClientGetFlagHandle`. */
+typedef unsigned int LDFlagHandle;
+
+/** @brief Returned by `LDClientGetFlagHandle` on failure. Like a `NULL` key
+ * it may not be evaluated. */
+#define LD_INVALID_FLAG_HANDLE ((LDFlagHandle)0)
+
+/**
+ * @brief Get a handle to evaluate a flag with the `ByHandle` variation
+ * functions. Those look up the flag without hashing its key, which is worth
+ * doing for flags evaluated in hot paths. A handle stays valid across flag
+ * updates for the life of the client, and may be taken before the flag exists.
+ * The same key always returns the same handle.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] key The key of the flag. May not be `NULL`.
+ * @return A handle, or `LD_INVALID_FLAG_HANDLE` on failure.
+ */
+LD_EXPORT(LDFlagHandle)
+LDClientGetFlagHandle(struct LDClient *const client, const char *const key);
+
+/**
+ * @brief A callback notified of flag configuration changes.
+ * @param[in] flagKey The key of the changed flag. Only valid for the duration
+ * of the call.
+ * @param[in] userData The value given at registration.
+ */
+typedef void (*LDFlagChangeListener)(
+    const char *const flagKey, void *const userData);
+
+/**
+ * @brief Register a listener called with the key of every flag whose
+ * configuration changes, whether directly or through a prerequisite flag or
+ * segment it references. Listeners are called on a dedicated thread, not the
+ * network thread, and may evaluate flags, register and unregister listeners,
+ * and close the client.
+ *
+ * With a persistent store every flag is loaded from it when the first
+ * listener is registered. Changes made by another process, as in daemon mode,
+ * are only seen when the SDK next reads the store. A change is reported when
+ * it replaces a version the SDK had cached. A flag seen for the first time
+ * is not reported.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] listener The listener to call. May not be `NULL`.
+ * @param[in] userData Passed to each call of the listener. May be `NULL`.
+ * @return True on success, False on failure.
+ */
+LD_EXPORT(LDBoolean)
+LDClientRegisterFlagChangeListener(
+    struct LDClient *const     client,
+    const LDFlagChangeListener listener,
+    void *const                userData);
+
+/**
+ * @brief Remove a listener registered with the same `userData`. Once this
+ * returns the listener will not be called again. A listener removing itself
+ * finishes its current call.
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] listener The listener to remove. May not be `NULL`.
+ * @param[in] userData The value given at registration.
+ * @return True if the listener was removed, False if it was not registered.
+ */
+LD_EXPORT(LDBoolean)
+LDClientUnregisterFlagChangeListener(
+    struct LDClient *const     client,
+    const LDFlagChangeListener listener,
+    void *const                userData);
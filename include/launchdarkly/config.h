@@ -236,6 +236,154 @@ LD_EXPORT(void)
 LDConfigSetFeatureStoreBackendCacheTTL(
     struct LDConfig *const config, const unsigned int milliseconds);
 
+/**
+ * @brief When a feature store backend is provided, allow expired items to be
+ * served from the cache while they are refreshed from the backend in the
+ * background. Once an item has been expired for longer than this value lookups
+ * fetch it from the backend synchronously again. Set the value to zero to
+ * always fetch expired items synchronously. If no backend exists this value is
+ * ignored. The default is zero.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] milliseconds How long an expired item may be served.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendStaleTTL(
+    struct LDConfig *const config, const unsigned int milliseconds);
+
+/**
+ * @brief When a feature store backend is provided, refresh frequently read
+ * items from the backend in the background shortly before they expire from the
+ * cache. An item is refreshed ahead of time if it has been read at least this
+ * many times since it was last fetched. Items read less often expire normally.
+ * Set the value to zero to disable refresh ahead. If no backend exists, or the
+ * cache TTL is zero, this value is ignored. The default is zero.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] minimumReads How many reads make an item worth refreshing.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendRefreshAhead(
+    struct LDConfig *const config, const unsigned int minimumReads);
+
+/**
+ * @brief When a feature store backend is provided, limit how many flags and
+ * segments are cached in memory. When the limit is reached the least recently
+ * read items are evicted and fetched from the backend again when needed. Set
+ * the value to zero to cache every item read. If no backend exists this value
+ * is ignored. The default is zero.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] capacity The maximum number of items to cache.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendCacheCapacity(
+    struct LDConfig *const config, const unsigned int capacity);
+
+/**
+ * @brief When a feature store backend is provided, limit the estimated memory
+ * used by cached flags and segments. Items are evicted as with
+ * `LDConfigSetFeatureStoreBackendCacheCapacity`, and either limit may be used
+ * alone or together. Set the value to zero for no byte limit. If no backend
+ * exists this value is ignored. The default is zero.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] maxBytes The maximum estimated bytes of cached items.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendCacheMaxBytes(
+    struct LDConfig *const config, const size_t maxBytes);
+
+/**
+ * @brief When a feature store backend is provided, write flags and segments to
+ * it in a compact binary encoding instead of JSON. The encoding is smaller and
+ * faster to load, but only this SDK can read it, so leave it disabled if other
+ * SDKs share the backend. It is only used if the backend supports it, and
+ * items of either encoding are always read. The default is false.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] compactItems Whether to write the compact encoding.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendCompactItems(
+    struct LDConfig *const config, const LDBoolean compactItems);
+
+/**
+ * @brief When a feature store backend is provided, apply updates to the in
+ * memory cache at once and write them to the backend from a background thread,
+ * so a slow backend does not delay later updates. Queued changes to the same
+ * item are coalesced, and items are not expired from the cache until written.
+ * Changes that still fail to write when the client is closed are lost, see
+ * `LDClientGetStoreWriteStats`. The default is false.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] writeBehind Whether to write to the backend in the background.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendWriteBehind(
+    struct LDConfig *const config, const LDBoolean writeBehind);
+
+/**
+ * @brief Declare that this client is the only writer to the feature store
+ * backend, which then serves only to persist data across restarts. Once the
+ * client receives flags from LaunchDarkly the in memory cache is authoritative:
+ * items never expire, reads never go to the backend, and updates are still
+ * written through to it. The cache capacity, stale TTL, and refresh ahead
+ * settings are not used in this mode. Ignored with `LDConfigSetUseLDD`, where
+ * other processes update the backend. The default is false.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] soleWriter Whether this client is the only backend writer.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendSoleWriter(
+    struct LDConfig *const config, const LDBoolean soleWriter);
+
+/**
+ * @brief With `LDConfigSetUseLDD`, load every flag and segment from the
+ * feature store backend in `LDClientInit` instead of fetching each item on its
+ * first evaluation. The collections are then reloaded in the background before
+ * the cache TTL expires, so evaluations are served from memory. Has no effect
+ * with a cache TTL of zero, or outside of daemon mode. The default is false.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] warmUp Whether to load and reload whole collections.
+ * @return Void.
+ */
+LD_EXPORT(void)
+LDConfigSetFeatureStoreBackendWarmUp(
+    struct LDConfig *const config, const LDBoolean warmUp);
+
+/**
+ * @brief Persist flags and segments to a binary snapshot file after each full
+ * update from LaunchDarkly, and load it when the client starts. Evaluations can
+ * then use the last known data before the first update arrives. The file is
+ * replaced atomically. Ignored when a feature store backend is provided, as the
+ * backend already persists the data. Disabled by default.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] path The file to write and load. May be `NULL` to disable
+ * snapshots again.
+ * @return True on success, False on failure.
+ */
+LD_EXPORT(LDBoolean)
+LDConfigSetFeatureStoreSnapshotPath(
+    struct LDConfig *const config, const char *const path);
+
+/**
+ * @brief Read flags and segments from a local file instead of connecting to
+ * LaunchDarkly. The file uses the format of the `/sdk/latest-all` response, an
+ * object with `flags` and `segments` objects keyed by item key. The file is
+ * watched and rewrites are applied incrementally, so an item only changes when
+ * its version changes. Polling and streaming are disabled, events are still
+ * sent unless disabled separately.
+ * @param[in] config The configuration to modify. May not be `NULL`.
+ * @param[in] path The file to read. May be `NULL` to connect to
+ * LaunchDarkly again.
+ * @return True on success, False on failure.
+ */
+LD_EXPORT(LDBoolean)
+LDConfigSetFileDataSource(
+    struct LDConfig *const config, const char *const path);
+
 /**
  * @brief Indicates to LaunchDarkly the name and version of an SDK wrapper
  * library. If `wrapperVersion` is set `wrapperName` must be set.
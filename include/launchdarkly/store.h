@@ -19,8 +19,13 @@
 struct LDStoreCollectionItem
 {
     /** @brief May be NULL to indicate a deleted item */
-    void *       buffer;
-    size_t       bufferSize;
+    void * buffer;
+    size_t bufferSize;
+    /**
+     * @brief The version of the item. Always set by the store when writing,
+     * so a backend may record it beside the buffer and compare versions
+     * without parsing. On reads it is only required for deleted items.
+     */
     unsigned int version;
 };
 
@@ -135,6 +140,85 @@ struct LDStoreInterface
      * @return Void.
      */
     void (*destructor)(void *const context);
+    /**
+     * @brief Fetch several features of one namespace in a single operation.
+     * Optional, when NULL `get` is called for each key instead.
+     * @param[in] context Implementation specific context.
+     * May not be NULL (assert).
+     * @param[in] kind The namespace to search in.
+     * May not be NULL (assert).
+     * @param[in] featureKeys The keys to return values for.
+     * May not be NULL (assert).
+     * @param[in] keyCount The number of keys.
+     * @param[out] results An array of `keyCount` items, filled in the order of
+     * `featureKeys`. The buffer of an item is NULL if it does not exist. No
+     * buffers are returned on failure.
+     * @return True on success, False on failure.
+     */
+    LDBoolean (*getMany)(
+        void *const                         context,
+        const char *const                   kind,
+        const char *const *const            featureKeys,
+        const unsigned int                  keyCount,
+        struct LDStoreCollectionItem *const results);
+    /**
+     * @brief Fetch a feature without copying it out of backend memory.
+     * Optional, used instead of `get` when both it and `release` are set.
+     * @param[in] context Implementation specific context.
+     * May not be NULL (assert).
+     * @param[in] kind The namespace to search in.
+     * May not be NULL (assert).
+     * @param[in] featureKey The key to return the value for.
+     * May not be NULL (assert).
+     * @param[out] result Returns the feature, or NULL if it does not exist.
+     * The buffer must be NUL terminated and stays valid until `release`.
+     * @param[out] token Passed to `release` once the store has parsed the
+     * item. Only set on success.
+     * @return True on success, False on failure.
+     */
+    LDBoolean (*getBorrowed)(
+        void *const                         context,
+        const char *const                   kind,
+        const char *const                   featureKey,
+        struct LDStoreCollectionItem *const result,
+        void **const                        token);
+    /**
+     * @brief Fetch all features in a given namespace without copying them
+     * out of backend memory. Optional, used instead of `all` when both it and
+     * `release` are set.
+     * @param[in] context Implementation specific context.
+     * May not be NULL (assert).
+     * @param[in] kind The namespace to search in.
+     * May not be NULL (assert).
+     * @param[out] result Returns an array of items. The array and every
+     * buffer, which must be NUL terminated, stay valid until `release`.
+     * @param[out] resultCount Returns the number of items in the result array.
+     * @param[out] token Passed to `release` once the store has parsed the
+     * items. Only set on success.
+     * @return True on success, False on failure.
+     */
+    LDBoolean (*allBorrowed)(
+        void *const                          context,
+        const char *const                    kind,
+        struct LDStoreCollectionItem **const result,
+        unsigned int *const                  resultCount,
+        void **const                         token);
+    /**
+     * @brief Free memory handed out by `getBorrowed` or `allBorrowed`.
+     * @param[in] context Implementation specific context.
+     * May not be NULL (assert).
+     * @param[in] token The token returned with the borrowed items.
+     * @return Void.
+     */
+    void (*release)(void *const context, void *const token);
+    /**
+     * @brief Set when buffers are kept with their length as arbitrary bytes,
+     * never assuming NUL terminated text. The store may then write items in
+     * its compact binary encoding, see
+     * `LDConfigSetFeatureStoreBackendCompactItems`. Buffers read back must
+     * still be NUL terminated.
+     */
+    LDBoolean compactItems;
 };
 
 /*@}*/
@@ -238,6 +238,107 @@ LDJSONVariation(
     const struct LDJSON *const fallback,
     struct LDDetails *const    details);
 
+/**
+ * @brief Evaluate a boolean flag by handle, see `LDClientGetFlagHandle`
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] user The user to evaluate the flag against. May not be `NULL`.
+ * @param[in] handle A handle from the same client. May not be
+ * `LD_INVALID_FLAG_HANDLE`.
+ * @param[in] fallback The value to return on error
+ * @param[out] details A struct where the evaluation explanation will be put.
+ * If `NULL` no explanation will be generated.
+ * @return The fallback will be returned on any error.
+ */
+LD_EXPORT(LDBoolean)
+LDBoolVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const LDBoolean            fallback,
+    struct LDDetails *const    details);
+
+/**
+ * @brief Evaluate a integer flag by handle, see `LDClientGetFlagHandle`
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] user The user to evaluate the flag against. May not be `NULL`.
+ * @param[in] handle A handle from the same client. May not be
+ * `LD_INVALID_FLAG_HANDLE`.
+ * @param[in] fallback The value to return on error
+ * @param[out] details A struct where the evaluation explanation will be put.
+ * If `NULL` no explanation will be generated.
+ * @return The fallback will be returned on any error.
+ */
+LD_EXPORT(int)
+LDIntVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const int                  fallback,
+    struct LDDetails *const    details);
+
+/**
+ * @brief Evaluate a double flag by handle, see `LDClientGetFlagHandle`
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] user The user to evaluate the flag against. May not be `NULL`.
+ * @param[in] handle A handle from the same client. May not be
+ * `LD_INVALID_FLAG_HANDLE`.
+ * @param[in] fallback The value to return on error
+ * @param[out] details A struct where the evaluation explanation will be put.
+ * If `NULL` no explanation will be generated.
+ * @return The fallback will be returned on any error.
+ */
+LD_EXPORT(double)
+LDDoubleVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const double               fallback,
+    struct LDDetails *const    details);
+
+/**
+ * @brief Evaluate a text flag by handle, see `LDClientGetFlagHandle`
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] user The user to evaluate the flag against. May not be `NULL`.
+ * @param[in] handle A handle from the same client. May not be
+ * `LD_INVALID_FLAG_HANDLE`.
+ * @param[in] fallback The value to return on error. Ownership is not
+ * transferred. May be `NULL`.
+ * @param[out] details A struct where the evaluation explanation will be put.
+ * If `NULL` no explanation will be generated.
+ * @return The fallback will be returned on any error but may be `NULL` on
+ * allocation failure.
+ * The result must be cleaned up with `LDFree`.
+ */
+LD_EXPORT(char *)
+LDStringVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const char *const          fallback,
+    struct LDDetails *const    details);
+
+/**
+ * @brief Evaluate a JSON flag by handle, see `LDClientGetFlagHandle`
+ * @param[in] client The client to use. May not be `NULL`.
+ * @param[in] user The user to evaluate the flag against. May not be `NULL`.
+ * @param[in] handle A handle from the same client. May not be
+ * `LD_INVALID_FLAG_HANDLE`.
+ * @param[in] fallback The fallback to return on error. Ownership is not
+ * transferred. May be `NULL`.
+ * @param[out] details A struct where the evaluation explanation will be put.
+ * If `NULL` no explanation will be generated.
+ * @return The fallback will be returned on any error but may be `NULL` on
+ * allocation failure.
+ * The result must be cleaned up with `LDJSONFree`.
+ */
+LD_EXPORT(struct LDJSON *)
+LDJSONVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const struct LDJSON *const fallback,
+    struct LDDetails *const    details);
+
 /**
  * @brief Returns a map from feature flag keys to values for a given user.
  * This does not send analytics events back to LaunchDarkly.
@@ -55,6 +55,24 @@ LDClientInit(struct LDConfig *const config, const unsigned int maxwaitmilli)
 
     LDi_rwlock_init(&client->lock);
 
+    /* serve the last known data while waiting on the first update */
+    if (config->storeSnapshotPath) {
+        LDStoreLoadSnapshot(client->store);
+    }
+
+    /* the relay keeps the backend current, load it in one pass */
+    if (config->useLDD && !LDStoreWarmUp(client->store)) {
+        LD_LOG(LD_LOG_ERROR, "failed to warm up store from backend");
+    }
+
+    if (config->fileDataSourcePath) {
+        if (!(client->fileSource = LDi_startFileSource(
+                  client->store, config->fileDataSourcePath)))
+        {
+            LD_LOG(LD_LOG_ERROR, "failed to start file data source");
+        }
+    }
+
     LDi_thread_create(&client->thread, LDi_networkthread, client);
 
     LD_LOG(LD_LOG_INFO, "waiting to initialize");
@@ -89,6 +107,8 @@ LDClientClose(struct LDClient *const client)
         /* wait until background exits */
         LDi_thread_join(&client->thread);
 
+        LDi_stopFileSource(client->fileSource);
+
         /* cleanup resources */
         LDi_rwlock_destroy(&client->lock);
         LDi_freeEventProcessor(client->eventProcessor);
@@ -283,3 +303,140 @@ LDClientFlush(struct LDClient *const client)
 
     return LDBooleanTrue;
 }
+
+struct LDJSON *
+LDClientGetMemoryStats(
+    struct LDClient *const client, const unsigned int largestCount)
+{
+    struct LDJSON *stats;
+
+    LD_ASSERT_API(client);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetMemoryStats NULL client");
+
+        return NULL;
+    }
+#endif
+
+    if (!LDStoreMemoryStats(client->store, largestCount, &stats)) {
+        LD_LOG(LD_LOG_ERROR, "LDClientGetMemoryStats failed");
+
+        return NULL;
+    }
+
+    return stats;
+}
+
+struct LDJSON *
+LDClientGetStoreWriteStats(struct LDClient *const client)
+{
+    struct LDJSON *stats;
+
+    LD_ASSERT_API(client);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetStoreWriteStats NULL client");
+
+        return NULL;
+    }
+#endif
+
+    if (!LDStoreWriteBehindStats(client->store, &stats)) {
+        LD_LOG(LD_LOG_ERROR, "LDClientGetStoreWriteStats failed");
+
+        return NULL;
+    }
+
+    return stats;
+}
+
+LDFlagHandle
+LDClientGetFlagHandle(struct LDClient *const client, const char *const key)
+{
+    LDFlagHandle handle;
+
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(key);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetFlagHandle NULL client");
+
+        return LD_INVALID_FLAG_HANDLE;
+    }
+
+    if (key == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDClientGetFlagHandle NULL key");
+
+        return LD_INVALID_FLAG_HANDLE;
+    }
+#endif
+
+    if (!LDStoreFlagHandle(client->store, key, &handle)) {
+        LD_LOG(LD_LOG_ERROR, "LDClientGetFlagHandle failed");
+
+        return LD_INVALID_FLAG_HANDLE;
+    }
+
+    return handle;
+}
+
+LDBoolean
+LDClientRegisterFlagChangeListener(
+    struct LDClient *const     client,
+    const LDFlagChangeListener listener,
+    void *const                userData)
+{
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(listener);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING, "LDClientRegisterFlagChangeListener NULL client");
+
+        return LDBooleanFalse;
+    }
+
+    if (listener == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING, "LDClientRegisterFlagChangeListener NULL listener");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    return LDStoreRegisterListener(client->store, listener, userData);
+}
+
+LDBoolean
+LDClientUnregisterFlagChangeListener(
+    struct LDClient *const     client,
+    const LDFlagChangeListener listener,
+    void *const                userData)
+{
+    LD_ASSERT_API(client);
+    LD_ASSERT_API(listener);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (client == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING, "LDClientUnregisterFlagChangeListener NULL client");
+
+        return LDBooleanFalse;
+    }
+
+    if (listener == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDClientUnregisterFlagChangeListener NULL listener");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    return LDStoreUnregisterListener(client->store, listener, userData);
+}
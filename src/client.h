@@ -4,6 +4,7 @@
 
 #include "concurrency.h"
 #include "event_processor.h"
+#include "file_source.h"
 #include "lru.h"
 
 struct LDClient
@@ -15,4 +16,6 @@ struct LDClient
     LDBoolean              shouldFlush;
     struct LDStore *       store;
     struct EventProcessor *eventProcessor;
+    /* only when reading flags from a local file */
+    struct LDFileSource *fileSource;
 };
@@ -0,0 +1,536 @@
+#include <math.h>
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "compact_item.h"
+#include "store.h"
+#include "utility.h"
+
+/* the format is the magic, the item version as four big endian bytes, then
+the item as a tagged value. counts, lengths, and integers are little endian
+base 128 varints, fractions are an integer mantissa and a zigzag exponent */
+static const unsigned char COMPACT_MAGIC[4] = { 0xFF, 'L', 'D', 1 };
+
+#define COMPACT_HEADER_SIZE (sizeof(COMPACT_MAGIC) + 4)
+
+/* deeper values are rejected instead of exhausting the stack */
+#define COMPACT_MAX_DEPTH 256
+
+/* the longest varint, enough for integers up to 2^53 */
+#define COMPACT_MAX_VARINT 8
+
+enum CompactTag
+{
+    TAG_NULL,
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_INTEGER,
+    TAG_NEGATIVE_INTEGER,
+    TAG_FRACTION,
+    TAG_NEGATIVE_FRACTION,
+    TAG_TEXT,
+    TAG_WORD,
+    TAG_ARRAY,
+    TAG_OBJECT
+};
+
+/* field names and operators written as their index. part of the format, new
+words may only be appended */
+static const char *const COMPACT_WORDS[] = {
+    "key",
+    "version",
+    "deleted",
+    "on",
+    "salt",
+    "variations",
+    "offVariation",
+    "fallthrough",
+    "variation",
+    "rollout",
+    "weight",
+    "bucketBy",
+    "rules",
+    "id",
+    "clauses",
+    "attribute",
+    "op",
+    "values",
+    "negate",
+    "targets",
+    "prerequisites",
+    "trackEvents",
+    "trackEventsFallthrough",
+    "debugEventsUntilDate",
+    "clientSide",
+    "included",
+    "excluded",
+    "kind",
+    "seed",
+    "untracked",
+    "experiment",
+    "in",
+    "endsWith",
+    "startsWith",
+    "matches",
+    "contains",
+    "lessThan",
+    "lessThanOrEqual",
+    "greaterThan",
+    "greaterThanOrEqual",
+    "before",
+    "after",
+    "segmentMatch",
+    "semVerEqual",
+    "semVerLessThan",
+    "semVerGreaterThan",
+    "email",
+    "country",
+    "name",
+    "anonymous",
+    "ip"
+};
+
+#define COMPACT_WORD_COUNT (sizeof(COMPACT_WORDS) / sizeof(COMPACT_WORDS[0]))
+
+/* larger zigzag exponents are beyond the range of a double */
+#define COMPACT_MAX_EXPONENT 4096
+
+/* integers from zero to this are exact in a double */
+static const double COMPACT_MAX_INTEGER = 9007199254740992.0;
+
+/* **** Encoding **** */
+
+struct CompactWriter
+{
+    unsigned char *buffer;
+    size_t         length;
+    size_t         capacity;
+};
+
+static LDBoolean
+putBytes(
+    struct CompactWriter *const writer,
+    const void *const           bytes,
+    const size_t                length)
+{
+    if (writer->capacity - writer->length < length) {
+        unsigned char *buffer;
+        size_t         capacity;
+
+        capacity = writer->capacity * 2;
+
+        while (capacity - writer->length < length) {
+            capacity *= 2;
+        }
+
+        if (!(buffer = (unsigned char *)LDRealloc(writer->buffer, capacity))) {
+            return LDBooleanFalse;
+        }
+
+        writer->buffer   = buffer;
+        writer->capacity = capacity;
+    }
+
+    memcpy(writer->buffer + writer->length, bytes, length);
+    writer->length += length;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+putByte(struct CompactWriter *const writer, const unsigned char byte)
+{
+    return putBytes(writer, &byte, 1);
+}
+
+/* value is a non negative integer, arithmetic is on doubles as unsigned long
+may not hold every version or timestamp */
+static LDBoolean
+putVarint(struct CompactWriter *const writer, double value)
+{
+    do {
+        unsigned char byte;
+
+        byte  = (unsigned char)fmod(value, 128);
+        value = floor(value / 128);
+
+        if (value > 0) {
+            byte |= 0x80;
+        }
+
+        if (!putByte(writer, byte)) {
+            return LDBooleanFalse;
+        }
+    } while (value > 0);
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+putNumber(struct CompactWriter *const writer, const double value)
+{
+    const LDBoolean negative = value < 0;
+    const double    absolute = fabs(value);
+
+    if (absolute == floor(absolute) && absolute <= COMPACT_MAX_INTEGER) {
+        return putByte(writer, negative ? TAG_NEGATIVE_INTEGER : TAG_INTEGER) &&
+               putVarint(writer, absolute);
+    } else {
+        double mantissa;
+        int    exponent;
+
+        mantissa = ldexp(frexp(absolute, &exponent), 53);
+        exponent -= 53;
+
+        return putByte(
+                   writer, negative ? TAG_NEGATIVE_FRACTION : TAG_FRACTION) &&
+               putVarint(writer, mantissa) &&
+               putVarint(
+                   writer,
+                   exponent >= 0 ? 2.0 * exponent : -2.0 * exponent - 1);
+    }
+}
+
+static LDBoolean
+putText(struct CompactWriter *const writer, const char *const text)
+{
+    unsigned int i;
+
+    for (i = 0; i < COMPACT_WORD_COUNT; i++) {
+        if (strcmp(COMPACT_WORDS[i], text) == 0) {
+            return putByte(writer, TAG_WORD) &&
+                   putByte(writer, (unsigned char)i);
+        }
+    }
+
+    {
+        const size_t length = strlen(text) + 1;
+
+        return putByte(writer, TAG_TEXT) && putVarint(writer, length) &&
+               putBytes(writer, text, length);
+    }
+}
+
+static LDBoolean
+putValue(struct CompactWriter *const writer, const struct LDJSON *const value)
+{
+    const struct LDJSON *iter;
+
+    switch (LDJSONGetType(value)) {
+    case LDNull:
+        return putByte(writer, TAG_NULL);
+    case LDBool:
+        return putByte(writer, LDGetBool(value) ? TAG_TRUE : TAG_FALSE);
+    case LDNumber:
+        return putNumber(writer, LDGetNumber(value));
+    case LDText:
+        return putText(writer, LDGetText(value));
+    case LDArray:
+        if (!putByte(writer, TAG_ARRAY) ||
+            !putVarint(writer, LDCollectionGetSize(value)))
+        {
+            return LDBooleanFalse;
+        }
+
+        for (iter = LDGetIter(value); iter; iter = LDIterNext(iter)) {
+            if (!putValue(writer, iter)) {
+                return LDBooleanFalse;
+            }
+        }
+
+        return LDBooleanTrue;
+    case LDObject:
+        if (!putByte(writer, TAG_OBJECT) ||
+            !putVarint(writer, LDCollectionGetSize(value)))
+        {
+            return LDBooleanFalse;
+        }
+
+        for (iter = LDGetIter(value); iter; iter = LDIterNext(iter)) {
+            if (!putText(writer, LDIterKey(iter)) || !putValue(writer, iter)) {
+                return LDBooleanFalse;
+            }
+        }
+
+        return LDBooleanTrue;
+    default:
+        return LDBooleanFalse;
+    }
+}
+
+LDBoolean
+LDi_encodeCompactItem(
+    const struct LDJSON *const item, void **const buffer, size_t *const size)
+{
+    struct CompactWriter writer;
+    unsigned char        version[4];
+    unsigned int         number;
+
+    LD_ASSERT(item);
+    LD_ASSERT(buffer);
+    LD_ASSERT(size);
+
+    writer.length   = 0;
+    writer.capacity = 256;
+
+    if (!(writer.buffer = (unsigned char *)LDAlloc(writer.capacity))) {
+        return LDBooleanFalse;
+    }
+
+    number     = LDi_getFeatureVersionTrusted(item);
+    version[0] = (unsigned char)((number >> 24) & 0xFF);
+    version[1] = (unsigned char)((number >> 16) & 0xFF);
+    version[2] = (unsigned char)((number >> 8) & 0xFF);
+    version[3] = (unsigned char)(number & 0xFF);
+
+    if (!putBytes(&writer, COMPACT_MAGIC, sizeof(COMPACT_MAGIC)) ||
+        !putBytes(&writer, version, sizeof(version)) ||
+        !putValue(&writer, item))
+    {
+        LD_LOG(LD_LOG_ERROR, "failed to encode compact item");
+
+        LDFree(writer.buffer);
+
+        return LDBooleanFalse;
+    }
+
+    *buffer = writer.buffer;
+    *size   = writer.length;
+
+    return LDBooleanTrue;
+}
+
+/* **** Decoding **** */
+
+struct CompactReader
+{
+    const unsigned char *cursor;
+    const unsigned char *end;
+};
+
+static LDBoolean
+getVarint(struct CompactReader *const reader, double *const value)
+{
+    double       scale;
+    unsigned int i;
+
+    *value = 0;
+    scale  = 1;
+
+    for (i = 0; i < COMPACT_MAX_VARINT && reader->cursor < reader->end; i++) {
+        const unsigned char byte = *reader->cursor++;
+
+        *value += (byte & 0x7F) * scale;
+        scale *= 128;
+
+        if (!(byte & 0x80)) {
+            return LDBooleanTrue;
+        }
+    }
+
+    return LDBooleanFalse;
+}
+
+/* text is used in place, the terminator is checked instead of copying */
+static const char *
+getText(struct CompactReader *const reader, const unsigned char tag)
+{
+    const char *text;
+    double      length;
+
+    if (tag == TAG_WORD) {
+        if (reader->cursor == reader->end ||
+            *reader->cursor >= COMPACT_WORD_COUNT) {
+            return NULL;
+        }
+
+        return COMPACT_WORDS[*reader->cursor++];
+    } else if (tag != TAG_TEXT) {
+        return NULL;
+    }
+
+    if (!getVarint(reader, &length) || length < 1 ||
+        length > (double)(reader->end - reader->cursor))
+    {
+        return NULL;
+    }
+
+    text = (const char *)reader->cursor;
+
+    if (text[(size_t)length - 1] != '\0') {
+        return NULL;
+    }
+
+    reader->cursor += (size_t)length;
+
+    return text;
+}
+
+static struct LDJSON *
+getValue(struct CompactReader *const reader, const unsigned int depth);
+
+static struct LDJSON *
+getCollection(
+    struct CompactReader *const reader,
+    const unsigned char         tag,
+    const unsigned int          depth)
+{
+    struct LDJSON *collection, *child;
+    const char *   key;
+    double         count, i;
+
+    if (!getVarint(reader, &count)) {
+        return NULL;
+    }
+
+    if (!(collection = tag == TAG_ARRAY ? LDNewArray() : LDNewObject())) {
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        key = NULL;
+
+        if (tag == TAG_OBJECT) {
+            if (reader->cursor == reader->end ||
+                !(key = getText(reader, *reader->cursor++)))
+            {
+                goto error;
+            }
+        }
+
+        if (!(child = getValue(reader, depth + 1))) {
+            goto error;
+        }
+
+        if (key) {
+            /* the encoder never writes duplicate keys */
+            if (!LDi_objectAppendKey(collection, key, child)) {
+                LDJSONFree(child);
+
+                goto error;
+            }
+        } else if (!LDArrayPush(collection, child)) {
+            LDJSONFree(child);
+
+            goto error;
+        }
+    }
+
+    return collection;
+
+error:
+    LDJSONFree(collection);
+
+    return NULL;
+}
+
+static struct LDJSON *
+getValue(struct CompactReader *const reader, const unsigned int depth)
+{
+    unsigned char tag;
+    const char *  text;
+    double        number, exponent;
+
+    if (depth > COMPACT_MAX_DEPTH || reader->cursor == reader->end) {
+        return NULL;
+    }
+
+    tag = *reader->cursor++;
+
+    switch (tag) {
+    case TAG_NULL:
+        return LDNewNull();
+    case TAG_FALSE:
+        return LDNewBool(LDBooleanFalse);
+    case TAG_TRUE:
+        return LDNewBool(LDBooleanTrue);
+    case TAG_INTEGER:
+    case TAG_NEGATIVE_INTEGER:
+        if (!getVarint(reader, &number)) {
+            return NULL;
+        }
+
+        return LDNewNumber(tag == TAG_NEGATIVE_INTEGER ? -number : number);
+    case TAG_FRACTION:
+    case TAG_NEGATIVE_FRACTION:
+        if (!getVarint(reader, &number) || !getVarint(reader, &exponent) ||
+            exponent > COMPACT_MAX_EXPONENT)
+        {
+            return NULL;
+        }
+
+        /* undo the zigzag encoding */
+        if (fmod(exponent, 2) == 0) {
+            number = ldexp(number, (int)(exponent / 2));
+        } else {
+            number = ldexp(number, -(int)((exponent + 1) / 2));
+        }
+
+        return LDNewNumber(tag == TAG_NEGATIVE_FRACTION ? -number : number);
+    case TAG_TEXT:
+    case TAG_WORD:
+        if (!(text = getText(reader, tag))) {
+            return NULL;
+        }
+
+        return LDNewText(text);
+    case TAG_ARRAY:
+    case TAG_OBJECT:
+        return getCollection(reader, tag, depth);
+    default:
+        return NULL;
+    }
+}
+
+LDBoolean
+LDi_isCompactItem(const void *const buffer, const size_t size)
+{
+    return buffer && size >= COMPACT_HEADER_SIZE &&
+           memcmp(buffer, COMPACT_MAGIC, sizeof(COMPACT_MAGIC)) == 0;
+}
+
+LDBoolean
+LDi_compactItemVersion(
+    const void *const buffer, const size_t size, unsigned int *const version)
+{
+    const unsigned char *bytes;
+
+    LD_ASSERT(version);
+
+    if (!LDi_isCompactItem(buffer, size)) {
+        return LDBooleanFalse;
+    }
+
+    bytes    = (const unsigned char *)buffer + sizeof(COMPACT_MAGIC);
+    *version = ((unsigned int)bytes[0] << 24) |
+               ((unsigned int)bytes[1] << 16) |
+               ((unsigned int)bytes[2] << 8) | (unsigned int)bytes[3];
+
+    return LDBooleanTrue;
+}
+
+struct LDJSON *
+LDi_decodeCompactItem(const void *const buffer, const size_t size)
+{
+    struct CompactReader reader;
+    struct LDJSON *      item;
+
+    if (!LDi_isCompactItem(buffer, size)) {
+        return NULL;
+    }
+
+    reader.cursor = (const unsigned char *)buffer + COMPACT_HEADER_SIZE;
+    reader.end    = (const unsigned char *)buffer + size;
+
+    if (!(item = getValue(&reader, 0)) || reader.cursor != reader.end) {
+        LD_LOG(LD_LOG_ERROR, "compact item is malformed");
+
+        LDJSONFree(item);
+
+        return NULL;
+    }
+
+    return item;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <launchdarkly/json.h>
+
+/* A binary encoding of store items for backends that keep buffers with their
+length. Strings are length prefixed and NUL terminated so they are used in
+place, and operators and well known field names are single byte identifiers.
+The item version leads the encoding so it can be read without decoding. JSON
+text never starts with the same byte, so buffers of either format are told
+apart without negotiation on read. */
+
+/* True when `buffer` holds a compact item rather than JSON text. */
+LDBoolean
+LDi_isCompactItem(const void *const buffer, const size_t size);
+
+/* Encode a validated item. The result is allocated with `LDAlloc`. */
+LDBoolean
+LDi_encodeCompactItem(
+    const struct LDJSON *const item, void **const buffer, size_t *const size);
+
+/* Decode a compact item, returning `NULL` when it is malformed. */
+struct LDJSON *
+LDi_decodeCompactItem(const void *const buffer, const size_t size);
+
+/* Read the version of a compact item without decoding it. */
+LDBoolean
+LDi_compactItemVersion(
+    const void *const buffer, const size_t size, unsigned int *const version);
@@ -62,6 +62,16 @@ LDConfigNew(const char *const key)
     config->userKeysFlushInterval  = 300000;
     config->storeBackend           = NULL;
     config->storeCacheMilliseconds = 30 * 1000;
+    config->storeStaleMilliseconds = 0;
+    config->storeRefreshAheadReads = 0;
+    config->storeCacheCapacity     = 0;
+    config->storeCacheMaxBytes     = 0;
+    config->storeCompactItems      = LDBooleanFalse;
+    config->storeWriteBehind       = LDBooleanFalse;
+    config->storeSoleWriter        = LDBooleanFalse;
+    config->storeWarmUp            = LDBooleanFalse;
+    config->storeSnapshotPath      = NULL;
+    config->fileDataSourcePath     = NULL;
     config->wrapperName            = NULL;
     config->wrapperVersion         = NULL;
 
@@ -90,6 +100,8 @@ LDConfigFree(struct LDConfig *const config)
         LDFree(config->streamURI);
         LDFree(config->eventsURI);
         LDJSONFree(config->privateAttributeNames);
+        LDFree(config->storeSnapshotPath);
+        LDFree(config->fileDataSourcePath);
         LDFree(config->wrapperName);
         LDFree(config->wrapperVersion);
         LDFree(config);
@@ -431,6 +443,191 @@ LDConfigSetFeatureStoreBackendCacheTTL(
     config->storeCacheMilliseconds = milliseconds;
 }
 
+void
+LDConfigSetFeatureStoreBackendStaleTTL(
+    struct LDConfig *const config, const unsigned int milliseconds)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendStaleTTL NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeStaleMilliseconds = milliseconds;
+}
+
+void
+LDConfigSetFeatureStoreBackendRefreshAhead(
+    struct LDConfig *const config, const unsigned int minimumReads)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendRefreshAhead NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeRefreshAheadReads = minimumReads;
+}
+
+void
+LDConfigSetFeatureStoreBackendCacheCapacity(
+    struct LDConfig *const config, const unsigned int capacity)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendCacheCapacity NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeCacheCapacity = capacity;
+}
+
+void
+LDConfigSetFeatureStoreBackendCacheMaxBytes(
+    struct LDConfig *const config, const size_t maxBytes)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendCacheMaxBytes NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeCacheMaxBytes = maxBytes;
+}
+
+void
+LDConfigSetFeatureStoreBackendCompactItems(
+    struct LDConfig *const config, const LDBoolean compactItems)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendCompactItems NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeCompactItems = compactItems;
+}
+
+void
+LDConfigSetFeatureStoreBackendWriteBehind(
+    struct LDConfig *const config, const LDBoolean writeBehind)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendWriteBehind NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeWriteBehind = writeBehind;
+}
+
+void
+LDConfigSetFeatureStoreBackendSoleWriter(
+    struct LDConfig *const config, const LDBoolean soleWriter)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "LDConfigSetFeatureStoreBackendSoleWriter NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeSoleWriter = soleWriter;
+}
+
+void
+LDConfigSetFeatureStoreBackendWarmUp(
+    struct LDConfig *const config, const LDBoolean warmUp)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING, "LDConfigSetFeatureStoreBackendWarmUp NULL config");
+
+        return;
+    }
+#endif
+
+    config->storeWarmUp = warmUp;
+}
+
+LDBoolean
+LDConfigSetFeatureStoreSnapshotPath(
+    struct LDConfig *const config, const char *const path)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(
+            LD_LOG_WARNING, "LDConfigSetFeatureStoreSnapshotPath NULL config");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    return LDSetString(&config->storeSnapshotPath, path);
+}
+
+LDBoolean
+LDConfigSetFileDataSource(struct LDConfig *const config, const char *const path)
+{
+    LD_ASSERT_API(config);
+
+#ifdef LAUNCHDARKLY_DEFENSIVE
+    if (config == NULL) {
+        LD_LOG(LD_LOG_WARNING, "LDConfigSetFileDataSource NULL config");
+
+        return LDBooleanFalse;
+    }
+#endif
+
+    return LDSetString(&config->fileDataSourcePath, path);
+}
+
 LDBoolean
 LDConfigSetWrapperInfo(
     struct LDConfig *const config,
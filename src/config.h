@@ -24,6 +24,16 @@ struct LDConfig
     unsigned int             userKeysFlushInterval;
     struct LDStoreInterface *storeBackend;
     unsigned int             storeCacheMilliseconds;
+    unsigned int             storeStaleMilliseconds;
+    unsigned int             storeRefreshAheadReads;
+    unsigned int             storeCacheCapacity;
+    size_t                   storeCacheMaxBytes;
+    LDBoolean                storeCompactItems;
+    LDBoolean                storeWriteBehind;
+    LDBoolean                storeSoleWriter;
+    LDBoolean                storeWarmUp;
+    char *                   storeSnapshotPath;
+    char *                   fileDataSourcePath;
     char *                   wrapperName;
     char *                   wrapperVersion;
 };
@@ -0,0 +1,569 @@
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "dependencies.h"
+#include "utility.h"
+
+#include "uthash.h"
+
+struct KeySetEntry
+{
+    char *         key;
+    UT_hash_handle hh;
+};
+
+/* the flags referencing one prerequisite flag or segment */
+struct Dependents
+{
+    char *              key;
+    struct KeySetEntry *flags;
+    UT_hash_handle      hh;
+};
+
+/* what a flag references, kept so that its edges can be removed */
+struct References
+{
+    char *         flagKey;
+    struct LDJSON *prerequisites; /* Array of Text */
+    struct LDJSON *segments;      /* Array of Text */
+    UT_hash_handle hh;
+};
+
+struct LDDependencyIndex
+{
+    /* by the kind of the referenced item */
+    struct Dependents * dependents[LD_FEATURE_KIND_COUNT];
+    struct References * references;
+    struct KeySetEntry *changed;
+};
+
+int
+LDi_keySetAdd(struct KeySetEntry **const set, const char *const key)
+{
+    struct KeySetEntry *entry;
+
+    LD_ASSERT(set);
+    LD_ASSERT(key);
+
+    entry = NULL;
+
+    HASH_FIND_STR(*set, key, entry);
+
+    if (entry) {
+        return 0;
+    }
+
+    if (!(entry = (struct KeySetEntry *)LDAlloc(sizeof(struct KeySetEntry)))) {
+        return -1;
+    }
+
+    if (!(entry->key = LDStrDup(key))) {
+        LDFree(entry);
+
+        return -1;
+    }
+
+    HASH_ADD_KEYPTR(hh, *set, entry->key, strlen(entry->key), entry);
+
+    return 1;
+}
+
+static void
+keySetRemove(struct KeySetEntry **const set, const char *const key)
+{
+    struct KeySetEntry *entry;
+
+    LD_ASSERT(set);
+    LD_ASSERT(key);
+
+    entry = NULL;
+
+    HASH_FIND_STR(*set, key, entry);
+
+    if (entry) {
+        HASH_DEL(*set, entry);
+
+        LDFree(entry->key);
+        LDFree(entry);
+    }
+}
+
+void
+LDi_keySetFree(struct KeySetEntry **const set)
+{
+    struct KeySetEntry *entry, *tmp;
+
+    LD_ASSERT(set);
+
+    entry = NULL;
+    tmp   = NULL;
+
+    HASH_ITER(hh, *set, entry, tmp)
+    {
+        HASH_DEL(*set, entry);
+
+        LDFree(entry->key);
+        LDFree(entry);
+    }
+}
+
+static LDBoolean
+addDependent(
+    struct LDDependencyIndex *const index,
+    const enum FeatureKind          kind,
+    const char *const               key,
+    const char *const               flagKey)
+{
+    struct Dependents *dependents;
+
+    dependents = NULL;
+
+    HASH_FIND_STR(index->dependents[kind], key, dependents);
+
+    if (!dependents) {
+        if (!(dependents =
+                  (struct Dependents *)LDAlloc(sizeof(struct Dependents)))) {
+            return LDBooleanFalse;
+        }
+
+        if (!(dependents->key = LDStrDup(key))) {
+            LDFree(dependents);
+
+            return LDBooleanFalse;
+        }
+
+        dependents->flags = NULL;
+
+        HASH_ADD_KEYPTR(
+            hh,
+            index->dependents[kind],
+            dependents->key,
+            strlen(dependents->key),
+            dependents);
+    }
+
+    return LDi_keySetAdd(&dependents->flags, flagKey) >= 0;
+}
+
+static void
+removeDependent(
+    struct LDDependencyIndex *const index,
+    const enum FeatureKind          kind,
+    const char *const               key,
+    const char *const               flagKey)
+{
+    struct Dependents *dependents;
+
+    dependents = NULL;
+
+    HASH_FIND_STR(index->dependents[kind], key, dependents);
+
+    if (dependents) {
+        keySetRemove(&dependents->flags, flagKey);
+
+        if (!dependents->flags) {
+            HASH_DEL(index->dependents[kind], dependents);
+
+            LDFree(dependents->key);
+            LDFree(dependents);
+        }
+    }
+}
+
+static void
+removeEdges(
+    struct LDDependencyIndex *const index,
+    const struct References *const  references)
+{
+    struct LDJSON *iter;
+
+    for (iter = LDGetIter(references->prerequisites); iter;
+         iter = LDIterNext(iter)) {
+        removeDependent(index, LD_FLAG, LDGetText(iter), references->flagKey);
+    }
+
+    for (iter = LDGetIter(references->segments); iter; iter = LDIterNext(iter))
+    {
+        removeDependent(
+            index, LD_SEGMENT, LDGetText(iter), references->flagKey);
+    }
+}
+
+static LDBoolean
+addEdges(
+    struct LDDependencyIndex *const index,
+    const struct References *const  references)
+{
+    struct LDJSON *iter;
+
+    for (iter = LDGetIter(references->prerequisites); iter;
+         iter = LDIterNext(iter)) {
+        if (!addDependent(
+                index, LD_FLAG, LDGetText(iter), references->flagKey)) {
+            return LDBooleanFalse;
+        }
+    }
+
+    for (iter = LDGetIter(references->segments); iter; iter = LDIterNext(iter))
+    {
+        if (!addDependent(
+                index, LD_SEGMENT, LDGetText(iter), references->flagKey)) {
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+static void
+freeReferences(struct References *const references)
+{
+    if (references) {
+        LDFree(references->flagKey);
+        LDJSONFree(references->prerequisites);
+        LDJSONFree(references->segments);
+        LDFree(references);
+    }
+}
+
+static LDBoolean
+pushText(struct LDJSON *const array, const struct LDJSON *const text)
+{
+    struct LDJSON *dupe;
+
+    if (!text || LDJSONGetType(text) != LDText) {
+        return LDBooleanTrue;
+    }
+
+    if (!(dupe = LDJSONDuplicate(text))) {
+        return LDBooleanFalse;
+    }
+
+    if (!LDArrayPush(array, dupe)) {
+        LDJSONFree(dupe);
+
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDi_collectFlagReferences(
+    const struct LDJSON *const flag,
+    struct LDJSON *const       prerequisiteKeys,
+    struct LDJSON *const       segmentKeys)
+{
+    const struct LDJSON *prerequisites, *rules, *iter;
+
+    LD_ASSERT(flag);
+    LD_ASSERT(prerequisiteKeys);
+    LD_ASSERT(segmentKeys);
+
+    prerequisites = LDObjectLookup(flag, "prerequisites");
+
+    if (prerequisites && LDJSONGetType(prerequisites) == LDArray) {
+        for (iter = LDGetIter(prerequisites); iter; iter = LDIterNext(iter)) {
+            if (LDJSONGetType(iter) != LDObject) {
+                continue;
+            }
+
+            if (!pushText(prerequisiteKeys, LDObjectLookup(iter, "key"))) {
+                return LDBooleanFalse;
+            }
+        }
+    }
+
+    rules = LDObjectLookup(flag, "rules");
+
+    if (rules && LDJSONGetType(rules) == LDArray) {
+        for (iter = LDGetIter(rules); iter; iter = LDIterNext(iter)) {
+            const struct LDJSON *clauses, *clause;
+
+            if (LDJSONGetType(iter) != LDObject) {
+                continue;
+            }
+
+            clauses = LDObjectLookup(iter, "clauses");
+
+            if (!clauses || LDJSONGetType(clauses) != LDArray) {
+                continue;
+            }
+
+            for (clause = LDGetIter(clauses); clause;
+                 clause = LDIterNext(clause)) {
+                const struct LDJSON *op, *values, *value;
+
+                if (LDJSONGetType(clause) != LDObject) {
+                    continue;
+                }
+
+                op     = LDObjectLookup(clause, "op");
+                values = LDObjectLookup(clause, "values");
+
+                if (!op || LDJSONGetType(op) != LDText ||
+                    strcmp(LDGetText(op), "segmentMatch") != 0 || !values ||
+                    LDJSONGetType(values) != LDArray)
+                {
+                    continue;
+                }
+
+                for (value = LDGetIter(values); value;
+                     value = LDIterNext(value)) {
+                    if (!pushText(segmentKeys, value)) {
+                        return LDBooleanFalse;
+                    }
+                }
+            }
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+static struct References *
+makeReferences(const char *const flagKey, const struct LDJSON *const flag)
+{
+    struct References *references;
+
+    if (!(references = (struct References *)LDAlloc(sizeof(struct References))))
+    {
+        return NULL;
+    }
+
+    memset(references, 0, sizeof(struct References));
+
+    if (!(references->flagKey = LDStrDup(flagKey))) {
+        goto error;
+    }
+
+    if (!(references->prerequisites = LDNewArray())) {
+        goto error;
+    }
+
+    if (!(references->segments = LDNewArray())) {
+        goto error;
+    }
+
+    if (!LDi_collectFlagReferences(
+            flag, references->prerequisites, references->segments)) {
+        goto error;
+    }
+
+    return references;
+
+error:
+    freeReferences(references);
+
+    return NULL;
+}
+
+struct LDDependencyIndex *
+LDDependencyIndexNew(void)
+{
+    struct LDDependencyIndex *index;
+
+    if (!(index = (struct LDDependencyIndex *)LDAlloc(
+              sizeof(struct LDDependencyIndex))))
+    {
+        return NULL;
+    }
+
+    memset(index, 0, sizeof(struct LDDependencyIndex));
+
+    return index;
+}
+
+void
+LDDependencyIndexFree(struct LDDependencyIndex *const index)
+{
+    if (index) {
+        struct References *references, *referencesTmp;
+        struct Dependents *dependents, *dependentsTmp;
+        unsigned int       kind;
+
+        references    = NULL;
+        referencesTmp = NULL;
+        dependents    = NULL;
+        dependentsTmp = NULL;
+
+        HASH_ITER(hh, index->references, references, referencesTmp)
+        {
+            HASH_DEL(index->references, references);
+
+            freeReferences(references);
+        }
+
+        for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+            HASH_ITER(hh, index->dependents[kind], dependents, dependentsTmp)
+            {
+                HASH_DEL(index->dependents[kind], dependents);
+
+                LDi_keySetFree(&dependents->flags);
+                LDFree(dependents->key);
+                LDFree(dependents);
+            }
+        }
+
+        LDi_keySetFree(&index->changed);
+
+        LDFree(index);
+    }
+}
+
+LDBoolean
+LDDependencyIndexUpdate(
+    struct LDDependencyIndex *const index,
+    const char *const               flagKey,
+    const struct LDJSON *const      flag)
+{
+    struct References *references;
+
+    LD_ASSERT(index);
+    LD_ASSERT(flagKey);
+
+    references = NULL;
+
+    HASH_FIND_STR(index->references, flagKey, references);
+
+    if (references) {
+        removeEdges(index, references);
+
+        HASH_DEL(index->references, references);
+
+        freeReferences(references);
+    }
+
+    if (!flag || LDi_isFeatureDeleted(flag)) {
+        return LDBooleanTrue;
+    }
+
+    if (!(references = makeReferences(flagKey, flag))) {
+        return LDBooleanFalse;
+    }
+
+    if (!addEdges(index, references)) {
+        removeEdges(index, references);
+
+        freeReferences(references);
+
+        return LDBooleanFalse;
+    }
+
+    HASH_ADD_KEYPTR(
+        hh,
+        index->references,
+        references->flagKey,
+        strlen(references->flagKey),
+        references);
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+markDependents(
+    struct LDDependencyIndex *const index,
+    const enum FeatureKind          kind,
+    const char *const               key);
+
+static LDBoolean
+markFlag(struct LDDependencyIndex *const index, const char *const key)
+{
+    int status;
+
+    if ((status = LDi_keySetAdd(&index->changed, key)) <= 0) {
+        /* already visited, which also stops prerequisite cycles */
+        return status == 0;
+    }
+
+    return markDependents(index, LD_FLAG, key);
+}
+
+static LDBoolean
+markDependents(
+    struct LDDependencyIndex *const index,
+    const enum FeatureKind          kind,
+    const char *const               key)
+{
+    struct Dependents * dependents;
+    struct KeySetEntry *entry, *tmp;
+
+    dependents = NULL;
+    entry      = NULL;
+    tmp        = NULL;
+
+    HASH_FIND_STR(index->dependents[kind], key, dependents);
+
+    if (!dependents) {
+        return LDBooleanTrue;
+    }
+
+    HASH_ITER(hh, dependents->flags, entry, tmp)
+    {
+        if (!markFlag(index, entry->key)) {
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDDependencyIndexMarkChanged(
+    struct LDDependencyIndex *const index,
+    const enum FeatureKind          kind,
+    const char *const               key)
+{
+    LD_ASSERT(index);
+    LD_ASSERT(key);
+
+    if (kind == LD_FLAG) {
+        return markFlag(index, key);
+    } else {
+        return markDependents(index, kind, key);
+    }
+}
+
+struct LDJSON *
+LDDependencyIndexTakeChanged(struct LDDependencyIndex *const index)
+{
+    struct LDJSON *     keys, *key;
+    struct KeySetEntry *entry, *tmp;
+
+    LD_ASSERT(index);
+
+    entry = NULL;
+    tmp   = NULL;
+
+    if (!(keys = LDNewArray())) {
+        LDi_keySetFree(&index->changed);
+
+        return NULL;
+    }
+
+    HASH_ITER(hh, index->changed, entry, tmp)
+    {
+        if (!(key = LDNewText(entry->key))) {
+            goto error;
+        }
+
+        if (!LDArrayPush(keys, key)) {
+            LDJSONFree(key);
+
+            goto error;
+        }
+    }
+
+    LDi_keySetFree(&index->changed);
+
+    return keys;
+
+error:
+    LDi_keySetFree(&index->changed);
+
+    LDJSONFree(keys);
+
+    return NULL;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <launchdarkly/json.h>
+
+#include "store.h"
+
+/* Append the keys of the prerequisites of a flag, and of the segments used by
+its `segmentMatch` clauses, to two arrays of text. */
+LDBoolean
+LDi_collectFlagReferences(
+    const struct LDJSON *const flag,
+    struct LDJSON *const       prerequisiteKeys,
+    struct LDJSON *const       segmentKeys);
+
+/* A set of keys, empty when `NULL`. Not thread safe. */
+struct KeySetEntry;
+
+/* Add a copy of `key`. Returns -1 on error, 0 if it was present, 1 if added. */
+int
+LDi_keySetAdd(struct KeySetEntry **const set, const char *const key);
+
+/* Free every entry, leaving an empty set. */
+void
+LDi_keySetFree(struct KeySetEntry **const set);
+
+/* Tracks which flags reference each prerequisite flag and each segment, so a
+change to one item can be expanded to every flag it affects. Not thread safe.
+*/
+struct LDDependencyIndex;
+
+struct LDDependencyIndex *
+LDDependencyIndexNew(void);
+
+void
+LDDependencyIndexFree(struct LDDependencyIndex *const index);
+
+/* Replace the references of a flag. `flag` is `NULL` when it is removed. */
+LDBoolean
+LDDependencyIndexUpdate(
+    struct LDDependencyIndex *const index,
+    const char *const               flagKey,
+    const struct LDJSON *const      flag);
+
+/* Record that an item changed, along with every flag depending on it. */
+LDBoolean
+LDDependencyIndexMarkChanged(
+    struct LDDependencyIndex *const index,
+    const enum FeatureKind          kind,
+    const char *const               key);
+
+/* The keys of flags marked changed since the last call as an array, which may
+be empty. Returns `NULL` on failure. */
+struct LDJSON *
+LDDependencyIndexTakeChanged(struct LDDependencyIndex *const index);
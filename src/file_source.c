@@ -0,0 +1,686 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "concurrency.h"
+#include "file_source.h"
+#include "network.h"
+#include "utility.h"
+
+/* how often the thread checks for shutdown, and how often the file is checked
+when change notifications are unavailable */
+static const int WATCH_INTERVAL_MILLISECONDS = 250;
+
+struct LDFileSource
+{
+    struct LDStore *store;
+    char *          path;
+    /* the directory is watched as editors often replace the file by renaming
+    a new one over it */
+    char *      directory;
+    const char *name;
+    /* the items the store holds from the file, NULL before the first
+    successful load */
+    struct LDJSON *applied;
+    /* keys removed since the last init by section, their tombstones would
+    hide the items if they return */
+    struct LDJSON *removed;
+    /* inotify descriptor, or -1 when polling stat */
+    int         watch;
+    time_t      modifiedOn;
+    off_t       size;
+    ld_mutex_t  lock;
+    ld_cond_t   condition;
+    LDBoolean   running;
+    ld_thread_t thread;
+    /* reloads by the thread, protected by lock */
+    unsigned int reloads;
+};
+
+static char *
+readFile(const char *const path)
+{
+    FILE * file;
+    char * buffer;
+    long   size;
+    size_t length;
+
+    buffer = NULL;
+
+    if (!(file = fopen(path, "rb"))) {
+        LD_LOG_1(LD_LOG_ERROR, "failed to open flag file: %s", path);
+
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) != 0)
+    {
+        goto error;
+    }
+
+    if (!(buffer = (char *)LDAlloc((size_t)size + 1))) {
+        goto error;
+    }
+
+    if ((length = fread(buffer, 1, (size_t)size, file)) != (size_t)size) {
+        goto error;
+    }
+
+    buffer[length] = 0;
+
+    fclose(file);
+
+    return buffer;
+
+error:
+    LD_LOG_1(LD_LOG_ERROR, "failed to read flag file: %s", path);
+
+    fclose(file);
+
+    LDFree(buffer);
+
+    return NULL;
+}
+
+static struct LDJSON *
+readPut(const char *const path)
+{
+    char *         raw;
+    struct LDJSON *put;
+
+    if (!(raw = readFile(path))) {
+        return NULL;
+    }
+
+    put = LDJSONDeserialize(raw);
+
+    LDFree(raw);
+
+    if (!put) {
+        LD_LOG(LD_LOG_ERROR, "failed to parse flag file");
+
+        return NULL;
+    }
+
+    if (!validatePutBody(put)) {
+        LD_LOG(LD_LOG_ERROR, "failed to validate flag file");
+
+        LDJSONFree(put);
+
+        return NULL;
+    }
+
+    return put;
+}
+
+/* the first load replaces the store contents */
+static LDBoolean
+applyPut(struct LDFileSource *const source, const struct LDJSON *const put)
+{
+    struct LDJSON *sets, *tmp;
+
+    if (!(sets = LDNewObject())) {
+        return LDBooleanFalse;
+    }
+
+    if (!(tmp = LDJSONDuplicate(LDObjectLookup(put, "flags")))) {
+        goto error;
+    }
+
+    if (!LDObjectSetKey(sets, "features", tmp)) {
+        LDJSONFree(tmp);
+
+        goto error;
+    }
+
+    if (!(tmp = LDJSONDuplicate(LDObjectLookup(put, "segments")))) {
+        goto error;
+    }
+
+    if (!LDObjectSetKey(sets, "segments", tmp)) {
+        LDJSONFree(tmp);
+
+        goto error;
+    }
+
+    return LDStoreInit(source->store, sets);
+
+error:
+    LDJSONFree(sets);
+
+    return LDBooleanFalse;
+}
+
+/* copy an item into the record of what the store holds, NULL is skipped */
+static LDBoolean
+keepApplied(
+    struct LDJSON *const       applied,
+    const char *const          key,
+    const struct LDJSON *const item)
+{
+    struct LDJSON *dupe;
+
+    if (!item) {
+        return LDBooleanTrue;
+    }
+
+    if (!(dupe = LDJSONDuplicate(item))) {
+        return LDBooleanFalse;
+    }
+
+    if (!LDi_objectAppendKey(applied, key, dupe)) {
+        LDJSONFree(dupe);
+
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
+}
+
+/* upsert items whose version changed and remove items no longer present.
+returns the items the store now holds, failed changes keep the previous item
+so the next reload retries them. returns NULL if that record can not be
+built, changes already made are then repeated by the next reload */
+static struct LDJSON *
+applyChanges(
+    struct LDFileSource *const source,
+    const enum FeatureKind     kind,
+    struct LDJSON *const       removed,
+    const struct LDJSON *const previous,
+    const struct LDJSON *const current)
+{
+    struct LDJSON *iter, *old, *dupe, *applied;
+    unsigned int   updated, removedCount;
+
+    updated      = 0;
+    removedCount = 0;
+
+    if (!(applied = LDNewObject())) {
+        return NULL;
+    }
+
+    for (iter = LDGetIter(current); iter; iter = LDIterNext(iter)) {
+        old = LDObjectLookup(previous, LDIterKey(iter));
+
+        if (old && LDi_getFeatureVersion(old) == LDi_getFeatureVersion(iter)) {
+            if (!LDJSONCompare(old, iter)) {
+                LD_LOG_1(
+                    LD_LOG_WARNING,
+                    "flag file item %s changed without a new version",
+                    LDIterKey(iter));
+            }
+
+            if (!keepApplied(applied, LDIterKey(iter), iter)) {
+                goto error;
+            }
+
+            continue;
+        }
+
+        if (!(dupe = LDJSONDuplicate(iter))) {
+            LD_LOG(LD_LOG_ERROR, "flag file alloc error");
+
+            if (!keepApplied(applied, LDIterKey(iter), old)) {
+                goto error;
+            }
+
+            continue;
+        }
+
+        if (!LDStoreUpsert(source->store, kind, dupe)) {
+            LD_LOG_1(
+                LD_LOG_ERROR,
+                "flag file failed to update item %s",
+                LDIterKey(iter));
+
+            if (!keepApplied(applied, LDIterKey(iter), old)) {
+                goto error;
+            }
+
+            continue;
+        }
+
+        if (!keepApplied(applied, LDIterKey(iter), iter)) {
+            goto error;
+        }
+
+        updated++;
+    }
+
+    for (iter = LDGetIter(previous); iter; iter = LDIterNext(iter)) {
+        if (LDObjectLookup(current, LDIterKey(iter))) {
+            continue;
+        }
+
+        if (!LDStoreRemove(
+                source->store,
+                kind,
+                LDIterKey(iter),
+                LDi_getFeatureVersion(iter) + 1))
+        {
+            LD_LOG_1(
+                LD_LOG_ERROR,
+                "flag file failed to remove item %s",
+                LDIterKey(iter));
+
+            if (!keepApplied(applied, LDIterKey(iter), iter)) {
+                goto error;
+            }
+
+            continue;
+        }
+
+        if (!LDObjectSetKey(
+                removed, LDIterKey(iter), LDNewBool(LDBooleanTrue))) {
+            LD_LOG(LD_LOG_ERROR, "flag file alloc error");
+        }
+
+        removedCount++;
+    }
+
+    LD_LOG_2(
+        LD_LOG_INFO,
+        "flag file updated %u and removed %u items",
+        updated,
+        removedCount);
+
+    return applied;
+
+error:
+    LDJSONFree(applied);
+
+    return NULL;
+}
+
+/* whether the put brings back an item removed since the last init */
+static LDBoolean
+isRestoring(
+    const struct LDFileSource *const source, const struct LDJSON *const put)
+{
+    struct LDJSON *section, *iter;
+
+    for (section = LDGetIter(source->removed); section;
+         section = LDIterNext(section))
+    {
+        for (iter = LDGetIter(LDObjectLookup(put, LDIterKey(section))); iter;
+             iter = LDIterNext(iter))
+        {
+            if (LDObjectLookup(section, LDIterKey(iter))) {
+                return LDBooleanTrue;
+            }
+        }
+    }
+
+    return LDBooleanFalse;
+}
+
+static struct LDJSON *
+makeRemoved(void)
+{
+    struct LDJSON *removed, *section;
+
+    if (!(removed = LDNewObject())) {
+        return NULL;
+    }
+
+    if (!(section = LDNewObject()) ||
+        !LDObjectSetKey(removed, "flags", section))
+    {
+        LDJSONFree(section);
+
+        goto error;
+    }
+
+    if (!(section = LDNewObject()) ||
+        !LDObjectSetKey(removed, "segments", section))
+    {
+        LDJSONFree(section);
+
+        goto error;
+    }
+
+    return removed;
+
+error:
+    LDJSONFree(removed);
+
+    return NULL;
+}
+
+/* the store only holds what it accepted, so the put is rewritten to match */
+static LDBoolean
+applyPutChanges(struct LDFileSource *const source, struct LDJSON *const put)
+{
+    struct LDJSON *flags, *segments;
+
+    flags = applyChanges(
+        source,
+        LD_FLAG,
+        LDObjectLookup(source->removed, "flags"),
+        LDObjectLookup(source->applied, "flags"),
+        LDObjectLookup(put, "flags"));
+
+    segments = applyChanges(
+        source,
+        LD_SEGMENT,
+        LDObjectLookup(source->removed, "segments"),
+        LDObjectLookup(source->applied, "segments"),
+        LDObjectLookup(put, "segments"));
+
+    if (!flags || !segments || !LDObjectSetKey(put, "flags", flags)) {
+        LDJSONFree(flags);
+        LDJSONFree(segments);
+
+        return LDBooleanFalse;
+    }
+
+    if (!LDObjectSetKey(put, "segments", segments)) {
+        LDJSONFree(segments);
+
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
+}
+
+static void
+reload(struct LDFileSource *const source)
+{
+    struct LDJSON *put, *removed;
+
+    if (!(put = readPut(source->path))) {
+        return;
+    }
+
+    /* a returning item is hidden by its tombstone, so the store is rebuilt */
+    if (source->applied && !isRestoring(source, put)) {
+        if (!applyPutChanges(source, put)) {
+            LD_LOG(LD_LOG_ERROR, "flag file alloc error");
+
+            LDJSONFree(put);
+
+            return;
+        }
+    } else {
+        if (!(removed = makeRemoved())) {
+            LD_LOG(LD_LOG_ERROR, "flag file alloc error");
+
+            LDJSONFree(put);
+
+            return;
+        }
+
+        if (!applyPut(source, put)) {
+            LD_LOG(LD_LOG_ERROR, "flag file failed to initialize store");
+
+            LDJSONFree(removed);
+            LDJSONFree(put);
+
+            return;
+        }
+
+        LDJSONFree(source->removed);
+        source->removed = removed;
+    }
+
+    LDJSONFree(source->applied);
+    source->applied = put;
+}
+
+/* detects a rewrite by modification time and size */
+static LDBoolean
+statChanged(struct LDFileSource *const source)
+{
+    struct stat info;
+    LDBoolean   changed;
+
+    if (stat(source->path, &info) != 0) {
+        return LDBooleanFalse;
+    }
+
+    changed =
+        info.st_mtime != source->modifiedOn || info.st_size != source->size;
+
+    source->modifiedOn = info.st_mtime;
+    source->size       = info.st_size;
+
+    return changed;
+}
+
+/* waits up to one interval, returns if the file may have changed */
+static LDBoolean
+waitForChange(struct LDFileSource *const source)
+{
+#ifdef __linux__
+    if (source->watch >= 0) {
+        struct pollfd descriptor;
+        LDBoolean     changed;
+        ssize_t       length;
+        union
+        {
+            struct inotify_event event;
+            char                 bytes[4096];
+        } buffer;
+
+        descriptor.fd     = source->watch;
+        descriptor.events = POLLIN;
+        changed           = LDBooleanFalse;
+
+        if (poll(&descriptor, 1, WATCH_INTERVAL_MILLISECONDS) <= 0) {
+            return LDBooleanFalse;
+        }
+
+        /* drain every queued event so a burst of writes is one reload */
+        while ((length = read(source->watch, buffer.bytes, sizeof(buffer))) >
+               0) {
+            const char *iter;
+
+            for (iter = buffer.bytes; iter < buffer.bytes + length;) {
+                const struct inotify_event *const event =
+                    (const struct inotify_event *)iter;
+
+                if (event->len && strcmp(event->name, source->name) == 0) {
+                    changed = LDBooleanTrue;
+                }
+
+                iter += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        return changed;
+    }
+#endif
+
+    LDi_mutex_lock(&source->lock);
+
+    if (source->running) {
+        LDi_cond_wait(
+            &source->condition, &source->lock, WATCH_INTERVAL_MILLISECONDS);
+    }
+
+    LDi_mutex_unlock(&source->lock);
+
+    return statChanged(source);
+}
+
+static THREAD_RETURN
+fileSourceThread(void *const rawSource)
+{
+    struct LDFileSource *source;
+
+    LD_ASSERT(rawSource);
+
+    source = (struct LDFileSource *)rawSource;
+
+    while (LDBooleanTrue) {
+        LDBoolean changed;
+
+        changed = waitForChange(source);
+
+        LDi_mutex_lock(&source->lock);
+
+        if (!source->running) {
+            LDi_mutex_unlock(&source->lock);
+
+            break;
+        }
+
+        LDi_mutex_unlock(&source->lock);
+
+        if (changed) {
+            LD_LOG(LD_LOG_INFO, "flag file changed, reloading");
+
+            reload(source);
+
+            LDi_mutex_lock(&source->lock);
+            source->reloads++;
+            LDi_mutex_unlock(&source->lock);
+        }
+    }
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+static void
+freeFileSource(struct LDFileSource *const source)
+{
+#ifdef __linux__
+    if (source->watch >= 0) {
+        close(source->watch);
+    }
+#endif
+
+    LDi_mutex_destroy(&source->lock);
+    LDi_cond_destroy(&source->condition);
+
+    LDJSONFree(source->applied);
+    LDJSONFree(source->removed);
+    LDFree(source->path);
+    LDFree(source->directory);
+    LDFree(source);
+}
+
+struct LDFileSource *
+LDi_startFileSource(struct LDStore *const store, const char *const path)
+{
+    struct LDFileSource *source;
+    const char *         separator;
+
+    LD_ASSERT(store);
+    LD_ASSERT(path);
+
+    if (!(source =
+              (struct LDFileSource *)LDAlloc(sizeof(struct LDFileSource)))) {
+        return NULL;
+    }
+
+    memset(source, 0, sizeof(struct LDFileSource));
+
+    source->store = store;
+    source->watch = -1;
+
+    LDi_mutex_init(&source->lock);
+    LDi_cond_init(&source->condition);
+
+    if (!(source->path = LDStrDup(path))) {
+        goto error;
+    }
+
+    if ((separator = strrchr(path, '/'))) {
+        const size_t length = separator == path ? 1 : separator - path;
+
+        if (!(source->directory = (char *)LDAlloc(length + 1))) {
+            goto error;
+        }
+
+        memcpy(source->directory, path, length);
+        source->directory[length] = 0;
+
+        source->name = source->path + (separator - path) + 1;
+    } else {
+        if (!(source->directory = LDStrDup("."))) {
+            goto error;
+        }
+
+        source->name = source->path;
+    }
+
+#ifdef __linux__
+    /* watching starts before the first read so no rewrite is missed */
+    if ((source->watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+        inotify_add_watch(
+            source->watch,
+            source->directory,
+            IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        LD_LOG(
+            LD_LOG_WARNING,
+            "inotify unavailable, checking flag file modification time");
+
+        if (source->watch >= 0) {
+            close(source->watch);
+            source->watch = -1;
+        }
+    }
+#endif
+
+    statChanged(source);
+
+    reload(source);
+
+    source->running = LDBooleanTrue;
+
+    if (!LDi_thread_create(&source->thread, fileSourceThread, source)) {
+        LD_LOG(LD_LOG_ERROR, "failed to start flag file thread");
+
+        goto error;
+    }
+
+    return source;
+
+error:
+    freeFileSource(source);
+
+    return NULL;
+}
+
+void
+LDi_stopFileSource(struct LDFileSource *const source)
+{
+    if (source) {
+        LDi_mutex_lock(&source->lock);
+        source->running = LDBooleanFalse;
+        LDi_mutex_unlock(&source->lock);
+
+        LDi_cond_signal(&source->condition);
+        LDi_thread_join(&source->thread);
+
+        freeFileSource(source);
+    }
+}
+
+unsigned int
+LDi_fileSourceReloads(struct LDFileSource *const source)
+{
+    unsigned int reloads;
+
+    LD_ASSERT(source);
+
+    LDi_mutex_lock(&source->lock);
+    reloads = source->reloads;
+    LDi_mutex_unlock(&source->lock);
+
+    return reloads;
+}
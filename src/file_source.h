@@ -0,0 +1,28 @@
+/*!
+ * @file file_source.h
+ * @brief Internal API Interface for reading flags from a local file.
+ */
+
+#pragma once
+
+#include "store.h"
+
+/* Feeds the store from a file in the same format as the `/sdk/latest-all`
+response. The file is applied with `LDStoreInit` once, then only items whose
+version changed are upserted or removed as the file is rewritten. Restoring a
+removed item applies the whole file with `LDStoreInit` again. */
+struct LDFileSource;
+
+/* Loads the file before returning, so the store is initialized if it was
+readable, then watches it for changes on a dedicated thread. */
+struct LDFileSource *
+LDi_startFileSource(struct LDStore *const store, const char *const path);
+
+/* Stops watching and frees the source. May be `NULL`. */
+void
+LDi_stopFileSource(struct LDFileSource *const source);
+
+/* The number of times the file was read after the initial load, whether or
+not it could be applied. Used by tests to wait for a rewrite to be seen. */
+unsigned int
+LDi_fileSourceReloads(struct LDFileSource *const source);
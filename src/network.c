@@ -197,7 +197,8 @@ LDi_networkthread(void *const clientref)
         return THREAD_RETURN_DEFAULT;
     }
 
-    if (!client->config->useLDD) {
+    /* a file data source replaces polling and streaming */
+    if (!client->config->useLDD && !client->config->fileDataSourcePath) {
         if (!(interfaces[interfacecount++] = LDi_constructPolling(client))) {
             LD_LOG(LD_LOG_ERROR, "failed to construct polling");
 
@@ -47,6 +47,15 @@ LDi_networkthread(void *const clientref);
 LDBoolean
 validatePutBody(const struct LDJSON *const put);
 
+/* Parse a put body into the sets expected by `LDStoreInit`, reading one flag
+or segment at a time. When member is provided the flags and segments are read
+from the object under that key, as in the stream put event. */
+LDBoolean
+LDi_parsePut(
+    const char *const     text,
+    const char *const     member,
+    struct LDJSON **const result);
+
 LDBoolean
 LDi_addHandle(
     CURLM *const                   multi,
@@ -14,43 +14,19 @@
 static LDBoolean
 updateStore(struct LDStore *const store, const char *const rawupdate)
 {
-    struct LDJSON *update, *features;
+    struct LDJSON *sets;
 
     LD_ASSERT(store);
     LD_ASSERT(rawupdate);
 
-    update = NULL;
-
-    if (!(update = LDJSONDeserialize(rawupdate))) {
-        LD_LOG(LD_LOG_ERROR, "failed to deserialize put");
+    if (!LDi_parsePut(rawupdate, NULL, &sets)) {
+        LD_LOG(LD_LOG_ERROR, "failed to parse put");
 
         return LDBooleanFalse;
     }
 
-    if (!validatePutBody(update)) {
-        LD_LOG(LD_LOG_ERROR, "failed to validate put");
-
-        goto error;
-    }
-
-    features = LDObjectDetachKey(update, "flags");
-    LD_ASSERT(features);
-
-    if (!LDObjectSetKey(update, "features", features)) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
-
-        LDJSONFree(features);
-
-        goto error;
-    }
-
     LD_LOG(LD_LOG_INFO, "running store init");
-    return LDStoreInit(store, update);
-
-error:
-    LDJSONFree(update);
-
-    return LDBooleanFalse;
+    return LDStoreInit(store, sets);
 }
 
 struct PollContext
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "compact_item.h"
+#include "snapshot.h"
+#include "utility.h"
+
+/* the format is the magic, then a section count, then for each section a name
+and an item count followed by the items. names are NUL terminated text and
+items are in the compact encoding, each with a length prefix. lengths are four
+big endian bytes */
+static const char SNAPSHOT_MAGIC[8] = { 'L', 'D', 'S', 'N', 'A', 'P', 0, 2 };
+
+static LDBoolean
+writeLength(FILE *const file, const size_t length)
+{
+    unsigned char bytes[4];
+
+    if (length > 0xFFFFFFFFUL) {
+        return LDBooleanFalse;
+    }
+
+    bytes[0] = (unsigned char)((length >> 24) & 0xFF);
+    bytes[1] = (unsigned char)((length >> 16) & 0xFF);
+    bytes[2] = (unsigned char)((length >> 8) & 0xFF);
+    bytes[3] = (unsigned char)(length & 0xFF);
+
+    return fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+}
+
+static LDBoolean
+writeBlock(FILE *const file, const char *const text)
+{
+    const size_t length = strlen(text) + 1;
+
+    return writeLength(file, length) &&
+           fwrite(text, 1, length, file) == length;
+}
+
+static LDBoolean
+writeItem(FILE *const file, const struct LDJSON *const item)
+{
+    void *    buffer;
+    size_t    size;
+    LDBoolean success;
+
+    if (!LDi_encodeCompactItem(item, &buffer, &size)) {
+        return LDBooleanFalse;
+    }
+
+    success = writeLength(file, size) && fwrite(buffer, 1, size, file) == size;
+
+    LDFree(buffer);
+
+    return success;
+}
+
+/* flush the file to disk so a rename never exposes a partial snapshot */
+static LDBoolean
+syncFile(FILE *const file)
+{
+    if (fflush(file) != 0) {
+        return LDBooleanFalse;
+    }
+
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+LDBoolean
+LDi_writeSnapshot(
+    const char *const                    path,
+    const char *const *const             names,
+    struct LDStoreSnapshot *const *const sections,
+    const unsigned int                   count)
+{
+    FILE *       file;
+    char *       tmpPath;
+    size_t       pathLength;
+    unsigned int i, j;
+    LDBoolean    success;
+
+    LD_ASSERT(path);
+    LD_ASSERT(names);
+    LD_ASSERT(sections);
+
+    file       = NULL;
+    pathLength = strlen(path);
+    success    = LDBooleanFalse;
+
+    /* written beside the destination so the rename does not cross devices */
+    if (!(tmpPath = (char *)LDAlloc(pathLength + sizeof(".tmp")))) {
+        return LDBooleanFalse;
+    }
+
+    memcpy(tmpPath, path, pathLength);
+    memcpy(tmpPath + pathLength, ".tmp", sizeof(".tmp"));
+
+    if (!(file = fopen(tmpPath, "wb"))) {
+        LD_LOG_1(LD_LOG_ERROR, "failed to open snapshot file: %s", tmpPath);
+
+        goto cleanup;
+    }
+
+    if (fwrite(SNAPSHOT_MAGIC, 1, sizeof(SNAPSHOT_MAGIC), file) !=
+            sizeof(SNAPSHOT_MAGIC) ||
+        !writeLength(file, count))
+    {
+        goto cleanup;
+    }
+
+    for (i = 0; i < count; i++) {
+        const unsigned int items = LDStoreSnapshotCount(sections[i]);
+
+        if (!writeBlock(file, names[i]) || !writeLength(file, items)) {
+            goto cleanup;
+        }
+
+        for (j = 0; j < items; j++) {
+            if (!writeItem(
+                    file, LDJSONRCGet(LDStoreSnapshotItem(sections[i], j))))
+            {
+                goto cleanup;
+            }
+        }
+    }
+
+    if (!syncFile(file)) {
+        goto cleanup;
+    }
+
+    if (fclose(file) != 0) {
+        file = NULL;
+
+        goto cleanup;
+    }
+
+    file = NULL;
+
+#ifdef _WIN32
+    /* rename does not replace an existing file on windows */
+    remove(path);
+#endif
+
+    if (rename(tmpPath, path) != 0) {
+        LD_LOG_1(LD_LOG_ERROR, "failed to replace snapshot file: %s", path);
+
+        goto cleanup;
+    }
+
+    success = LDBooleanTrue;
+
+cleanup:
+    if (file) {
+        fclose(file);
+    }
+
+    if (!success) {
+        LD_LOG(LD_LOG_ERROR, "failed to write snapshot");
+
+        remove(tmpPath);
+    }
+
+    LDFree(tmpPath);
+
+    return success;
+}
+
+static LDBoolean
+readLength(
+    const unsigned char **const cursor,
+    const unsigned char *const  end,
+    size_t *const               length)
+{
+    const unsigned char *bytes;
+
+    if (end - *cursor < 4) {
+        return LDBooleanFalse;
+    }
+
+    bytes   = *cursor;
+    *length = ((size_t)bytes[0] << 24) | ((size_t)bytes[1] << 16) |
+              ((size_t)bytes[2] << 8) | (size_t)bytes[3];
+    *cursor += 4;
+
+    return LDBooleanTrue;
+}
+
+/* blocks are used in place, the terminator is checked instead of copying */
+static const char *
+readBlock(const unsigned char **const cursor, const unsigned char *const end)
+{
+    size_t      length;
+    const char *block;
+
+    if (!readLength(cursor, end, &length) || length == 0 ||
+        (size_t)(end - *cursor) < length)
+    {
+        return NULL;
+    }
+
+    block = (const char *)*cursor;
+
+    if (block[length - 1] != '\0') {
+        return NULL;
+    }
+
+    *cursor += length;
+
+    return block;
+}
+
+static LDBoolean
+readItem(
+    const unsigned char **const cursor,
+    const unsigned char *const  end,
+    const unsigned char **const item,
+    size_t *const               size)
+{
+    if (!readLength(cursor, end, size) || *size == 0 ||
+        (size_t)(end - *cursor) < *size)
+    {
+        return LDBooleanFalse;
+    }
+
+    *item = *cursor;
+    *cursor += *size;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+parseSnapshot(
+    const unsigned char *      cursor,
+    const unsigned char *const end,
+    struct LDJSON **const      result)
+{
+    struct LDJSON *sets, *set;
+    size_t         sections, items, i, j;
+
+    if ((size_t)(end - cursor) < sizeof(SNAPSHOT_MAGIC) ||
+        memcmp(cursor, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+    {
+        LD_LOG(LD_LOG_ERROR, "snapshot has an unknown format");
+
+        return LDBooleanFalse;
+    }
+
+    cursor += sizeof(SNAPSHOT_MAGIC);
+
+    if (!(sets = LDNewObject())) {
+        return LDBooleanFalse;
+    }
+
+    if (!readLength(&cursor, end, &sections)) {
+        goto truncated;
+    }
+
+    for (i = 0; i < sections; i++) {
+        const char *name;
+
+        if (!(name = readBlock(&cursor, end)) ||
+            !readLength(&cursor, end, &items))
+        {
+            goto truncated;
+        }
+
+        if (!(set = LDNewObject())) {
+            goto error;
+        }
+
+        if (!LDObjectSetKey(sets, name, set)) {
+            LDJSONFree(set);
+
+            goto error;
+        }
+
+        for (j = 0; j < items; j++) {
+            const unsigned char *raw;
+            size_t               size;
+            struct LDJSON *      item;
+
+            if (!readItem(&cursor, end, &raw, &size)) {
+                goto truncated;
+            }
+
+            if (!(item = LDi_decodeCompactItem(raw, size))) {
+                LD_LOG(LD_LOG_WARNING, "snapshot skipping unparsable item");
+
+                continue;
+            }
+
+            if (!LDi_validateFeature(item)) {
+                LD_LOG(LD_LOG_WARNING, "snapshot skipping invalid item");
+
+                LDJSONFree(item);
+
+                continue;
+            }
+
+            /* duplicate keys are resolved by version in the store */
+            if (!LDi_objectAppendKey(
+                    set, LDGetText(LDObjectLookup(item, "key")), item))
+            {
+                LDJSONFree(item);
+
+                goto error;
+            }
+        }
+    }
+
+    *result = sets;
+
+    return LDBooleanTrue;
+
+truncated:
+    LD_LOG(LD_LOG_ERROR, "snapshot is truncated");
+
+error:
+    LDJSONFree(sets);
+
+    return LDBooleanFalse;
+}
+
+LDBoolean
+LDi_readSnapshot(const char *const path, struct LDJSON **const result)
+{
+#ifndef _WIN32
+    int                  fd;
+    struct stat          info;
+    const unsigned char *mapping;
+    size_t               size;
+    LDBoolean            success;
+
+    LD_ASSERT(path);
+    LD_ASSERT(result);
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        LD_LOG_1(LD_LOG_INFO, "no snapshot found at: %s", path);
+
+        return LDBooleanFalse;
+    }
+
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+
+        return LDBooleanFalse;
+    }
+
+    size    = (size_t)info.st_size;
+    mapping = (const unsigned char *)mmap(
+        NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if ((const void *)mapping == MAP_FAILED) {
+        LD_LOG_1(LD_LOG_ERROR, "failed to map snapshot: %s", path);
+
+        return LDBooleanFalse;
+    }
+
+    success = parseSnapshot(mapping, mapping + size, result);
+
+    munmap((void *)mapping, size);
+
+    return success;
+#else
+    FILE *         file;
+    long           size;
+    unsigned char *buffer;
+    LDBoolean      success;
+
+    LD_ASSERT(path);
+    LD_ASSERT(result);
+
+    buffer  = NULL;
+    success = LDBooleanFalse;
+
+    if (!(file = fopen(path, "rb"))) {
+        LD_LOG_1(LD_LOG_INFO, "no snapshot found at: %s", path);
+
+        return LDBooleanFalse;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0 ||
+        fseek(file, 0, SEEK_SET) != 0)
+    {
+        goto cleanup;
+    }
+
+    if (!(buffer = (unsigned char *)LDAlloc((size_t)size))) {
+        goto cleanup;
+    }
+
+    if (fread(buffer, 1, (size_t)size, file) != (size_t)size) {
+        goto cleanup;
+    }
+
+    success = parseSnapshot(buffer, buffer + size, result);
+
+cleanup:
+    fclose(file);
+
+    LDFree(buffer);
+
+    return success;
+#endif
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <launchdarkly/json.h>
+
+#include "store.h"
+
+/* A binary file of store items in the compact encoding used for warm starts.
+Each section holds the items of one kind under the same name used by
+`LDStoreInit`. */
+
+/* Write `count` sections, replacing `path` atomically. */
+LDBoolean
+LDi_writeSnapshot(
+    const char *const                    path,
+    const char *const *const             names,
+    struct LDStoreSnapshot *const *const sections,
+    const unsigned int                   count);
+
+/* Read a snapshot into an object of collections suitable for `LDStoreInit`.
+Items that fail to parse are skipped. */
+LDBoolean
+LDi_readSnapshot(const char *const path, struct LDJSON **const result);
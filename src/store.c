@@ -1,11 +1,15 @@
 #include <stdio.h>
 
 #include "uthash.h"
+#include "utlist.h"
 
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "compact_item.h"
 #include "concurrency.h"
+#include "dependencies.h"
+#include "snapshot.h"
 #include "store.h"
 #include "utility.h"
 
@@ -19,7 +23,13 @@ static const char *const LD_SS_SEGMENTS   = "segments";
 static const char *const INIT_CHECKED_KEY = "$initChecked";
 
 static LDBoolean
-memoryInit(struct LDStore *const context, struct LDJSON *const sets);
+memoryInit(
+    struct LDStore *const context,
+    struct LDJSON *const  sets,
+    const LDBoolean       queue);
+
+static LDBoolean
+queueInit(struct LDStore *const store, struct CacheItem *const *const tables);
 
 static void
 memoryDestructor(struct MemoryContext *const context);
@@ -28,6 +38,12 @@ static int
 isExpired(
     const struct LDStore *const store, const struct CacheItem *const item);
 
+static LDBoolean
+memorySnapshot(
+    struct MemoryContext *const    context,
+    const enum FeatureKind         kind,
+    struct LDStoreSnapshot **const result);
+
 /* **** Flag Utilities **** */
 
 LDBoolean
@@ -131,6 +147,23 @@ featureKindToString(const enum FeatureKind kind)
     }
 }
 
+static LDBoolean
+featureKindFromString(const char *const text, enum FeatureKind *const kind)
+{
+    LD_ASSERT(text);
+    LD_ASSERT(kind);
+
+    if (strcmp(text, LD_SS_FEATURES) == 0) {
+        *kind = LD_FLAG;
+    } else if (strcmp(text, LD_SS_SEGMENTS) == 0) {
+        *kind = LD_SEGMENT;
+    } else {
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
+}
+
 LDBoolean
 LDi_isFeatureDeleted(const struct LDJSON *const feature)
 {
@@ -204,13 +237,150 @@ LDi_makeDeleted(const char *const key, const unsigned int version)
 
 /* **** LDStore **** */
 
+/* tracks a backend fetch so that concurrent readers of the same item wait on
+one round trip instead of each querying the backend */
+struct InFlightFetch
+{
+    /* NULL when fetching an entire kind */
+    char *           key;
+    enum FeatureKind kind;
+    LDBoolean        done;
+    LDBoolean        success;
+    unsigned int     waiters;
+    UT_hash_handle   hh;
+    /* next item in the background refresh queue */
+    struct InFlightFetch *next;
+};
+
+/* calls and removed are protected by dispatchLock. a removed listener is
+freed once no dispatch holds it */
+struct FlagListener
+{
+    LDFlagChangeListener listener;
+    void *               userData;
+    unsigned int         calls;
+    LDBoolean            removed;
+    struct FlagListener *next;
+};
+
+/* the keys of changed flags waiting to be delivered to listeners */
+struct ChangeBatch
+{
+    struct LDJSON *     keys;
+    struct ChangeBatch *next;
+};
+
+/* the latest change to an item waiting to be written to the backend */
+struct PendingWrite
+{
+    char *                       key;
+    struct LDStoreCollectionItem item;
+    /* monotonic milliseconds when the first unwritten change was queued */
+    double         queuedOn;
+    UT_hash_handle hh;
+};
+
+/* a full data set waiting to be written to the backend, sharing the items
+held in memory */
+struct PendingInit
+{
+    struct LDStoreSnapshot *sections[LD_FEATURE_KIND_COUNT];
+    unsigned int            sequence;
+    double                  queuedOn;
+};
+
 struct LDStore
 {
     struct MemoryContext *   cache;
     struct LDStoreInterface *backend;
     unsigned int             cacheMilliseconds;
+    /* how long past expiration an item may be served while it is refreshed */
+    unsigned int staleMilliseconds;
+    /* reads that make an item worth refreshing before it expires */
+    unsigned int refreshAheadReads;
+    /* how often whole collections are reloaded in daemon mode, zero is never */
+    unsigned int reloadMilliseconds;
+    /* maximum cached items across all kinds, zero is unbounded */
+    unsigned int cacheCapacity;
+    /* maximum estimated bytes of cached items, zero is unbounded */
+    size_t cacheMaxBytes;
+    /* write items to the backend in the compact encoding instead of JSON */
+    LDBoolean compactItems;
+    /* no other process writes the backend, so after an init memory holds
+    every item. authoritative is protected by the cache lock */
+    LDBoolean soleWriter;
+    LDBoolean authoritative;
+    /* written after each init when there is no backend, may be NULL */
+    char *     snapshotPath;
+    ld_mutex_t usageLock;
+    /* protects the in flight tables and refresh queue below */
+    ld_mutex_t            fetchLock;
+    ld_cond_t             fetchCondition;
+    struct InFlightFetch *fetching[LD_FEATURE_KIND_COUNT];
+    struct InFlightFetch *fetchingAll[LD_FEATURE_KIND_COUNT];
+    /* fetches waiting on the background refresh thread */
+    struct InFlightFetch *refreshQueue;
+    ld_cond_t             refreshCondition;
+    LDBoolean             refreshRunning;
+    ld_thread_t           refreshThread;
+    /* protects the listener list and the listener being called. listeners
+    are called without it */
+    ld_mutex_t           dispatchLock;
+    ld_cond_t            dispatchCondition;
+    struct FlagListener *listeners;
+    struct FlagListener *calling;
+    /* protects the dependency index and change queue below. acquired after
+    the cache lock and after dispatchLock */
+    ld_mutex_t                listenerLock;
+    struct LDDependencyIndex *dependencies;
+    struct ChangeBatch *      changeQueue;
+    ld_cond_t                 changeCondition;
+    LDBoolean                 dispatchRunning;
+    ld_thread_t               dispatchThread;
+    /* set when a listener destroys the store, which the dispatch thread then
+    frees. only accessed by that thread */
+    LDBoolean dispatchDestroys;
+    /* changes are applied to memory and written to the backend by a thread */
+    LDBoolean writeBehind;
+    /* set while an init applied to memory waits to be written, so nothing
+    expires before the backend has it. protected by the cache lock */
+    LDBoolean    initUnwritten;
+    unsigned int initSequence;
+    /* protects the write queue and counters below. never held with the cache
+    lock */
+    ld_mutex_t           writeLock;
+    ld_cond_t            writeCondition;
+    struct PendingInit * pendingInit;
+    struct PendingWrite *pendingWrites[LD_FEATURE_KIND_COUNT];
+    /* changes taken by the writer, and when the oldest of them was queued */
+    unsigned int  writesInFlight;
+    double        inFlightSince;
+    unsigned long writesCompleted, writesFailed;
+    LDBoolean     writeRunning;
+    ld_thread_t   writeThread;
+    /* the snapshot is written by a thread, so init does not wait on the
+    disk. protects the flags below */
+    ld_mutex_t  snapshotLock;
+    ld_cond_t   snapshotCondition;
+    LDBoolean   snapshotPending;
+    LDBoolean   snapshotRunning;
+    ld_thread_t snapshotThread;
 };
 
+/* how long to wait on another thread's fetch before querying directly */
+static const int FETCH_WAIT_MILLISECONDS = 1000;
+
+/* hot items are refreshed within the final 1/N of their TTL, and scanned for
+four times within that window */
+static const unsigned int REFRESH_AHEAD_WINDOW_DIVISOR = 4;
+static const unsigned int REFRESH_AHEAD_SCANS          = 4;
+
+/* the most queued refreshes of one kind fetched with a single backend call */
+#define REFRESH_BATCH_SIZE 64
+
+/* how long the write behind thread waits before retrying a failed write */
+static const int WRITE_RETRY_MILLISECONDS = 1000;
+
 /* ***** Reference counting **** */
 
 struct LDJSONRC
@@ -291,6 +461,22 @@ LDJSONRCGet(struct LDJSONRC *const rc)
 
 /* **** Memory Implementation **** */
 
+struct LDStoreSnapshot
+{
+    struct LDJSONRC **items;
+    unsigned int      count;
+};
+
+/* the items loaded by one LDStoreInit share a single allocation, which is
+released in one call once the last of them has left the cache */
+struct Generation
+{
+    void *slab;
+    /* items of the generation still in a table, only changed while the items
+    are exclusively owned, either under write lock or in a private table */
+    unsigned int live;
+};
+
 /* Feature Key -> JSON */
 struct CacheItem
 {
@@ -299,15 +485,36 @@ struct CacheItem
     UT_hash_handle   hh;
     /* monotonic milliseconds */
     double updatedOn;
+    /* reads since last fetched, protected by the store usageLock */
+    unsigned int reads;
+    /* estimated heap bytes used by the item and its value */
+    size_t bytes;
+    /* eviction state, only maintained when the cache has a capacity */
+    enum FeatureKind  kind;
+    LDBoolean         referenced;
+    struct CacheItem *clockPrev, *clockNext;
+    /* set when the item and its key live in a generation slab */
+    struct Generation *generation;
+    /* a change not yet written to the backend, which pins the item */
+    LDBoolean unwritten;
 };
 
 static void
 deleteCacheItem(struct CacheItem *const item)
 {
     if (item) {
-        LDFree(item->key);
         LDJSONRCDecrement(item->feature);
-        LDFree(item);
+
+        if (item->generation) {
+            LD_ASSERT(item->generation->live > 0);
+
+            if (--item->generation->live == 0) {
+                LDFree(item->generation->slab);
+            }
+        } else {
+            LDFree(item->key);
+            LDFree(item);
+        }
     }
 }
 
@@ -316,10 +523,8 @@ deleteAndRemoveCacheItem(
     struct CacheItem **const collection, struct CacheItem *const item)
 {
     if (collection && item) {
-        LDFree(item->key);
-        LDJSONRCDecrement(item->feature);
         HASH_DEL(*collection, item);
-        LDFree(item);
+        deleteCacheItem(item);
     }
 }
 
@@ -329,18 +534,22 @@ makeCacheItem(const char *const key, struct LDJSON *value)
     char *            keyDupe;
     struct CacheItem *item;
     struct LDJSONRC * valueRC;
+    size_t            bytes;
 
     LD_ASSERT(key);
 
     keyDupe = NULL;
     item    = NULL;
     valueRC = NULL;
+    bytes   = sizeof(struct CacheItem) + strlen(key) + 1;
 
     if (!(keyDupe = LDStrDup(key))) {
         goto error;
     }
 
     if (value) {
+        bytes += sizeof(struct LDJSONRC) + LDi_JSONFootprint(value);
+
         if (!(valueRC = LDJSONRCNew(value))) {
             goto error;
         }
@@ -360,6 +569,7 @@ makeCacheItem(const char *const key, struct LDJSON *value)
 
     item->key     = keyDupe;
     item->feature = valueRC;
+    item->bytes   = bytes;
 
     return item;
 
@@ -367,93 +577,337 @@ error:
     LDFree(item);
     LDFree(keyDupe);
     LDJSONFree(value);
+    LDJSONRCDecrement(valueRC);
 
     return NULL;
 }
 
+/* an interned flag key, resolved to the current item whenever the tables
+change so that lookups by handle skip hashing the key */
+struct FlagHandle
+{
+    char *         key;
+    LDFlagHandle   handle;
+    UT_hash_handle hh;
+    /* NULL when the flag is not cached, only changed under write lock */
+    struct CacheItem *item;
+};
+
 struct MemoryContext
 {
     LDBoolean initialized;
-    /* ut hash table */
-    struct CacheItem *items;
-    ld_rwlock_t       lock;
+    /* ut hash tables keyed directly by feature key, one per kind */
+    struct CacheItem *items[LD_FEATURE_KIND_COUNT];
+    /* when each kind was last loaded in full from the backend */
+    struct CacheItem *all[LD_FEATURE_KIND_COUNT];
+    /* when the backend was last asked if it is initialized */
+    struct CacheItem *initChecked;
+    /* keys evicted from a kind since it was last loaded in full. the marker
+    in all stays valid, and a snapshot fetches only these keys */
+    struct CacheItem *evicted[LD_FEATURE_KIND_COUNT];
+    /* clock hand of the eviction ring holding every item of every kind */
+    struct CacheItem *clock;
+    /* estimated bytes of the items in the eviction ring */
+    size_t clockBytes;
+    /* handles are never removed, handle N is at index N - 1 */
+    struct FlagHandle **handles;
+    unsigned int        handleCount;
+    unsigned int        handleCapacity;
+    /* flag key -> handle, for interning */
+    struct FlagHandle *handleIndex;
+    ld_rwlock_t        lock;
 };
 
-static char *
-featureStoreCacheKey(const char *const kind, const char *const key)
+/* expects write lock. points the handle of a flag, if one was taken, at the
+item now in the table. item is NULL when the flag left the table */
+static void
+updateHandle(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct CacheItem *const item)
 {
-    char *result;
-    int   bytes;
-    int   status;
+    struct FlagHandle *slot;
 
-    LD_ASSERT(kind);
+    LD_ASSERT(store);
     LD_ASSERT(key);
 
-    bytes = strlen(kind) + 1 + strlen(key) + 1;
+    if (kind != LD_FLAG) {
+        return;
+    }
+
+    slot = NULL;
 
-    if (!(result = LDAlloc(bytes))) {
-        return NULL;
+    HASH_FIND_STR(store->cache->handleIndex, key, slot);
+
+    if (slot) {
+        slot->item = item;
+    }
+}
+
+/* expects write lock. points every handle at the new items after the flag
+table is replaced */
+static void
+resolveHandles(struct LDStore *const store)
+{
+    unsigned int i;
+
+    LD_ASSERT(store);
+
+    for (i = 0; i < store->cache->handleCount; i++) {
+        struct FlagHandle *const slot = store->cache->handles[i];
+
+        slot->item = NULL;
+
+        HASH_FIND_STR(store->cache->items[LD_FLAG], slot->key, slot->item);
     }
+}
 
-    status = snprintf(result, bytes, "%s:%s", kind, key);
-    LD_ASSERT(status == bytes - 1);
+static void
+freeTable(struct CacheItem *table)
+{
+    struct CacheItem *item, *itemTmp;
 
-    return result;
+    item    = NULL;
+    itemTmp = NULL;
+
+    HASH_ITER(hh, table, item, itemTmp)
+    {
+        deleteAndRemoveCacheItem(&table, item);
+    }
 }
 
-static char *
-featureStoreAllCacheKey(const char *const kind)
+/* replace the collection level marker for a kind, which also forgets the
+keys evicted since the previous one. expects write lock */
+static void
+setAllCacheItem(
+    struct MemoryContext *const context,
+    const enum FeatureKind      kind,
+    struct CacheItem *const     item)
 {
-    char *result;
-    int   bytes;
-    int   status;
+    LD_ASSERT(context);
 
-    LD_ASSERT(kind);
+    deleteCacheItem(context->all[kind]);
+    freeTable(context->evicted[kind]);
+
+    context->all[kind]     = item;
+    context->evicted[kind] = NULL;
+}
 
-    bytes = 4 + strlen(kind) + 1;
+static LDBoolean
+isCacheBounded(const struct LDStore *const store)
+{
+    return store->cacheCapacity > 0 || store->cacheMaxBytes > 0;
+}
 
-    if (!(result = LDAlloc(bytes))) {
-        return NULL;
+/* expects write lock */
+static void
+clockInsert(struct LDStore *const store, struct CacheItem *const item)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(item);
+
+    if (isCacheBounded(store)) {
+        /* behind the hand, so it is the last to be considered */
+        CDL_APPEND2(store->cache->clock, item, clockPrev, clockNext);
+
+        store->cache->clockBytes += item->bytes;
     }
+}
+
+/* expects write lock */
+static void
+clockRemove(struct LDStore *const store, struct CacheItem *const item)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(item);
 
-    status = snprintf(result, bytes, "all:%s", kind);
-    LD_ASSERT(status == bytes - 1);
+    if (isCacheBounded(store)) {
+        CDL_DELETE2(store->cache->clock, item, clockPrev, clockNext);
 
-    return result;
+        store->cache->clockBytes -= item->bytes;
+    }
+}
+
+/* expects write lock. an evicted key is remembered while its kind is complete
+in the backend view, the marker is dropped if that fails */
+static void
+rememberEvicted(
+    struct LDStore *const store, const struct CacheItem *const item)
+{
+    struct CacheItem *entry;
+
+    LD_ASSERT(store);
+    LD_ASSERT(item);
+
+    if (!store->cache->all[item->kind]) {
+        return;
+    }
+
+    entry = NULL;
+
+    HASH_FIND_STR(store->cache->evicted[item->kind], item->key, entry);
+
+    if (entry) {
+        return;
+    }
+
+    if (!(entry = makeCacheItem(item->key, NULL))) {
+        setAllCacheItem(store->cache, item->kind, NULL);
+
+        return;
+    }
+
+    HASH_ADD_KEYPTR(
+        hh,
+        store->cache->evicted[item->kind],
+        entry->key,
+        strlen(entry->key),
+        entry);
+}
+
+/* expects write lock. a key cached again is no longer fetched separately */
+static void
+forgetEvicted(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    const char *const      key)
+{
+    struct CacheItem *entry;
+
+    LD_ASSERT(store);
+    LD_ASSERT(key);
+
+    entry = NULL;
+
+    HASH_FIND_STR(store->cache->evicted[kind], key, entry);
+
+    deleteAndRemoveCacheItem(&store->cache->evicted[kind], entry);
+}
+
+/* whether the cache holds more than either limit allows, expects write lock */
+static LDBoolean
+isOverCapacity(const struct LDStore *const store, const unsigned int count)
+{
+    if (store->cacheCapacity > 0 && count > store->cacheCapacity) {
+        return LDBooleanTrue;
+    }
+
+    return store->cacheMaxBytes > 0 &&
+           store->cache->clockBytes > store->cacheMaxBytes;
 }
 
 /* expects write lock */
+static void
+enforceCapacity(struct LDStore *const store)
+{
+    unsigned int count, pinned, i;
+
+    LD_ASSERT(store);
+
+    if (!isCacheBounded(store)) {
+        return;
+    }
+
+    count  = 0;
+    pinned = 0;
+
+    for (i = 0; i < LD_FEATURE_KIND_COUNT; i++) {
+        count += HASH_COUNT(store->cache->items[i]);
+    }
+
+    /* stops over capacity when a full turn finds only unwritten items */
+    while (isOverCapacity(store, count) && store->cache->clock &&
+           pinned < count)
+    {
+        struct CacheItem *const hand = store->cache->clock;
+
+        if (hand->unwritten) {
+            store->cache->clock = hand->clockNext;
+            pinned++;
+
+            continue;
+        }
+
+        pinned = 0;
+
+        if (hand->referenced) {
+            hand->referenced    = LDBooleanFalse;
+            store->cache->clock = hand->clockNext;
+
+            continue;
+        }
+
+        rememberEvicted(store, hand);
+
+        updateHandle(store, hand->kind, hand->key, NULL);
+
+        clockRemove(store, hand);
+        deleteAndRemoveCacheItem(&store->cache->items[hand->kind], hand);
+
+        count--;
+    }
+}
+
+static LDBoolean
+isLiveItem(const struct CacheItem *const item)
+{
+    return item && !LDi_isFeatureDeleted(LDJSONRCGet(item->feature));
+}
+
+/* whether listeners should hear about replacing one item with another, either
+may be NULL */
+static LDBoolean
+isItemChanged(
+    const struct CacheItem *const previous,
+    const struct CacheItem *const current)
+{
+    if (isLiveItem(previous) != isLiveItem(current)) {
+        return LDBooleanTrue;
+    }
+
+    if (!isLiveItem(previous)) {
+        return LDBooleanFalse;
+    }
+
+    return LDi_getFeatureVersionTrusted(LDJSONRCGet(previous->feature)) !=
+           LDi_getFeatureVersionTrusted(LDJSONRCGet(current->feature));
+}
+
+/* expects write lock. when changed is provided it receives a reference to the
+replacement if it changed the item. when stored is provided it receives a
+reference to the item cached for the key afterwards, whether the replacement
+or a newer item that was kept */
 static LDBoolean
 upsertMemory(
-    struct LDStore *const store,
-    const char *const     kind,
-    struct LDJSON *       replacement)
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    struct LDJSON *         replacement,
+    struct LDJSONRC **const changed,
+    struct LDJSONRC **const stored)
 {
     LDBoolean         success;
-    struct LDJSON *   weakReplacementRef;
-    struct CacheItem *currentItem, *replacementItem, *allItems;
-    char *            cacheKey;
-    char *            allCacheKey;
+    struct CacheItem *currentItem, *replacementItem;
+    const char *      key;
 
     LD_ASSERT(store);
     LD_ASSERT(store->cache);
-    LD_ASSERT(kind);
     LD_ASSERT(replacement);
 
-    success            = LDBooleanFalse;
-    currentItem        = NULL;
-    replacementItem    = NULL;
-    cacheKey           = NULL;
-    weakReplacementRef = replacement;
+    success         = LDBooleanFalse;
+    currentItem     = NULL;
+    replacementItem = NULL;
+    key             = LDi_getFeatureKeyTrusted(replacement);
 
-    allCacheKey = featureStoreAllCacheKey(kind);
-    LD_ASSERT(allCacheKey);
+    if (changed) {
+        *changed = NULL;
+    }
 
-    cacheKey =
-        featureStoreCacheKey(kind, LDi_getFeatureKeyTrusted(replacement));
-    LD_ASSERT(cacheKey);
+    if (stored) {
+        *stored = NULL;
+    }
 
-    HASH_FIND_STR(store->cache->items, cacheKey, currentItem);
+    HASH_FIND_STR(store->cache->items[kind], key, currentItem);
 
     if (currentItem) {
         int            expired;
@@ -472,1104 +926,4637 @@ upsertMemory(
         if (expired == 0 && LDi_getFeatureVersionTrusted(current) >=
                                 LDi_getFeatureVersionTrusted(replacement))
         {
+            /* the backend confirmed the cached version, keep it fresh */
+            if (LDi_getFeatureVersionTrusted(current) ==
+                LDi_getFeatureVersionTrusted(replacement))
+            {
+                if (!LDi_getMonotonicMilliseconds(&currentItem->updatedOn)) {
+                    goto cleanup;
+                }
+
+                currentItem->reads = 0;
+            }
+
+            if (stored) {
+                LDJSONRCIncrement(currentItem->feature);
+
+                *stored = currentItem->feature;
+            }
+
             success = LDBooleanTrue;
 
             goto cleanup;
         }
     }
 
-    if (!(replacementItem = makeCacheItem(cacheKey, replacement))) {
+    if (!(replacementItem = makeCacheItem(key, replacement))) {
+        replacement = NULL;
+
         goto cleanup;
     }
 
     replacement = NULL;
 
-    HASH_FIND_STR(store->cache->items, allCacheKey, allItems);
-
-    if (!store->backend) {
-        struct LDJSON *itemDupe;
-
-        itemDupe = NULL;
-
-        if (!LDi_isFeatureDeleted(weakReplacementRef)) {
-            if (!(itemDupe = LDJSONDuplicate(weakReplacementRef))) {
-                goto cleanup;
-            }
-        }
-
-        if (allItems) {
-            struct LDJSON *   allDupe;
-            struct CacheItem *allDupeItem;
-
-            if (!(allDupe = LDJSONDuplicate(LDJSONRCGet(allItems->feature)))) {
-                goto cleanup;
-            }
-
-            if (itemDupe) {
-                if (!LDObjectSetKey(
-                        allDupe,
-                        LDi_getFeatureKeyTrusted(weakReplacementRef),
-                        itemDupe))
-                {
-                    goto cleanup;
-                }
-            } else {
-                LDObjectDeleteKey(
-                    allDupe, LDi_getFeatureKeyTrusted(weakReplacementRef));
-            }
-
-            if (!(allDupeItem = makeCacheItem(allCacheKey, allDupe))) {
-                goto cleanup;
-            }
-
-            deleteAndRemoveCacheItem(&store->cache->items, allItems);
-
-            HASH_ADD_KEYPTR(
-                hh,
-                store->cache->items,
-                allDupeItem->key,
-                strlen(allDupeItem->key),
-                allDupeItem);
-        } else if (itemDupe) {
-            struct LDJSON *   singleton;
-            struct CacheItem *singletonItem;
-
-            if (!(singleton = LDNewObject())) {
-                goto cleanup;
-            }
+    if (changed && isItemChanged(currentItem, replacementItem)) {
+        /* kept alive in case the item is evicted below */
+        LDJSONRCIncrement(replacementItem->feature);
 
-            if (!LDObjectSetKey(
-                    singleton,
-                    LDi_getFeatureKeyTrusted(weakReplacementRef),
-                    itemDupe))
-            {
-                goto cleanup;
-            }
+        *changed = replacementItem->feature;
+    }
 
-            if (!(singletonItem = makeCacheItem(allCacheKey, singleton))) {
-                goto cleanup;
-            }
+    if (stored) {
+        LDJSONRCIncrement(replacementItem->feature);
 
-            HASH_ADD_KEYPTR(
-                hh,
-                store->cache->items,
-                singletonItem->key,
-                strlen(singletonItem->key),
-                singletonItem);
-        }
-    } else if (allItems) {
-        deleteAndRemoveCacheItem(&store->cache->items, allItems);
+        *stored = replacementItem->feature;
     }
 
     if (currentItem) {
-        deleteAndRemoveCacheItem(&store->cache->items, currentItem);
+        clockRemove(store, currentItem);
+        deleteAndRemoveCacheItem(&store->cache->items[kind], currentItem);
     }
 
+    replacementItem->kind = kind;
+
     HASH_ADD_KEYPTR(
         hh,
-        store->cache->items,
+        store->cache->items[kind],
         replacementItem->key,
         strlen(replacementItem->key),
         replacementItem);
 
+    updateHandle(store, kind, replacementItem->key, replacementItem);
+    forgetEvicted(store, kind, replacementItem->key);
+
+    clockInsert(store, replacementItem);
+
     replacementItem = NULL;
 
+    enforceCapacity(store);
+
     success = LDBooleanTrue;
 
 cleanup:
-    LDFree(allCacheKey);
-    LDFree(cacheKey);
     LDJSONFree(replacement);
     deleteCacheItem(replacementItem);
 
     return success;
 }
 
-/* expects write lock */
-static LDBoolean
-filterAndCacheItems(
-    struct LDStore *const store,
-    const char *const     kind,
-    struct LDJSON *const  features,
-    struct LDJSON **const result)
+static void
+memoryCacheFlush(struct MemoryContext *const context)
 {
-    LDBoolean      success;
-    struct LDJSON *filteredItems, *featuresIter, *dupe, *next;
+    unsigned int i;
 
-    LD_ASSERT(store);
-    LD_ASSERT(kind);
-    LD_ASSERT(features);
-    LD_ASSERT(LDJSONGetType(features) == LDObject);
+    LD_ASSERT(context);
 
-    success       = LDBooleanFalse;
-    filteredItems = NULL;
-    dupe          = NULL;
+    for (i = 0; i < LD_FEATURE_KIND_COUNT; i++) {
+        freeTable(context->items[i]);
+        context->items[i] = NULL;
 
-    if (!(filteredItems = LDNewObject())) {
-        goto cleanup;
+        setAllCacheItem(context, (enum FeatureKind)i, NULL);
     }
 
-    for (featuresIter = LDGetIter(features); featuresIter; featuresIter = next)
-    {
-        next = LDIterNext(featuresIter);
+    deleteCacheItem(context->initChecked);
+    context->initChecked = NULL;
 
-        if (!LDi_isFeatureDeleted(featuresIter)) {
-            if (!(dupe = LDJSONDuplicate(featuresIter))) {
-                goto cleanup;
-            }
+    context->clock      = NULL;
+    context->clockBytes = 0;
+}
 
-            if (!LDObjectSetKey(
-                    filteredItems, LDi_getFeatureKeyTrusted(dupe), dupe)) {
-                goto cleanup;
-            }
+/* expects listenerLock. queues the flags marked changed for the dispatcher */
+static void
+queueChanges(struct LDStore *const store)
+{
+    struct LDJSON *     keys;
+    struct ChangeBatch *batch;
 
-            dupe = NULL;
-        }
+    LD_ASSERT(store);
+    LD_ASSERT(store->dependencies);
 
-        if (!upsertMemory(
-                store, kind, LDCollectionDetachIter(features, featuresIter))) {
-            goto cleanup;
-        }
+    if (!(keys = LDDependencyIndexTakeChanged(store->dependencies))) {
+        LD_LOG(LD_LOG_ERROR, "failed to collect changed flags");
+
+        return;
     }
 
-    success = LDBooleanTrue;
+    if (LDCollectionGetSize(keys) == 0) {
+        LDJSONFree(keys);
 
-    if (result) {
-        *result       = filteredItems;
-        filteredItems = NULL;
+        return;
     }
 
-cleanup:
-    LDJSONFree(dupe);
-    LDJSONFree(filteredItems);
-    LDJSONFree(features);
-
-    return success;
-}
+    if (!(batch = (struct ChangeBatch *)LDAlloc(sizeof(struct ChangeBatch)))) {
+        LD_LOG(LD_LOG_ERROR, "failed to queue changed flags");
 
-static void
-memoryCacheFlush(struct MemoryContext *const context)
-{
-    struct CacheItem *item, *itemTmp;
+        LDJSONFree(keys);
 
-    LD_ASSERT(context);
+        return;
+    }
 
-    item    = NULL;
-    itemTmp = NULL;
+    batch->keys = keys;
+    batch->next = NULL;
 
-    HASH_ITER(hh, context->items, item, itemTmp)
-    {
-        deleteAndRemoveCacheItem(&context->items, item);
-    }
+    LL_APPEND(store->changeQueue, batch);
 
-    context->items = NULL;
+    LDi_cond_signal(&store->changeCondition);
 }
 
-static LDBoolean
-memoryInit(struct LDStore *const store, struct LDJSON *const sets)
+/* expects write lock. consumes the reference produced by upsertMemory. when
+report is false the index is updated without notifying listeners */
+static void
+recordChange(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    struct LDJSONRC *const changed,
+    const LDBoolean        report)
 {
-    struct LDJSON *iter, *next;
+    struct LDJSON *feature;
+    const char *   key;
 
     LD_ASSERT(store);
-    LD_ASSERT(store->cache);
-    LD_ASSERT(sets);
-    LD_ASSERT(LDJSONGetType(sets) == LDObject);
 
-    LDi_rwlock_wrlock(&store->cache->lock);
+    if (!changed) {
+        return;
+    }
 
-    memoryCacheFlush(store->cache);
+    feature = LDJSONRCGet(changed);
+    key     = LDi_getFeatureKeyTrusted(feature);
 
-    for (iter = LDGetIter(sets); iter; iter = next) {
-        next = LDIterNext(iter);
+    LDi_mutex_lock(&store->listenerLock);
 
-        if (!filterAndCacheItems(
-                store,
-                LDIterKey(iter),
-                LDCollectionDetachIter(sets, iter),
-                NULL))
+    if (store->dependencies) {
+        if (kind == LD_FLAG &&
+            !LDDependencyIndexUpdate(store->dependencies, key, feature))
         {
-            memoryCacheFlush(store->cache);
-
-            LDi_rwlock_wrunlock(&store->cache->lock);
-
-            LDJSONFree(sets);
+            LD_LOG(LD_LOG_ERROR, "failed to update flag dependencies");
+        }
 
-            return LDBooleanFalse;
+        if (report &&
+            !LDDependencyIndexMarkChanged(store->dependencies, kind, key))
+        {
+            LD_LOG(LD_LOG_ERROR, "failed to mark changed flags");
         }
-    }
 
-    if (!store->backend) {
-        store->cache->initialized = LDBooleanTrue;
+        queueChanges(store);
     }
 
-    LDi_rwlock_wrunlock(&store->cache->lock);
-
-    LDJSONFree(sets);
+    LDi_mutex_unlock(&store->listenerLock);
 
-    return LDBooleanTrue;
+    LDJSONRCDecrement(changed);
 }
 
-static LDBoolean
-memoryGetCollectionItem(
-    struct MemoryContext *const context,
-    const char *const           kind,
-    const char *const           key,
-    struct CacheItem **         result)
+/* expects read lock and listenerLock. with update set the references of
+changed flags are replaced, otherwise changed items are marked. the index must
+be completely updated before marking so that new references are followed. when
+previous is partial, items missing from it are indexed but not marked */
+static void
+diffTables(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    struct CacheItem *const previous,
+    const LDBoolean         partial,
+    const LDBoolean         update)
 {
-    char *            cacheKey;
-    struct CacheItem *current;
+    struct CacheItem *item, *itemTmp, *other;
 
-    LD_ASSERT(context);
-    LD_ASSERT(kind);
-    LD_ASSERT(key);
-    LD_ASSERT(result);
+    item    = NULL;
+    itemTmp = NULL;
 
-    cacheKey = NULL;
-    *result  = NULL;
+    HASH_ITER(hh, store->cache->items[kind], item, itemTmp)
+    {
+        other = NULL;
 
-    if (!(cacheKey = featureStoreCacheKey(kind, key))) {
-        return LDBooleanFalse;
+        HASH_FIND_STR(previous, item->key, other);
+
+        if (!isItemChanged(other, item)) {
+            continue;
+        }
+
+        if (update) {
+            if (kind == LD_FLAG &&
+                !LDDependencyIndexUpdate(
+                    store->dependencies,
+                    item->key,
+                    isLiveItem(item) ? LDJSONRCGet(item->feature) : NULL))
+            {
+                LD_LOG(LD_LOG_ERROR, "failed to update flag dependencies");
+            }
+        } else if (
+            (other || !partial) &&
+            !LDDependencyIndexMarkChanged(
+                store->dependencies, kind, item->key))
+        {
+            LD_LOG(LD_LOG_ERROR, "failed to mark changed flags");
+        }
     }
 
-    HASH_FIND_STR(context->items, cacheKey, current);
+    HASH_ITER(hh, previous, item, itemTmp)
+    {
+        other = NULL;
 
-    LDFree(cacheKey);
+        HASH_FIND_STR(store->cache->items[kind], item->key, other);
 
-    *result = current;
+        if (other || !isLiveItem(item)) {
+            continue;
+        }
 
-    return LDBooleanTrue;
+        if (update) {
+            if (kind == LD_FLAG &&
+                !LDDependencyIndexUpdate(store->dependencies, item->key, NULL))
+            {
+                LD_LOG(LD_LOG_ERROR, "failed to update flag dependencies");
+            }
+        } else if (!LDDependencyIndexMarkChanged(
+                       store->dependencies, kind, item->key)) {
+            LD_LOG(LD_LOG_ERROR, "failed to mark changed flags");
+        }
+    }
 }
 
-/* -1 error, 0 not expired, 1 expired */
-static int
-isExpired(const struct LDStore *const store, const struct CacheItem *const item)
+/* compare the tables replaced by an init with the current tables */
+static void
+recordInitChanges(
+    struct LDStore *const store, struct CacheItem *const *const previous)
 {
-    double now;
+    unsigned int kind;
 
     LD_ASSERT(store);
-    LD_ASSERT(item);
+    LD_ASSERT(previous);
 
-    if (!store->backend) {
-        return 0;
-    }
+    LDi_rwlock_rdlock(&store->cache->lock);
+    LDi_mutex_lock(&store->listenerLock);
 
-    if (store->cacheMilliseconds == 0) {
-        return 1;
-    }
+    if (store->dependencies) {
+        for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+            diffTables(
+                store,
+                (enum FeatureKind)kind,
+                previous[kind],
+                LDBooleanFalse,
+                LDBooleanTrue);
+        }
 
-    if (LDi_getMonotonicMilliseconds(&now)) {
-        if ((now - item->updatedOn) > store->cacheMilliseconds) {
-            return 1;
-        } else {
-            return 0;
+        for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+            diffTables(
+                store,
+                (enum FeatureKind)kind,
+                previous[kind],
+                LDBooleanFalse,
+                LDBooleanFalse);
         }
-    } else {
-        return -1;
+
+        queueChanges(store);
     }
+
+    LDi_mutex_unlock(&store->listenerLock);
+    LDi_rwlock_rdunlock(&store->cache->lock);
 }
 
-/* if there is a backend use it to fetch all features */
-static LDBoolean
-tryGetAllBackend(
+/* expects write lock. compare a table loaded from the backend with the one it
+replaced, which may only have held the items read so far */
+static void
+recordLoadedChanges(
     struct LDStore *const   store,
-    const char *const       kind,
-    struct LDJSONRC **const result)
+    const enum FeatureKind  kind,
+    struct CacheItem *const previous)
 {
-    LDBoolean                     success;
-    struct LDStoreCollectionItem *rawFeatureItems;
-    unsigned int                  rawFeaturesCount, i;
-    struct LDJSON *               active, *rawFeatures, *activeDupe;
-    struct LDJSONRC *             activeRC;
-    char *                        cacheKey;
-    struct CacheItem *            cacheItem;
-
     LD_ASSERT(store);
-    LD_ASSERT(kind);
-    LD_ASSERT(result);
 
-    success          = LDBooleanFalse;
-    *result          = NULL;
-    rawFeatureItems  = NULL;
-    rawFeaturesCount = 0;
-    i                = 0;
-    active           = NULL;
-    rawFeatures      = NULL;
-    activeRC         = NULL;
-    cacheKey         = NULL;
-    cacheItem        = NULL;
-    activeDupe       = NULL;
+    LDi_mutex_lock(&store->listenerLock);
 
-    if (!store->backend) {
-        success = LDBooleanTrue;
+    if (store->dependencies) {
+        diffTables(store, kind, previous, LDBooleanTrue, LDBooleanTrue);
+        diffTables(store, kind, previous, LDBooleanTrue, LDBooleanFalse);
 
-        goto cleanup;
+        queueChanges(store);
     }
 
-    LD_ASSERT(store->backend->all);
-
-    if (!store->backend->all(
-            store->backend->context, kind, &rawFeatureItems, &rawFeaturesCount))
-    {
-        goto cleanup;
-    }
+    LDi_mutex_unlock(&store->listenerLock);
+}
 
-    if (!(rawFeatures = LDNewObject())) {
-        goto cleanup;
-    }
+/* build one table per kind from a set of collections, the items of all tables
+are allocated together as a generation. invalid items are skipped. when ring is
+provided items are also linked into a new eviction ring. when current is
+provided, items with the same version as in those tables share their value
+instead of the new copy. consumes the items of sets, a read lock is required
+for current */
+static LDBoolean
+buildGeneration(
+    struct LDJSON *const                  sets,
+    const struct CacheItem *const *const current,
+    struct CacheItem **const              tables,
+    struct CacheItem **const              ring)
+{
+    struct LDJSON *    set, *iter, *next;
+    struct CacheItem * slots;
+    struct Generation *generation;
+    char *             keys;
+    unsigned int       count, kind;
+    size_t             keyBytes;
+    double             now;
 
-    for (i = 0; i < rawFeaturesCount; i++) {
-        const char *   key;
-        struct LDJSON *deserialized;
+    LD_ASSERT(sets);
+    LD_ASSERT(tables);
 
-        deserialized = NULL;
+    slots      = NULL;
+    generation = NULL;
+    count      = 0;
+    keyBytes   = 0;
 
-        if (!rawFeatureItems[i].buffer) {
-            continue;
-        }
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        tables[kind] = NULL;
+    }
 
-        if (!(deserialized = LDJSONDeserialize(rawFeatureItems[i].buffer))) {
-            goto cleanup;
-        }
+    if (ring) {
+        *ring = NULL;
+    }
 
-        if (!LDi_validateFeature(deserialized)) {
-            LD_LOG(LD_LOG_ERROR, "LDStoreAll invalid feature from backend");
+    for (set = LDGetIter(sets); set; set = LDIterNext(set)) {
+        enum FeatureKind setKind;
 
-            LDJSONFree(deserialized);
+        if (!featureKindFromString(LDIterKey(set), &setKind)) {
+            LD_LOG_1(
+                LD_LOG_WARNING,
+                "LDStoreInit ignoring unknown kind: %s",
+                LDIterKey(set));
 
             continue;
         }
 
-        if (LDi_isFeatureDeleted(deserialized)) {
-            LDJSONFree(deserialized);
-
-            continue;
-        }
+        for (iter = LDGetIter(set); iter; iter = next) {
+            next = LDIterNext(iter);
 
-        key = LDGetText(LDObjectLookup(deserialized, "key"));
-        LD_ASSERT(key);
+            if (!LDi_validateFeature(iter)) {
+                LD_LOG(LD_LOG_ERROR, "LDStoreInit failed to validate feature");
 
-        if (!LDObjectSetKey(rawFeatures, key, deserialized)) {
-            goto cleanup;
-        }
-    }
+                LDJSONFree(LDCollectionDetachIter(set, iter));
 
-    LDi_rwlock_wrlock(&store->cache->lock);
-    if (!filterAndCacheItems(store, kind, rawFeatures, &active)) {
-        LDi_rwlock_wrunlock(&store->cache->lock);
-        rawFeatures = NULL;
-        goto cleanup;
-    }
-    rawFeatures = NULL;
+                continue;
+            }
 
-    if (!(cacheKey = featureStoreAllCacheKey(kind))) {
-        goto cleanup;
+            keyBytes += strlen(LDi_getFeatureKeyTrusted(iter)) + 1;
+            count++;
+        }
     }
 
-    if (!(activeDupe = LDJSONDuplicate(active))) {
-        goto cleanup;
+    if (count == 0) {
+        return LDBooleanTrue;
     }
 
-    if (!(cacheItem = makeCacheItem(cacheKey, activeDupe))) {
-        goto cleanup;
+    if (!LDi_getMonotonicMilliseconds(&now)) {
+        return LDBooleanFalse;
     }
-    activeDupe = NULL;
-
-    HASH_ADD_KEYPTR(
-        hh,
-        store->cache->items,
-        cacheItem->key,
-        strlen(cacheItem->key),
-        cacheItem);
 
-    LDi_rwlock_wrunlock(&store->cache->lock);
-
-    if (!(activeRC = LDJSONRCNew(active))) {
-        goto cleanup;
+    /* items, then the generation header, then keys */
+    if (!(slots = (struct CacheItem *)LDAlloc(
+              sizeof(struct CacheItem) * count + sizeof(struct Generation) +
+              keyBytes)))
+    {
+        return LDBooleanFalse;
     }
 
-    active  = NULL;
-    *result = activeRC;
-    success = LDBooleanTrue;
-
-cleanup:
-    LDFree(active);
-    LDFree(rawFeatures);
-    LDFree(cacheKey);
-    LDFree(activeDupe);
-
-    for (i = 0; i < rawFeaturesCount; i++) {
-        LDFree(rawFeatureItems[i].buffer);
-    }
+    generation       = (struct Generation *)(slots + count);
+    generation->slab = slots;
+    generation->live = 0;
+    keys             = (char *)(generation + 1);
 
-    LDFree(rawFeatureItems);
+    for (set = LDGetIter(sets); set; set = LDIterNext(set)) {
+        enum FeatureKind setKind;
 
-    return success;
-}
+        if (!featureKindFromString(LDIterKey(set), &setKind)) {
+            continue;
+        }
 
-static LDBoolean
-tryGetBackend(
-    struct LDStore *const   store,
-    const char *const       kind,
-    const char *const       key,
-    struct LDJSONRC **const result)
-{
-    struct LDStoreCollectionItem collectionItem;
-    LDBoolean status;
+        for (iter = LDGetIter(set); iter; iter = next) {
+            struct LDJSON *         feature;
+            struct CacheItem *      item, *existing;
+            const struct CacheItem *previous;
+            const char *            key;
 
-    LD_ASSERT(store);
-    LD_ASSERT(kind);
-    LD_ASSERT(key);
-    LD_ASSERT(result);
+            next     = LDIterNext(iter);
+            feature  = LDCollectionDetachIter(set, iter);
+            key      = LDi_getFeatureKeyTrusted(feature);
+            item     = slots++;
+            existing = NULL;
+            previous = NULL;
 
-    *result = NULL;
-    memset(&collectionItem, 0, sizeof(struct LDStoreCollectionItem));
+            HASH_FIND_STR(tables[setKind], key, existing);
 
-    if (!store->backend) {
-        return LDBooleanTrue;
-    }
+            if (existing &&
+                LDi_getFeatureVersionTrusted(LDJSONRCGet(existing->feature)) >=
+                    LDi_getFeatureVersionTrusted(feature))
+            {
+                LDJSONFree(feature);
 
-    LD_ASSERT(store->backend->get);
+                continue;
+            }
 
-    if (!store->backend->get(
-            store->backend->context, kind, key, &collectionItem)) {
-        return LDBooleanFalse;
-    }
+            memset(item, 0, sizeof(struct CacheItem));
 
-    if (collectionItem.buffer) {
-        struct LDJSON *  deserialized, *dupe;
-        struct LDJSONRC *deserializedRef;
+            strcpy(keys, key);
 
-        if (!(deserialized =
-                  LDJSONDeserialize((const char *)collectionItem.buffer))) {
-            LD_LOG(LD_LOG_ERROR, "LDStoreGet failed to deserialize JSON");
+            if (current) {
+                HASH_FIND_STR(current[setKind], keys, previous);
+            }
 
-            LDFree(collectionItem.buffer);
+            if (previous && previous->feature &&
+                LDi_getFeatureVersionTrusted(LDJSONRCGet(previous->feature)) ==
+                    LDi_getFeatureVersionTrusted(feature) &&
+                LDi_isFeatureDeleted(LDJSONRCGet(previous->feature)) ==
+                    LDi_isFeatureDeleted(feature))
+            {
+                /* unchanged, keep the value readers already share */
+                LDJSONFree(feature);
+                LDJSONRCIncrement(previous->feature);
 
-            return LDBooleanFalse;
-        }
+                item->feature = previous->feature;
+                item->bytes   = previous->bytes;
+            } else {
+                item->bytes = sizeof(struct CacheItem) + strlen(key) + 1 +
+                              sizeof(struct LDJSONRC) +
+                              LDi_JSONFootprint(feature);
 
-        LDFree(collectionItem.buffer);
+                if (!(item->feature = LDJSONRCNew(feature))) {
+                    LDJSONFree(feature);
 
-        if (!LDi_validateFeature(deserialized)) {
-            LD_LOG(LD_LOG_ERROR, "LDStoreGet invalid feature from backend");
+                    goto error;
+                }
+            }
 
-            LDJSONFree(deserialized);
+            item->key        = keys;
+            item->kind       = setKind;
+            item->updatedOn  = now;
+            item->generation = generation;
 
-            return LDBooleanFalse;
-        }
+            keys += strlen(keys) + 1;
 
-        if (LDi_isFeatureDeleted(deserialized)) {
-            LDi_rwlock_wrlock(&store->cache->lock);
-            status = upsertMemory(store, kind, deserialized);
-            LDi_rwlock_wrunlock(&store->cache->lock);
+            generation->live++;
 
-            return status;
-        } else {
-            if (!(deserializedRef = LDJSONRCNew(deserialized))) {
-                LDJSONFree(deserialized);
+            if (existing) {
+                if (ring) {
+                    CDL_DELETE2(*ring, existing, clockPrev, clockNext);
+                }
 
-                return LDBooleanFalse;
+                deleteAndRemoveCacheItem(&tables[setKind], existing);
             }
 
-            if (!(dupe = LDJSONDuplicate(deserialized))) {
-                LDJSONRCDecrement(deserializedRef);
+            HASH_ADD_KEYPTR(
+                hh, tables[setKind], item->key, strlen(item->key), item);
 
-                return LDBooleanFalse;
+            if (ring) {
+                CDL_APPEND2(*ring, item, clockPrev, clockNext);
             }
+        }
+    }
 
-            *result = deserializedRef;
+    return LDBooleanTrue;
 
-            LDi_rwlock_wrlock(&store->cache->lock);
-            status = upsertMemory(store, kind, dupe);
-            LDi_rwlock_wrunlock(&store->cache->lock);
+error:
+    if (ring) {
+        *ring = NULL;
+    }
 
-            return status;
-        }
+    if (generation->live == 0) {
+        LDFree(generation->slab);
     } else {
-        struct LDJSON *placeholder;
-
-        LD_ASSERT(store->cache);
-
-        if (!(placeholder = LDi_makeDeleted(key, collectionItem.version))) {
-            return LDBooleanFalse;
+        for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+            freeTable(tables[kind]);
+            tables[kind] = NULL;
         }
-
-        LDi_rwlock_wrlock(&store->cache->lock);
-        status = upsertMemory(store, kind, placeholder);
-        LDi_rwlock_wrunlock(&store->cache->lock);
-
-        return status;
     }
 
     return LDBooleanFalse;
 }
 
+/* when queue is set the new items are also queued for the backend */
 static LDBoolean
-memoryAllCollectionItem(
-    struct MemoryContext *const context,
-    const char *const           kind,
-    struct CacheItem **const    result)
+memoryInit(
+    struct LDStore *const store,
+    struct LDJSON *const  sets,
+    const LDBoolean       queue)
 {
-    char *            key;
-    struct CacheItem *filtered;
+    struct CacheItem *tables[LD_FEATURE_KIND_COUNT];
+    struct CacheItem *markers[LD_FEATURE_KIND_COUNT];
+    struct CacheItem *evicted[LD_FEATURE_KIND_COUNT];
+    struct CacheItem *initChecked, *ring, *item, *itemTmp;
+    struct LDJSON *   set;
+    unsigned int      kind;
+    size_t            ringBytes;
 
-    LD_ASSERT(context);
-    LD_ASSERT(kind);
-    LD_ASSERT(result);
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(sets);
+    LD_ASSERT(LDJSONGetType(sets) == LDObject);
 
-    if (!(key = featureStoreAllCacheKey(kind))) {
-        return LDBooleanFalse;
+    ring      = NULL;
+    item      = NULL;
+    itemTmp   = NULL;
+    ringBytes = 0;
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        markers[kind] = NULL;
     }
 
-    HASH_FIND_STR(context->items, key, filtered);
+    if (store->soleWriter) {
+        /* memory will hold every item, whichever kinds were provided */
+        for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+            if (!(markers[kind] = makeCacheItem(
+                      featureKindToString((enum FeatureKind)kind), NULL)))
+            {
+                goto error;
+            }
+        }
+    } else if (store->backend) {
+        for (set = LDGetIter(sets); set; set = LDIterNext(set)) {
+            enum FeatureKind setKind;
 
-    LDFree(key);
+            /* the table will mirror the backend, avoid refetching it */
+            if (featureKindFromString(LDIterKey(set), &setKind)) {
+                if (!(markers[setKind] = makeCacheItem(LDIterKey(set), NULL))) {
+                    goto error;
+                }
+            }
+        }
+    }
 
-    *result = filtered;
+    /* everything is built before taking the write lock so readers are only
+    blocked for the swap. unchanged items reuse the current values */
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    if (!buildGeneration(
+            sets,
+            (const struct CacheItem *const *)store->cache->items,
+            tables,
+            isCacheBounded(store) ? &ring : NULL))
+    {
+        LDi_rwlock_rdunlock(&store->cache->lock);
+
+        goto error;
+    }
+
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    /* queued before the swap so no write of an older item follows it */
+    if (queue && !queueInit(store, tables)) {
+        for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+            freeTable(tables[kind]);
+        }
+
+        goto error;
+    }
+
+    for (kind = 0; ring && kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, tables[kind], item, itemTmp) { ringBytes += item->bytes; }
+    }
+
+    LDi_rwlock_wrlock(&store->cache->lock);
+
+    /* swap in the new generation, the previous one is released below */
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        struct CacheItem *const previousTable  = store->cache->items[kind];
+        struct CacheItem *const previousMarker = store->cache->all[kind];
+
+        store->cache->items[kind] = tables[kind];
+        store->cache->all[kind]   = markers[kind];
+
+        tables[kind]  = previousTable;
+        markers[kind] = previousMarker;
+
+        evicted[kind]               = store->cache->evicted[kind];
+        store->cache->evicted[kind] = NULL;
+    }
+
+    initChecked               = store->cache->initChecked;
+    store->cache->initChecked = NULL;
+
+    resolveHandles(store);
+
+    if (isCacheBounded(store)) {
+        store->cache->clock      = ring;
+        store->cache->clockBytes = ringBytes;
+
+        enforceCapacity(store);
+    }
+
+    if (store->soleWriter) {
+        store->authoritative = LDBooleanTrue;
+    }
+
+    /* a backend is asked unless memory is authoritative, or the backend is yet
+    to receive this init */
+    if (!store->backend || store->authoritative || store->initUnwritten) {
+        store->cache->initialized = LDBooleanTrue;
+    }
+
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    recordInitChanges(store, tables);
+
+    /* outside of the lock, readers only hold references to values */
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        freeTable(tables[kind]);
+        freeTable(evicted[kind]);
+        deleteCacheItem(markers[kind]);
+    }
+
+    deleteCacheItem(initChecked);
+
+    LDJSONFree(sets);
+
+    return LDBooleanTrue;
+
+error:
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        deleteCacheItem(markers[kind]);
+    }
+
+    LDJSONFree(sets);
+
+    return LDBooleanFalse;
+}
+
+/* -1 error, 0 not expired, 1 expired */
+static int
+isExpired(const struct LDStore *const store, const struct CacheItem *const item)
+{
+    double now;
+
+    LD_ASSERT(store);
+    LD_ASSERT(item);
+
+    if (!store->backend || store->authoritative) {
+        return 0;
+    }
+
+    /* the backend may not have the item yet */
+    if (item->unwritten || store->initUnwritten) {
+        return 0;
+    }
+
+    if (store->cacheMilliseconds == 0) {
+        return 1;
+    }
+
+    if (LDi_getMonotonicMilliseconds(&now)) {
+        if ((now - item->updatedOn) > store->cacheMilliseconds) {
+            return 1;
+        } else {
+            return 0;
+        }
+    } else {
+        return -1;
+    }
+}
+
+/* serialize a validated item in the format negotiated with the backend */
+static LDBoolean
+encodeItem(
+    const struct LDStore *const         store,
+    const struct LDJSON *const          feature,
+    struct LDStoreCollectionItem *const result)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(feature);
+    LD_ASSERT(result);
+
+    result->version = LDi_getFeatureVersionTrusted(feature);
+
+    if (store->compactItems) {
+        return LDi_encodeCompactItem(
+            feature, &result->buffer, &result->bufferSize);
+    }
+
+    if (!(result->buffer = LDJSONSerialize(feature))) {
+        return LDBooleanFalse;
+    }
+
+    result->bufferSize = strlen((const char *)result->buffer);
+
+    return LDBooleanTrue;
+}
+
+/* items are read in either format, whatever this store writes */
+static struct LDJSON *
+decodeItem(const struct LDStoreCollectionItem *const item)
+{
+    LD_ASSERT(item);
+    LD_ASSERT(item->buffer);
+
+    if (LDi_isCompactItem(item->buffer, item->bufferSize)) {
+        return LDi_decodeCompactItem(item->buffer, item->bufferSize);
+    }
+
+    return LDJSONDeserialize((const char *)item->buffer);
+}
+
+/* build a table from the raw items returned by `backend->all` */
+static LDBoolean
+makeTableFromBackend(
+    const struct LDStoreCollectionItem *const rawItems,
+    const unsigned int                        rawItemsCount,
+    struct CacheItem **const                  result)
+{
+    struct CacheItem *table, *item, *existing;
+    unsigned int      i;
+
+    LD_ASSERT(rawItems || rawItemsCount == 0);
+    LD_ASSERT(result);
+
+    table   = NULL;
+    *result = NULL;
+
+    for (i = 0; i < rawItemsCount; i++) {
+        struct LDJSON *deserialized;
+        const char *   key;
+
+        if (!rawItems[i].buffer) {
+            continue;
+        }
+
+        if (!(deserialized = decodeItem(&rawItems[i]))) {
+            goto error;
+        }
+
+        if (!LDi_validateFeature(deserialized)) {
+            LD_LOG(LD_LOG_ERROR, "LDStoreAll invalid feature from backend");
+
+            LDJSONFree(deserialized);
+
+            continue;
+        }
+
+        key = LDi_getFeatureKeyTrusted(deserialized);
+
+        HASH_FIND_STR(table, key, existing);
+
+        if (existing) {
+            if (LDi_getFeatureVersionTrusted(LDJSONRCGet(existing->feature)) >=
+                LDi_getFeatureVersionTrusted(deserialized))
+            {
+                LDJSONFree(deserialized);
+
+                continue;
+            }
+
+            deleteAndRemoveCacheItem(&table, existing);
+        }
+
+        if (!(item = makeCacheItem(key, deserialized))) {
+            goto error;
+        }
+
+        HASH_ADD_KEYPTR(hh, table, item->key, strlen(item->key), item);
+    }
+
+    *result = table;
+
+    return LDBooleanTrue;
+
+error:
+    freeTable(table);
+
+    return LDBooleanFalse;
+}
+
+/* expects write lock, moves the eviction ring from one table to another */
+static void
+clockReplaceTable(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    struct CacheItem *const previous,
+    struct CacheItem *const replacement)
+{
+    struct CacheItem *item, *tmp;
+
+    LD_ASSERT(store);
+
+    item = NULL;
+    tmp  = NULL;
+
+    if (!isCacheBounded(store)) {
+        return;
+    }
+
+    HASH_ITER(hh, previous, item, tmp) { clockRemove(store, item); }
+
+    HASH_ITER(hh, replacement, item, tmp)
+    {
+        item->kind = kind;
+
+        clockInsert(store, item);
+    }
+}
+
+/* expects write lock. changes not yet written to the backend are moved from
+the previous table into the one loaded from the backend, unless the backend
+already has a version as new */
+static void
+keepUnwritten(
+    struct LDStore *const    store,
+    const enum FeatureKind   kind,
+    struct CacheItem **const previous)
+{
+    struct CacheItem *item, *tmp, *loaded;
+
+    LD_ASSERT(store);
+    LD_ASSERT(previous);
+
+    item = NULL;
+    tmp  = NULL;
+
+    if (!store->writeBehind) {
+        return;
+    }
+
+    HASH_ITER(hh, *previous, item, tmp)
+    {
+        if (!item->unwritten) {
+            continue;
+        }
+
+        loaded = NULL;
+
+        HASH_FIND_STR(store->cache->items[kind], item->key, loaded);
+
+        if (loaded) {
+            if (LDi_getFeatureVersionTrusted(LDJSONRCGet(loaded->feature)) >=
+                LDi_getFeatureVersionTrusted(LDJSONRCGet(item->feature)))
+            {
+                continue;
+            }
+
+            clockRemove(store, loaded);
+            deleteAndRemoveCacheItem(&store->cache->items[kind], loaded);
+        }
+
+        HASH_DEL(*previous, item);
+
+        item->kind = kind;
+
+        HASH_ADD_KEYPTR(
+            hh,
+            store->cache->items[kind],
+            item->key,
+            strlen(item->key),
+            item);
+
+        clockInsert(store, item);
+    }
+}
+
+/* if there is a backend use it to replace all features of a kind. when
+requested a snapshot is taken before any items are evicted */
+static LDBoolean
+tryGetAllBackend(
+    struct LDStore *const          store,
+    const enum FeatureKind         kind,
+    struct LDStoreSnapshot **const snapshot)
+{
+    LDBoolean                     success;
+    struct LDStoreCollectionItem *rawFeatureItems;
+    unsigned int                  rawFeaturesCount, i;
+    struct CacheItem *            table, *marker;
+    void *                        token;
+    LDBoolean                     borrowed, parsed;
+
+    LD_ASSERT(store);
+
+    success          = LDBooleanFalse;
+    rawFeatureItems  = NULL;
+    rawFeaturesCount = 0;
+    table            = NULL;
+    marker           = NULL;
+    token            = NULL;
+
+    if (!store->backend) {
+        return LDBooleanTrue;
+    }
+
+    borrowed = store->backend->allBorrowed && store->backend->release;
+
+    if (borrowed) {
+        if (!store->backend->allBorrowed(
+                store->backend->context,
+                featureKindToString(kind),
+                &rawFeatureItems,
+                &rawFeaturesCount,
+                &token))
+        {
+            return LDBooleanFalse;
+        }
+    } else {
+        LD_ASSERT(store->backend->all);
+
+        if (!store->backend->all(
+                store->backend->context,
+                featureKindToString(kind),
+                &rawFeatureItems,
+                &rawFeaturesCount))
+        {
+            return LDBooleanFalse;
+        }
+    }
+
+    parsed = makeTableFromBackend(rawFeatureItems, rawFeaturesCount, &table);
+
+    /* the raw items are no longer needed once parsed */
+    if (borrowed) {
+        store->backend->release(store->backend->context, token);
+    } else {
+        for (i = 0; i < rawFeaturesCount; i++) {
+            LDFree(rawFeatureItems[i].buffer);
+        }
+
+        LDFree(rawFeatureItems);
+    }
+
+    if (!parsed) {
+        return LDBooleanFalse;
+    }
+
+    if (!(marker = makeCacheItem(featureKindToString(kind), NULL))) {
+        goto cleanup;
+    }
+
+    /* the backend is authoritative, swap in its view of the kind. unless it
+    has yet to receive an init already applied to memory */
+    LDi_rwlock_wrlock(&store->cache->lock);
+    if (!store->initUnwritten) {
+        struct CacheItem *const previous = store->cache->items[kind];
+
+        clockReplaceTable(store, kind, previous, table);
+
+        store->cache->items[kind] = table;
+        table                     = previous;
+
+        keepUnwritten(store, kind, &table);
+
+        if (kind == LD_FLAG) {
+            resolveHandles(store);
+        }
+
+        recordLoadedChanges(store, kind, table);
+    }
+    setAllCacheItem(store->cache, kind, marker);
+
+    if (snapshot && !memorySnapshot(store->cache, kind, snapshot)) {
+        LDi_rwlock_wrunlock(&store->cache->lock);
+
+        goto cleanup;
+    }
+
+    enforceCapacity(store);
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    success = LDBooleanTrue;
+
+cleanup:
+    /* frees the previous table outside of the lock */
+    freeTable(table);
+
+    return success;
+}
+
+/* references every item of the table, deleted ones only when asked */
+static LDBoolean
+snapshotTable(
+    struct CacheItem *const        table,
+    const LDBoolean                deleted,
+    struct LDStoreSnapshot **const result)
+{
+    struct LDStoreSnapshot *snapshot;
+    struct CacheItem *      iter, *tmp;
+    unsigned int            capacity;
+
+    LD_ASSERT(result);
+
+    iter     = NULL;
+    tmp      = NULL;
+    capacity = HASH_COUNT(table);
+
+    if (!(snapshot = (struct LDStoreSnapshot *)LDAlloc(
+              sizeof(struct LDStoreSnapshot))))
+    {
+        return LDBooleanFalse;
+    }
+
+    snapshot->count = 0;
+    snapshot->items = NULL;
+
+    if (capacity > 0) {
+        if (!(snapshot->items = (struct LDJSONRC **)LDAlloc(
+                  sizeof(struct LDJSONRC *) * capacity)))
+        {
+            LDFree(snapshot);
+
+            return LDBooleanFalse;
+        }
+    }
+
+    HASH_ITER(hh, table, iter, tmp)
+    {
+        if (!deleted && LDi_isFeatureDeleted(LDJSONRCGet(iter->feature))) {
+            continue;
+        }
+
+        LDJSONRCIncrement(iter->feature);
+
+        snapshot->items[snapshot->count++] = iter->feature;
+    }
+
+    *result = snapshot;
+
+    return LDBooleanTrue;
+}
+
+/* expects read lock */
+static LDBoolean
+memorySnapshot(
+    struct MemoryContext *const    context,
+    const enum FeatureKind         kind,
+    struct LDStoreSnapshot **const result)
+{
+    LD_ASSERT(context);
+
+    return snapshotTable(context->items[kind], LDBooleanFalse, result);
+}
+
+/* expects write lock. flags read from the backend are indexed for listeners,
+which only hear about items replacing a cached version. when result is
+provided it receives a reference to the cached item, or NULL if it is
+deleted */
+static LDBoolean
+upsertLoaded(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    struct LDJSON *const    replacement,
+    struct LDJSONRC **const result)
+{
+    struct CacheItem *current;
+    struct LDJSONRC * changed, *stored;
+    LDBoolean         cached;
+
+    LD_ASSERT(store);
+    LD_ASSERT(replacement);
+
+    current = NULL;
+    changed = NULL;
+    stored  = NULL;
+
+    HASH_FIND_STR(
+        store->cache->items[kind],
+        LDi_getFeatureKeyTrusted(replacement),
+        current);
+
+    cached = current ? LDBooleanTrue : LDBooleanFalse;
+
+    if (!upsertMemory(
+            store, kind, replacement, &changed, result ? &stored : NULL))
+    {
+        return LDBooleanFalse;
+    }
+
+    recordChange(store, kind, changed, cached);
+
+    if (result) {
+        if (LDi_isFeatureDeleted(LDJSONRCGet(stored))) {
+            LDJSONRCDecrement(stored);
+        } else {
+            *result = stored;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+/* cache an item returned by the backend, the buffer is left to the caller.
+when result is provided it receives a reference to the item if it exists */
+static LDBoolean
+cacheBackendItem(
+    struct LDStore *const                     store,
+    const enum FeatureKind                    kind,
+    const char *const                         key,
+    const struct LDStoreCollectionItem *const collectionItem,
+    struct LDJSONRC **const                   result)
+{
+    LDBoolean status;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(key);
+    LD_ASSERT(collectionItem);
+
+    if (result) {
+        *result = NULL;
+    }
+
+    if (collectionItem->buffer) {
+        struct LDJSON *deserialized;
+
+        if (!(deserialized = decodeItem(collectionItem))) {
+            LD_LOG(LD_LOG_ERROR, "LDStoreGet failed to deserialize item");
+
+            return LDBooleanFalse;
+        }
+
+        if (!LDi_validateFeature(deserialized)) {
+            LD_LOG(LD_LOG_ERROR, "LDStoreGet invalid feature from backend");
+
+            LDJSONFree(deserialized);
+
+            return LDBooleanFalse;
+        }
+
+        /* the caller shares the item published to the cache */
+        LDi_rwlock_wrlock(&store->cache->lock);
+        status = upsertLoaded(store, kind, deserialized, result);
+        LDi_rwlock_wrunlock(&store->cache->lock);
+
+        return status;
+    } else {
+        struct LDJSON *placeholder;
+
+        if (!(placeholder = LDi_makeDeleted(key, collectionItem->version))) {
+            return LDBooleanFalse;
+        }
+
+        LDi_rwlock_wrlock(&store->cache->lock);
+        status = upsertLoaded(store, kind, placeholder, NULL);
+        LDi_rwlock_wrunlock(&store->cache->lock);
+
+        return status;
+    }
+}
+
+static LDBoolean
+tryGetBackend(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct LDJSONRC **const result)
+{
+    struct LDStoreCollectionItem collectionItem;
+    LDBoolean                    status;
+
+    LD_ASSERT(store);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    *result = NULL;
+    memset(&collectionItem, 0, sizeof(struct LDStoreCollectionItem));
+
+    if (!store->backend) {
+        return LDBooleanTrue;
+    }
+
+    /* parse directly from backend memory when it can lend it */
+    if (store->backend->getBorrowed && store->backend->release) {
+        void *token;
+
+        token = NULL;
+
+        if (!store->backend->getBorrowed(
+                store->backend->context,
+                featureKindToString(kind),
+                key,
+                &collectionItem,
+                &token))
+        {
+            return LDBooleanFalse;
+        }
+
+        status = cacheBackendItem(store, kind, key, &collectionItem, result);
+
+        store->backend->release(store->backend->context, token);
+
+        return status;
+    }
+
+    LD_ASSERT(store->backend->get);
+
+    if (!store->backend->get(
+            store->backend->context,
+            featureKindToString(kind),
+            key,
+            &collectionItem))
+    {
+        return LDBooleanFalse;
+    }
+
+    status = cacheBackendItem(store, kind, key, &collectionItem, result);
+
+    LDFree(collectionItem.buffer);
+
+    return status;
+}
+
+/* read several items of a kind from the backend, with a single call when the
+backend supports it. the caller frees each buffer and the array */
+static LDBoolean
+getManyRaw(
+    struct LDStore *const                store,
+    const enum FeatureKind               kind,
+    const char *const *const             keys,
+    const unsigned int                   count,
+    struct LDStoreCollectionItem **const result)
+{
+    struct LDStoreCollectionItem *collectionItems;
+    unsigned int                  i;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->backend);
+    LD_ASSERT(store->backend->get);
+    LD_ASSERT(keys);
+    LD_ASSERT(count > 0);
+    LD_ASSERT(result);
+
+    *result = NULL;
+
+    if (!(collectionItems = (struct LDStoreCollectionItem *)LDAlloc(
+              sizeof(struct LDStoreCollectionItem) * count)))
+    {
+        return LDBooleanFalse;
+    }
+
+    memset(collectionItems, 0, sizeof(struct LDStoreCollectionItem) * count);
+
+    if (store->backend->getMany && count > 1) {
+        if (!store->backend->getMany(
+                store->backend->context,
+                featureKindToString(kind),
+                keys,
+                count,
+                collectionItems))
+        {
+            LDFree(collectionItems);
+
+            return LDBooleanFalse;
+        }
+    } else {
+        for (i = 0; i < count; i++) {
+            if (!store->backend->get(
+                    store->backend->context,
+                    featureKindToString(kind),
+                    keys[i],
+                    &collectionItems[i]))
+            {
+                while (i > 0) {
+                    LDFree(collectionItems[--i].buffer);
+                }
+
+                LDFree(collectionItems);
+
+                return LDBooleanFalse;
+            }
+        }
+    }
+
+    *result = collectionItems;
+
+    return LDBooleanTrue;
+}
+
+/* fetch and cache several items of a kind */
+static LDBoolean
+tryGetManyBackend(
+    struct LDStore *const    store,
+    const enum FeatureKind   kind,
+    const char *const *const keys,
+    const unsigned int       count)
+{
+    struct LDStoreCollectionItem *collectionItems;
+    unsigned int                  i;
+    LDBoolean                     status;
+
+    LD_ASSERT(store);
+    LD_ASSERT(keys || count == 0);
+
+    if (!store->backend || count == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!getManyRaw(store, kind, keys, count, &collectionItems)) {
+        return LDBooleanFalse;
+    }
+
+    status = LDBooleanTrue;
+
+    /* every buffer is freed even if one item fails */
+    for (i = 0; i < count; i++) {
+        if (!cacheBackendItem(store, kind, keys[i], &collectionItems[i], NULL))
+        {
+            status = LDBooleanFalse;
+        }
+
+        LDFree(collectionItems[i].buffer);
+    }
+
+    LDFree(collectionItems);
+
+    return status;
+}
+
+/* **** Fetch coalescing **** */
+
+/* appends keys of items that are missing from memory or expired to wanted.
+keys already in visited are skipped, and every other key is added to it */
+static LDBoolean
+collectUncached(
+    struct LDStore *const      store,
+    const enum FeatureKind     kind,
+    const struct LDJSON *const keys,
+    struct KeySetEntry **const visited,
+    struct LDJSON *const       wanted)
+{
+    struct LDJSON *iter, *key;
+    LDBoolean      status;
+    int            added;
+
+    status = LDBooleanTrue;
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    for (iter = LDGetIter(keys); iter; iter = LDIterNext(iter)) {
+        struct CacheItem *item;
+
+        item = NULL;
+
+        if ((added = LDi_keySetAdd(visited, LDGetText(iter))) < 0) {
+            status = LDBooleanFalse;
+
+            break;
+        }
+
+        if (added == 0) {
+            continue;
+        }
+
+        HASH_FIND_STR(store->cache->items[kind], LDGetText(iter), item);
+
+        if (item && isExpired(store, item) == 0) {
+            continue;
+        }
+
+        if (!(key = LDJSONDuplicate(iter))) {
+            status = LDBooleanFalse;
+
+            break;
+        }
+
+        if (!LDArrayPush(wanted, key)) {
+            LDJSONFree(key);
+
+            status = LDBooleanFalse;
+
+            break;
+        }
+    }
+
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    return status;
+}
+
+static LDBoolean
+fetchKeys(
+    struct LDStore *const      store,
+    const enum FeatureKind     kind,
+    const struct LDJSON *const keys)
+{
+    const char **      buffer;
+    struct LDJSON *    iter;
+    const unsigned int count = LDCollectionGetSize(keys);
+    unsigned int       i;
+    LDBoolean          status;
+
+    if (count == 0) {
+        return LDBooleanTrue;
+    }
+
+    if (!(buffer = (const char **)LDAlloc(sizeof(char *) * count))) {
+        return LDBooleanFalse;
+    }
+
+    for (i = 0, iter = LDGetIter(keys); iter; iter = LDIterNext(iter)) {
+        buffer[i++] = LDGetText(iter);
+    }
+
+    status = tryGetManyBackend(store, kind, buffer, count);
+
+    LDFree(buffer);
+
+    return status;
+}
+
+/* a flag fetched from the backend is usually evaluated next, which reads each
+prerequisite and segment it references. those that are not cached are fetched
+with one batched call per kind for each level of prerequisites. each key is
+considered once, so prerequisite cycles end */
+static void
+prefetchDependencies(struct LDStore *const store, struct LDJSON *const flag)
+{
+    struct LDJSON *     prerequisites, *segments, *wantedFlags, *wantedSegments,
+        *fetched;
+    struct KeySetEntry *visitedFlags, *visitedSegments;
+
+    LD_ASSERT(store);
+    LD_ASSERT(flag);
+
+    prerequisites   = NULL;
+    segments        = NULL;
+    wantedFlags     = NULL;
+    wantedSegments  = NULL;
+    fetched         = NULL;
+    visitedFlags    = NULL;
+    visitedSegments = NULL;
+
+    /* prefetched items would expire before the evaluation reads them */
+    if (store->cacheMilliseconds == 0) {
+        return;
+    }
+
+    if (LDi_keySetAdd(&visitedFlags, LDi_getFeatureKeyTrusted(flag)) < 0) {
+        goto error;
+    }
+
+    while (LDBooleanTrue) {
+        struct LDJSON *iter;
+
+        if (!(prerequisites = LDNewArray()) || !(segments = LDNewArray()) ||
+            !(wantedFlags = LDNewArray()) || !(wantedSegments = LDNewArray()))
+        {
+            goto error;
+        }
+
+        if (!fetched) {
+            if (!LDi_collectFlagReferences(flag, prerequisites, segments)) {
+                goto error;
+            }
+        } else {
+            /* the prerequisites fetched by the previous level */
+            LDi_rwlock_rdlock(&store->cache->lock);
+
+            for (iter = LDGetIter(fetched); iter; iter = LDIterNext(iter)) {
+                struct CacheItem *item;
+
+                item = NULL;
+
+                HASH_FIND_STR(
+                    store->cache->items[LD_FLAG], LDGetText(iter), item);
+
+                if (isLiveItem(item) &&
+                    !LDi_collectFlagReferences(
+                        LDJSONRCGet(item->feature), prerequisites, segments))
+                {
+                    LDi_rwlock_rdunlock(&store->cache->lock);
+
+                    goto error;
+                }
+            }
+
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            LDJSONFree(fetched);
+            fetched = NULL;
+        }
+
+        if (!collectUncached(
+                store, LD_FLAG, prerequisites, &visitedFlags, wantedFlags) ||
+            !collectUncached(
+                store, LD_SEGMENT, segments, &visitedSegments, wantedSegments))
+        {
+            goto error;
+        }
+
+        LDJSONFree(prerequisites);
+        LDJSONFree(segments);
+        prerequisites = NULL;
+        segments      = NULL;
+
+        if (!fetchKeys(store, LD_FLAG, wantedFlags) ||
+            !fetchKeys(store, LD_SEGMENT, wantedSegments))
+        {
+            goto error;
+        }
+
+        LDJSONFree(wantedSegments);
+        wantedSegments = NULL;
+
+        if (LDCollectionGetSize(wantedFlags) == 0) {
+            break;
+        }
+
+        fetched     = wantedFlags;
+        wantedFlags = NULL;
+    }
+
+    LDJSONFree(wantedFlags);
+    LDi_keySetFree(&visitedFlags);
+    LDi_keySetFree(&visitedSegments);
+
+    return;
+
+error:
+    LD_LOG(LD_LOG_WARNING, "failed to prefetch flag dependencies");
+
+    LDJSONFree(prerequisites);
+    LDJSONFree(segments);
+    LDJSONFree(wantedFlags);
+    LDJSONFree(wantedSegments);
+    LDJSONFree(fetched);
+    LDi_keySetFree(&visitedFlags);
+    LDi_keySetFree(&visitedSegments);
+}
+
+static struct InFlightFetch *
+makeFetch(const enum FeatureKind kind, const char *const key)
+{
+    struct InFlightFetch *flight;
+
+    if (!(flight =
+              (struct InFlightFetch *)LDAlloc(sizeof(struct InFlightFetch))))
+    {
+        return NULL;
+    }
+
+    memset(flight, 0, sizeof(struct InFlightFetch));
+
+    flight->kind = kind;
+
+    if (key) {
+        if (!(flight->key = LDStrDup(key))) {
+            LDFree(flight);
+
+            return NULL;
+        }
+    }
+
+    return flight;
+}
+
+static void
+freeFetch(struct InFlightFetch *const flight)
+{
+    if (flight) {
+        LDFree(flight->key);
+        LDFree(flight);
+    }
+}
+
+/* expects fetchLock, which is released. the flight must already be detached
+from the in flight tables. -1 timed out, 0 fetch failed, 1 fetch succeeded */
+static int
+waitForFetch(struct LDStore *const store, struct InFlightFetch *const flight)
+{
+    double start, now;
+    int    outcome;
+
+    LD_ASSERT(store);
+    LD_ASSERT(flight);
+
+    start = 0;
+    now   = 0;
+
+    flight->waiters++;
+
+    if (LDi_getMonotonicMilliseconds(&start)) {
+        now = start;
+
+        while (!flight->done && now - start < FETCH_WAIT_MILLISECONDS) {
+            LDi_cond_wait(
+                &store->fetchCondition,
+                &store->fetchLock,
+                FETCH_WAIT_MILLISECONDS - (int)(now - start));
+
+            if (!LDi_getMonotonicMilliseconds(&now)) {
+                break;
+            }
+        }
+    }
+
+    flight->waiters--;
+
+    if (flight->done) {
+        outcome = flight->success ? 1 : 0;
+
+        /* the leader has gone, the last waiter out frees the flight */
+        if (flight->waiters == 0) {
+            freeFetch(flight);
+        }
+    } else {
+        outcome = -1;
+    }
+
+    LDi_mutex_unlock(&store->fetchLock);
+
+    return outcome;
+}
+
+/* expects fetchLock, which is released. the flight must already be detached
+from the in flight tables */
+static void
+finishFetch(
+    struct LDStore *const       store,
+    struct InFlightFetch *const flight,
+    const LDBoolean             success)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(flight);
+
+    flight->done    = LDBooleanTrue;
+    flight->success = success;
+
+    if (flight->waiters == 0) {
+        freeFetch(flight);
+    }
+
+    LDi_mutex_unlock(&store->fetchLock);
+
+    LDi_cond_signal(&store->fetchCondition);
+}
+
+/* expects fetchLock */
+static void
+detachFetch(struct LDStore *const store, struct InFlightFetch *const flight)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(flight);
+
+    if (flight->key) {
+        HASH_DEL(store->fetching[flight->kind], flight);
+    } else {
+        store->fetchingAll[flight->kind] = NULL;
+    }
+}
+
+/* read an item just written by another thread's fetch, ignoring expiration */
+static LDBoolean
+memoryGetFetched(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct LDJSONRC **const result)
+{
+    struct CacheItem *item;
+
+    LD_ASSERT(store);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    item    = NULL;
+    *result = NULL;
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    HASH_FIND_STR(store->cache->items[kind], key, item);
+
+    if (item && !LDi_isFeatureDeleted(LDJSONRCGet(item->feature))) {
+        LDJSONRCIncrement(item->feature);
+
+        *result = item->feature;
+    }
+
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    return LDBooleanTrue;
+}
+
+/* only one thread at a time queries the backend for a given item, others
+wait for and share its result */
+static LDBoolean
+coalescedGetBackend(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct LDJSONRC **const result)
+{
+    struct InFlightFetch *flight;
+    LDBoolean             status;
+
+    LD_ASSERT(store);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    flight  = NULL;
+    *result = NULL;
+
+    LDi_mutex_lock(&store->fetchLock);
+
+    HASH_FIND_STR(store->fetching[kind], key, flight);
+
+    if (flight) {
+        const int outcome = waitForFetch(store, flight);
+
+        if (outcome > 0) {
+            return memoryGetFetched(store, kind, key, result);
+        } else if (outcome == 0) {
+            return LDBooleanFalse;
+        }
+
+        LD_LOG(LD_LOG_WARNING, "timed out waiting on backend fetch");
+
+        return tryGetBackend(store, kind, key, result);
+    }
+
+    if (!(flight = makeFetch(kind, key))) {
+        LDi_mutex_unlock(&store->fetchLock);
+
+        return LDBooleanFalse;
+    }
+
+    HASH_ADD_KEYPTR(
+        hh, store->fetching[kind], flight->key, strlen(flight->key), flight);
+
+    LDi_mutex_unlock(&store->fetchLock);
+
+    status = tryGetBackend(store, kind, key, result);
+
+    LDi_mutex_lock(&store->fetchLock);
+    detachFetch(store, flight);
+    finishFetch(store, flight, status);
+
+    /* after finishing so waiters on the flag are not delayed */
+    if (status && kind == LD_FLAG && *result) {
+        prefetchDependencies(store, LDJSONRCGet(*result));
+    }
+
+    return status;
+}
+
+/* only one thread at a time loads an entire kind from the backend. the thread
+that performs the fetch receives a snapshot, others find the result in memory */
+static LDBoolean
+coalescedGetAllBackend(
+    struct LDStore *const          store,
+    const enum FeatureKind         kind,
+    struct LDStoreSnapshot **const snapshot)
+{
+    struct InFlightFetch *flight;
+    LDBoolean             status;
+
+    LD_ASSERT(store);
+
+    LDi_mutex_lock(&store->fetchLock);
+
+    if ((flight = store->fetchingAll[kind])) {
+        const int outcome = waitForFetch(store, flight);
+
+        if (outcome >= 0) {
+            return outcome > 0;
+        }
+
+        LD_LOG(LD_LOG_WARNING, "timed out waiting on backend fetch");
+
+        return tryGetAllBackend(store, kind, snapshot);
+    }
+
+    if (!(flight = makeFetch(kind, NULL))) {
+        LDi_mutex_unlock(&store->fetchLock);
+
+        return LDBooleanFalse;
+    }
+
+    store->fetchingAll[kind] = flight;
+
+    LDi_mutex_unlock(&store->fetchLock);
+
+    status = tryGetAllBackend(store, kind, snapshot);
+
+    LDi_mutex_lock(&store->fetchLock);
+    detachFetch(store, flight);
+    finishFetch(store, flight, status);
+
+    return status;
+}
+
+/* -1 error, 0 too stale to serve, 1 may be served while refreshing */
+static int
+isServableStale(
+    const struct LDStore *const store, const struct CacheItem *const item)
+{
+    double now;
+
+    LD_ASSERT(store);
+    LD_ASSERT(item);
+
+    if (store->staleMilliseconds == 0) {
+        return 0;
+    }
+
+    if (!LDi_getMonotonicMilliseconds(&now)) {
+        return -1;
+    }
+
+    if (now - item->updatedOn >
+        (double)store->cacheMilliseconds + store->staleMilliseconds)
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* queue a background refresh of an item, or of an entire kind when key is
+NULL, unless a fetch for it is already pending */
+static void
+scheduleRefresh(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    const char *const      key)
+{
+    struct InFlightFetch *flight;
+
+    LD_ASSERT(store);
+
+    flight = NULL;
+
+    LDi_mutex_lock(&store->fetchLock);
+
+    if (key) {
+        HASH_FIND_STR(store->fetching[kind], key, flight);
+    } else {
+        flight = store->fetchingAll[kind];
+    }
+
+    if (flight || !store->refreshRunning) {
+        LDi_mutex_unlock(&store->fetchLock);
+
+        return;
+    }
+
+    if (!(flight = makeFetch(kind, key))) {
+        LDi_mutex_unlock(&store->fetchLock);
+
+        return;
+    }
+
+    /* registered as in flight so synchronous fetches wait on it */
+    if (key) {
+        HASH_ADD_KEYPTR(
+            hh,
+            store->fetching[kind],
+            flight->key,
+            strlen(flight->key),
+            flight);
+    } else {
+        store->fetchingAll[kind] = flight;
+    }
+
+    LL_APPEND(store->refreshQueue, flight);
+
+    LDi_mutex_unlock(&store->fetchLock);
+
+    LDi_cond_signal(&store->refreshCondition);
+}
+
+/* expects read lock */
+static void
+recordRead(struct LDStore *const store, struct CacheItem *const item)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(item);
+
+    if (store->refreshAheadReads > 0 || isCacheBounded(store)) {
+        LDi_mutex_lock(&store->usageLock);
+        item->reads++;
+        item->referenced = LDBooleanTrue;
+        LDi_mutex_unlock(&store->usageLock);
+    }
+}
+
+/* queue refreshes for frequently read items that will expire soon */
+static void
+scanRefreshAhead(struct LDStore *const store)
+{
+    struct CacheItem *item, *tmp;
+    double            now, window;
+    unsigned int      kind;
+
+    LD_ASSERT(store);
+
+    item   = NULL;
+    tmp    = NULL;
+    window = store->cacheMilliseconds / REFRESH_AHEAD_WINDOW_DIVISOR;
+
+    if (!LDi_getMonotonicMilliseconds(&now)) {
+        return;
+    }
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, store->cache->items[kind], item, tmp)
+        {
+            unsigned int reads;
+
+            if (now - item->updatedOn < store->cacheMilliseconds - window) {
+                continue;
+            }
+
+            LDi_mutex_lock(&store->usageLock);
+            reads = item->reads;
+            LDi_mutex_unlock(&store->usageLock);
+
+            if (reads >= store->refreshAheadReads) {
+                scheduleRefresh(store, (enum FeatureKind)kind, item->key);
+            }
+        }
+    }
+
+    LDi_rwlock_rdunlock(&store->cache->lock);
+}
+
+static THREAD_RETURN
+refreshThread(void *const rawStore)
+{
+    struct LDStore *store;
+    double          nextScan, nextReload;
+    int             scanInterval;
+
+    LD_ASSERT(rawStore);
+
+    store        = (struct LDStore *)rawStore;
+    nextScan     = 0;
+    nextReload   = 0;
+    scanInterval = 1000;
+
+    if (store->refreshAheadReads > 0) {
+        scanInterval = store->cacheMilliseconds /
+                       (REFRESH_AHEAD_WINDOW_DIVISOR * REFRESH_AHEAD_SCANS);
+
+        if (scanInterval < 1) {
+            scanInterval = 1;
+        } else if (scanInterval > 1000) {
+            scanInterval = 1000;
+        }
+    }
+
+    if (store->reloadMilliseconds > 0) {
+        if ((int)store->reloadMilliseconds < scanInterval) {
+            scanInterval = store->reloadMilliseconds;
+        }
+
+        /* the collections were just loaded by the warm up */
+        if (LDi_getMonotonicMilliseconds(&nextReload)) {
+            nextReload += store->reloadMilliseconds;
+        }
+    }
+
+    LDi_mutex_lock(&store->fetchLock);
+
+    while (store->refreshRunning) {
+        struct InFlightFetch *flight;
+        LDBoolean             status;
+
+        if (!(flight = store->refreshQueue)) {
+            double now;
+
+            if (store->refreshAheadReads > 0 &&
+                LDi_getMonotonicMilliseconds(&now) && now >= nextScan)
+            {
+                nextScan = now + scanInterval;
+
+                /* the refreshes found are processed as a batch */
+                LDi_mutex_unlock(&store->fetchLock);
+                scanRefreshAhead(store);
+                LDi_mutex_lock(&store->fetchLock);
+            } else if (store->reloadMilliseconds > 0 &&
+                       LDi_getMonotonicMilliseconds(&now) && now >= nextReload)
+            {
+                unsigned int kind;
+
+                nextReload = now + store->reloadMilliseconds;
+
+                LDi_mutex_unlock(&store->fetchLock);
+
+                for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+                    scheduleRefresh(store, (enum FeatureKind)kind, NULL);
+                }
+
+                LDi_mutex_lock(&store->fetchLock);
+            } else {
+                LDi_cond_wait(
+                    &store->refreshCondition, &store->fetchLock, scanInterval);
+            }
+
+            continue;
+        }
+
+        LL_DELETE(store->refreshQueue, flight);
+        flight->next = NULL;
+
+        if (!flight->key) {
+            LDi_mutex_unlock(&store->fetchLock);
+
+            if (!(status = tryGetAllBackend(store, flight->kind, NULL))) {
+                LD_LOG(LD_LOG_ERROR, "background store refresh failed");
+            }
+
+            LDi_mutex_lock(&store->fetchLock);
+            detachFetch(store, flight);
+            finishFetch(store, flight, status);
+            LDi_mutex_lock(&store->fetchLock);
+
+            continue;
+        }
+
+        {
+            struct InFlightFetch *batch, *other, *tmp;
+            const char *          keys[REFRESH_BATCH_SIZE];
+            unsigned int          count;
+
+            batch   = flight;
+            keys[0] = flight->key;
+            count   = 1;
+
+            /* other queued items of the kind share one backend call */
+            LL_FOREACH_SAFE(store->refreshQueue, other, tmp)
+            {
+                if (count == REFRESH_BATCH_SIZE) {
+                    break;
+                }
+
+                if (other->key && other->kind == flight->kind) {
+                    LL_DELETE(store->refreshQueue, other);
+                    other->next = NULL;
+
+                    LL_APPEND(batch, other);
+
+                    keys[count++] = other->key;
+                }
+            }
+
+            LDi_mutex_unlock(&store->fetchLock);
+
+            if (!(status = tryGetManyBackend(store, flight->kind, keys, count)))
+            {
+                LD_LOG(LD_LOG_ERROR, "background store refresh failed");
+            }
+
+            LL_FOREACH_SAFE(batch, other, tmp)
+            {
+                LDi_mutex_lock(&store->fetchLock);
+                detachFetch(store, other);
+                finishFetch(store, other, status);
+            }
+
+            LDi_mutex_lock(&store->fetchLock);
+        }
+    }
+
+    LDi_mutex_unlock(&store->fetchLock);
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+/* **** Write Behind **** */
+
+static void
+freeCollections(
+    struct LDStoreCollectionState *const collections, const unsigned int count)
+{
+    unsigned int x;
+
+    if (collections) {
+        for (x = 0; x < count; x++) {
+            struct LDStoreCollectionState *collection;
+            unsigned int                   y;
+
+            collection = &(collections[x]);
+
+            for (y = 0; y < collection->itemCount; y++) {
+                struct LDStoreCollectionStateItem *item;
+
+                item = &(collection->items[y]);
+                /* this function owns the buffer the cast is safe */
+                LDFree((void *)item->item.buffer);
+            }
+
+            LDFree(collection->items);
+        }
+
+        LDFree(collections);
+    }
+}
+
+/* write a full data set to the backend, sets is not consumed */
+static LDBoolean
+initBackend(struct LDStore *const store, struct LDJSON *const sets)
+{
+    LDBoolean                      success;
+    struct LDJSON *                set, *setItem;
+    struct LDStoreCollectionState *collections, *collectionsIter;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->backend);
+    LD_ASSERT(store->backend->init);
+    LD_ASSERT(sets);
+
+    success         = LDBooleanFalse;
+    set             = NULL;
+    setItem         = NULL;
+    collections     = NULL;
+    collectionsIter = NULL;
+
+    if (!(collections = (struct LDStoreCollectionState *)LDAlloc(
+              sizeof(struct LDStoreCollectionState) *
+              LDCollectionGetSize(sets))))
+    {
+        LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
+
+        goto cleanup;
+    }
+
+    collectionsIter = collections;
+
+    for (set = LDGetIter(sets); set; set = LDIterNext(set)) {
+        struct LDStoreCollectionStateItem *itemIter;
+
+        LD_ASSERT(LDJSONGetType(set) == LDObject);
+
+        collectionsIter->kind      = LDIterKey(set);
+        collectionsIter->itemCount = LDCollectionGetSize(set);
+        collectionsIter->items     = NULL;
+
+        if (collectionsIter->itemCount > 0) {
+            unsigned int allocated;
+
+            allocated = sizeof(struct LDStoreCollectionStateItem) *
+                        LDCollectionGetSize(set);
+
+            if (!(collectionsIter->items =
+                      (struct LDStoreCollectionStateItem *)LDAlloc(allocated)))
+            {
+                LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
+
+                goto cleanup;
+            }
+
+            memset(collectionsIter->items, 0, allocated);
+
+            itemIter = collectionsIter->items;
+
+            for (setItem = LDGetIter(set); setItem;
+                 setItem = LDIterNext(setItem)) {
+                if (!LDi_validateFeature(setItem)) {
+                    LD_LOG(
+                        LD_LOG_ERROR,
+                        "LDStoreInit failed to validate feature");
+
+                    goto next;
+                }
+
+                if (!encodeItem(store, setItem, &itemIter->item)) {
+                    goto cleanup;
+                }
+
+                itemIter->key = LDi_getFeatureKeyTrusted(setItem);
+
+            next:
+                itemIter++;
+            }
+        }
+
+        collectionsIter++;
+    }
+
+    success = store->backend->init(
+        store->backend->context, collections, LDCollectionGetSize(sets));
+
+cleanup:
+    freeCollections(collections, LDCollectionGetSize(sets));
+
+    return success;
+}
+
+/* write a queued init, the items were validated when memory was built */
+static LDBoolean
+initBackendQueued(
+    struct LDStore *const store, const struct PendingInit *const init)
+{
+    LDBoolean                      success;
+    struct LDStoreCollectionState *collections;
+    unsigned int                   kind, x;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->backend);
+    LD_ASSERT(store->backend->init);
+    LD_ASSERT(init);
+
+    success = LDBooleanFalse;
+
+    if (!(collections = (struct LDStoreCollectionState *)LDAlloc(
+              sizeof(struct LDStoreCollectionState) * LD_FEATURE_KIND_COUNT)))
+    {
+        LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
+
+        return LDBooleanFalse;
+    }
+
+    memset(
+        collections,
+        0,
+        sizeof(struct LDStoreCollectionState) * LD_FEATURE_KIND_COUNT);
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        const struct LDStoreSnapshot *const  section    = init->sections[kind];
+        struct LDStoreCollectionState *const collection = &(collections[kind]);
+
+        collection->kind = featureKindToString((enum FeatureKind)kind);
+
+        if (section->count == 0) {
+            continue;
+        }
+
+        if (!(collection->items = (struct LDStoreCollectionStateItem *)LDAlloc(
+                  sizeof(struct LDStoreCollectionStateItem) * section->count)))
+        {
+            LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
+
+            goto cleanup;
+        }
+
+        memset(
+            collection->items,
+            0,
+            sizeof(struct LDStoreCollectionStateItem) * section->count);
+
+        collection->itemCount = section->count;
+
+        for (x = 0; x < section->count; x++) {
+            struct LDJSON *const feature = LDJSONRCGet(section->items[x]);
+
+            if (!encodeItem(store, feature, &collection->items[x].item)) {
+                goto cleanup;
+            }
+
+            collection->items[x].key = LDi_getFeatureKeyTrusted(feature);
+        }
+    }
+
+    success = store->backend->init(
+        store->backend->context, collections, LD_FEATURE_KIND_COUNT);
+
+cleanup:
+    freeCollections(collections, LD_FEATURE_KIND_COUNT);
+
+    return success;
+}
+
+static void
+freePendingInit(struct PendingInit *const init)
+{
+    unsigned int kind;
+
+    if (init) {
+        for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+            LDStoreSnapshotFree(init->sections[kind]);
+        }
+
+        LDFree(init);
+    }
+}
+
+static void
+freePendingWrite(struct PendingWrite *const entry)
+{
+    if (entry) {
+        LDFree(entry->key);
+        LDFree(entry->item.buffer);
+        LDFree(entry);
+    }
+}
+
+/* expects writeLock */
+static LDBoolean
+hasPendingWrites(const struct LDStore *const store)
+{
+    unsigned int kind;
+
+    LD_ASSERT(store);
+
+    if (store->pendingInit) {
+        return LDBooleanTrue;
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        if (store->pendingWrites[kind]) {
+            return LDBooleanTrue;
+        }
+    }
+
+    return LDBooleanFalse;
+}
+
+/* expects writeLock. an init replaces the whole data set, so it supersedes
+every change queued before it */
+static void
+dropPendingWrites(struct LDStore *const store)
+{
+    struct PendingWrite *entry, *tmp;
+    unsigned int         kind;
+
+    LD_ASSERT(store);
+
+    entry = NULL;
+    tmp   = NULL;
+
+    freePendingInit(store->pendingInit);
+    store->pendingInit = NULL;
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, store->pendingWrites[kind], entry, tmp)
+        {
+            HASH_DEL(store->pendingWrites[kind], entry);
+            freePendingWrite(entry);
+        }
+    }
+}
+
+/* queue references to the items of a generation built by memoryInit, which
+swaps it in afterwards */
+static LDBoolean
+queueInit(struct LDStore *const store, struct CacheItem *const *const tables)
+{
+    struct PendingInit *init;
+    unsigned int        kind;
+
+    LD_ASSERT(store);
+    LD_ASSERT(tables);
+
+    if (!(init = (struct PendingInit *)LDAlloc(sizeof(struct PendingInit)))) {
+        return LDBooleanFalse;
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        init->sections[kind] = NULL;
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        if (!snapshotTable(
+                tables[kind], LDBooleanTrue, &init->sections[kind])) {
+            freePendingInit(init);
+
+            return LDBooleanFalse;
+        }
+    }
+
+    if (!LDi_getMonotonicMilliseconds(&init->queuedOn)) {
+        freePendingInit(init);
+
+        return LDBooleanFalse;
+    }
+
+    LDi_rwlock_wrlock(&store->cache->lock);
+    store->initUnwritten = LDBooleanTrue;
+    init->sequence       = ++store->initSequence;
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    LDi_mutex_lock(&store->writeLock);
+    dropPendingWrites(store);
+    store->pendingInit = init;
+    LDi_mutex_unlock(&store->writeLock);
+
+    LDi_cond_signal(&store->writeCondition);
+
+    return LDBooleanTrue;
+}
+
+/* expects write lock. pins the cached item unless it has a version newer than
+the change, in which case the change is not worth writing */
+static LDBoolean
+markUnwritten(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    const char *const      key,
+    const unsigned int     version)
+{
+    struct CacheItem *item;
+
+    LD_ASSERT(store);
+    LD_ASSERT(key);
+
+    item = NULL;
+
+    HASH_FIND_STR(store->cache->items[kind], key, item);
+
+    if (!item) {
+        return LDBooleanTrue;
+    }
+
+    if (LDi_getFeatureVersionTrusted(LDJSONRCGet(item->feature)) > version) {
+        return LDBooleanFalse;
+    }
+
+    item->unwritten = LDBooleanTrue;
+
+    return LDBooleanTrue;
+}
+
+/* the last change to a key wins, but keeps the queue time of the first */
+static void
+queueWrite(
+    struct LDStore *const      store,
+    const enum FeatureKind     kind,
+    struct PendingWrite *const entry)
+{
+    struct PendingWrite *queued;
+
+    LD_ASSERT(store);
+    LD_ASSERT(entry);
+
+    queued = NULL;
+
+    LDi_mutex_lock(&store->writeLock);
+
+    HASH_FIND_STR(store->pendingWrites[kind], entry->key, queued);
+
+    if (queued) {
+        LDFree(queued->item.buffer);
+
+        queued->item       = entry->item;
+        entry->item.buffer = NULL;
+
+        freePendingWrite(entry);
+    } else {
+        HASH_ADD_KEYPTR(
+            hh,
+            store->pendingWrites[kind],
+            entry->key,
+            strlen(entry->key),
+            entry);
+    }
+
+    LDi_mutex_unlock(&store->writeLock);
+
+    LDi_cond_signal(&store->writeCondition);
+}
+
+/* apply a change to memory at once and queue it for the backend. the item
+buffer is NULL for a deletion, the feature and buffer are consumed */
+static LDBoolean
+upsertWriteBehind(
+    struct LDStore *const                     store,
+    const enum FeatureKind                    kind,
+    struct LDJSON *const                      feature,
+    const struct LDStoreCollectionItem *const item)
+{
+    struct PendingWrite *entry;
+    struct LDJSONRC *    changed;
+    LDBoolean            status, queue;
+
+    LD_ASSERT(store);
+    LD_ASSERT(feature);
+    LD_ASSERT(item);
+
+    /* allocated up front so an accepted change is never left unqueued */
+    if (!(entry = (struct PendingWrite *)LDAlloc(sizeof(struct PendingWrite))))
+    {
+        goto error;
+    }
+
+    memset(entry, 0, sizeof(struct PendingWrite));
+
+    if (!(entry->key = LDStrDup(LDi_getFeatureKeyTrusted(feature)))) {
+        goto error;
+    }
+
+    if (!LDi_getMonotonicMilliseconds(&entry->queuedOn)) {
+        goto error;
+    }
+
+    entry->item = *item;
+
+    LDi_rwlock_wrlock(&store->cache->lock);
+    status = upsertMemory(store, kind, feature, &changed, NULL);
+    recordChange(store, kind, changed, LDBooleanTrue);
+    queue = status && markUnwritten(store, kind, entry->key, item->version);
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    if (queue) {
+        queueWrite(store, kind, entry);
+    } else {
+        freePendingWrite(entry);
+    }
+
+    return status;
+
+error:
+    if (entry) {
+        LDFree(entry->key);
+        LDFree(entry);
+    }
+
+    LDFree(item->buffer);
+    LDJSONFree(feature);
+
+    return LDBooleanFalse;
+}
+
+/* expects write lock. unpins an item unless it changed again since */
+static void
+markWritten(
+    struct LDStore *const            store,
+    const enum FeatureKind           kind,
+    const struct PendingWrite *const entry)
+{
+    struct CacheItem *item;
+
+    LD_ASSERT(store);
+    LD_ASSERT(entry);
+
+    item = NULL;
+
+    HASH_FIND_STR(store->cache->items[kind], entry->key, item);
+
+    if (item && LDi_getFeatureVersionTrusted(LDJSONRCGet(item->feature)) ==
+                    entry->item.version)
+    {
+        item->unwritten = LDBooleanFalse;
+    }
+}
+
+/* write everything queued. failed changes are queued again while the writer
+is running, unless a newer change replaced them. returns false on failure */
+static LDBoolean
+writeBatch(struct LDStore *const store)
+{
+    struct PendingWrite *batch[LD_FEATURE_KIND_COUNT];
+    struct PendingWrite *retry[LD_FEATURE_KIND_COUNT];
+    struct PendingWrite *entry, *tmp, *queued;
+    struct PendingInit * init;
+    unsigned int         kind, written, failed, dropped;
+    LDBoolean            initWritten, superseded;
+
+    LD_ASSERT(store);
+
+    entry       = NULL;
+    tmp         = NULL;
+    written     = 0;
+    failed      = 0;
+    dropped     = 0;
+    initWritten = LDBooleanTrue;
+
+    LDi_mutex_lock(&store->writeLock);
+
+    init                  = store->pendingInit;
+    store->pendingInit    = NULL;
+    store->writesInFlight = 0;
+    store->inFlightSince  = 0;
+
+    if (init) {
+        store->writesInFlight = 1;
+        store->inFlightSince  = init->queuedOn;
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        batch[kind]                = store->pendingWrites[kind];
+        retry[kind]                = NULL;
+        store->pendingWrites[kind] = NULL;
+
+        HASH_ITER(hh, batch[kind], entry, tmp)
+        {
+            if (store->writesInFlight++ == 0 ||
+                entry->queuedOn < store->inFlightSince)
+            {
+                store->inFlightSince = entry->queuedOn;
+            }
+        }
+    }
+
+    LDi_mutex_unlock(&store->writeLock);
+
+    if (init) {
+        if (initBackendQueued(store, init)) {
+            written++;
+        } else {
+            initWritten = LDBooleanFalse;
+            failed++;
+        }
+    }
+
+    /* the backend has no batch upsert. changes are only written on top of a
+    successful init, so a retried init does not overwrite them */
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, batch[kind], entry, tmp)
+        {
+            if (initWritten) {
+                if (store->backend->upsert(
+                        store->backend->context,
+                        featureKindToString((enum FeatureKind)kind),
+                        &entry->item,
+                        entry->key))
+                {
+                    written++;
+
+                    continue;
+                }
+
+                failed++;
+            }
+
+            HASH_DEL(batch[kind], entry);
+            HASH_ADD_KEYPTR(
+                hh, retry[kind], entry->key, strlen(entry->key), entry);
+        }
+    }
+
+    LDi_rwlock_wrlock(&store->cache->lock);
+
+    if (initWritten && init && store->initSequence == init->sequence) {
+        store->initUnwritten = LDBooleanFalse;
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, batch[kind], entry, tmp)
+        {
+            markWritten(store, (enum FeatureKind)kind, entry);
+        }
+    }
+
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    LDi_mutex_lock(&store->writeLock);
+
+    store->writesCompleted += written;
+    store->writesFailed += failed;
+    store->writesInFlight = 0;
+    store->inFlightSince  = 0;
+
+    /* a newer init dropped everything queued before it */
+    superseded = store->pendingInit != NULL;
+
+    if (init && !initWritten) {
+        if (store->writeRunning && !superseded) {
+            store->pendingInit = init;
+            init               = NULL;
+        } else {
+            dropped++;
+        }
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, retry[kind], entry, tmp)
+        {
+            HASH_DEL(retry[kind], entry);
+
+            queued = NULL;
+
+            HASH_FIND_STR(store->pendingWrites[kind], entry->key, queued);
+
+            if (queued || superseded) {
+                freePendingWrite(entry);
+            } else if (store->writeRunning) {
+                HASH_ADD_KEYPTR(
+                    hh,
+                    store->pendingWrites[kind],
+                    entry->key,
+                    strlen(entry->key),
+                    entry);
+            } else {
+                dropped++;
+
+                freePendingWrite(entry);
+            }
+        }
+    }
+
+    LDi_mutex_unlock(&store->writeLock);
+
+    if (dropped > 0) {
+        LD_LOG_1(
+            LD_LOG_ERROR,
+            "store shutting down, dropped %u unwritten changes",
+            dropped);
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, batch[kind], entry, tmp)
+        {
+            HASH_DEL(batch[kind], entry);
+            freePendingWrite(entry);
+        }
+    }
+
+    freePendingInit(init);
+
+    return failed == 0;
+}
+
+static THREAD_RETURN
+writeBehindThread(void *const rawStore)
+{
+    struct LDStore *store;
+
+    LD_ASSERT(rawStore);
+
+    store = (struct LDStore *)rawStore;
+
+    LDi_mutex_lock(&store->writeLock);
+
+    /* drains the queue once more after shutdown is requested */
+    while (LDBooleanTrue) {
+        LDBoolean success;
+
+        if (!hasPendingWrites(store)) {
+            if (!store->writeRunning) {
+                break;
+            }
+
+            LDi_cond_wait(&store->writeCondition, &store->writeLock, 1000);
+
+            continue;
+        }
+
+        LDi_mutex_unlock(&store->writeLock);
+
+        success = writeBatch(store);
+
+        LDi_mutex_lock(&store->writeLock);
+
+        if (!success && store->writeRunning) {
+            LD_LOG(LD_LOG_ERROR, "store write behind failed, retrying");
+
+            LDi_cond_wait(
+                &store->writeCondition,
+                &store->writeLock,
+                WRITE_RETRY_MILLISECONDS);
+        }
+    }
+
+    LDi_mutex_unlock(&store->writeLock);
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+/* persist every live item. items are shared with the store by reference, so
+serialization happens without holding the cache lock */
+static LDBoolean
+writeSnapshot(struct LDStore *const store)
+{
+    struct LDStoreSnapshot *sections[LD_FEATURE_KIND_COUNT];
+    const char *            names[LD_FEATURE_KIND_COUNT];
+    unsigned int            kind;
+    LDBoolean               success;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->snapshotPath);
+
+    success = LDBooleanFalse;
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        sections[kind] = NULL;
+    }
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        names[kind] = featureKindToString((enum FeatureKind)kind);
+
+        if (!memorySnapshot(
+                store->cache, (enum FeatureKind)kind, &sections[kind])) {
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            goto cleanup;
+        }
+    }
+
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    success = LDi_writeSnapshot(
+        store->snapshotPath, names, sections, LD_FEATURE_KIND_COUNT);
+
+cleanup:
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        LDStoreSnapshotFree(sections[kind]);
+    }
+
+    return success;
+}
+
+/* writes the latest data once for any number of inits since the last write,
+and once more after shutdown is requested */
+static THREAD_RETURN
+snapshotThread(void *const rawStore)
+{
+    struct LDStore *store;
+
+    LD_ASSERT(rawStore);
+
+    store = (struct LDStore *)rawStore;
+
+    LDi_mutex_lock(&store->snapshotLock);
+
+    while (LDBooleanTrue) {
+        LDBoolean success;
+
+        if (!store->snapshotPending) {
+            if (!store->snapshotRunning) {
+                break;
+            }
+
+            LDi_cond_wait(
+                &store->snapshotCondition, &store->snapshotLock, 1000);
+
+            continue;
+        }
+
+        store->snapshotPending = LDBooleanFalse;
+
+        LDi_mutex_unlock(&store->snapshotLock);
+
+        success = writeSnapshot(store);
+
+        LDi_mutex_lock(&store->snapshotLock);
+
+        if (!success && store->snapshotRunning) {
+            LD_LOG(LD_LOG_ERROR, "store snapshot failed, retrying");
+
+            store->snapshotPending = LDBooleanTrue;
+
+            LDi_cond_wait(
+                &store->snapshotCondition,
+                &store->snapshotLock,
+                WRITE_RETRY_MILLISECONDS);
+        }
+    }
+
+    LDi_mutex_unlock(&store->snapshotLock);
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+static void
+requestSnapshot(struct LDStore *const store)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(store->snapshotPath);
+
+    LDi_mutex_lock(&store->snapshotLock);
+
+    if (store->snapshotRunning) {
+        store->snapshotPending = LDBooleanTrue;
+
+        LDi_mutex_unlock(&store->snapshotLock);
+
+        LDi_cond_signal(&store->snapshotCondition);
+
+        return;
+    }
+
+    LDi_mutex_unlock(&store->snapshotLock);
+
+    /* the thread could not be started */
+    if (!writeSnapshot(store)) {
+        LD_LOG(LD_LOG_ERROR, "store snapshot failed");
+    }
+}
+
+/* used for testing */
+void
+LDi_expireAll(struct LDStore *const store)
+{
+    struct CacheItem *item, *itemTmp;
+    unsigned int      i;
+
+    LD_ASSERT(store);
+
+    item    = NULL;
+    itemTmp = NULL;
+
+    LD_ASSERT(LDi_rwlock_wrlock(&store->cache->lock));
+
+    for (i = 0; i < LD_FEATURE_KIND_COUNT; i++) {
+        HASH_ITER(hh, store->cache->items[i], item, itemTmp)
+        {
+            item->updatedOn = 0;
+        }
+
+        if (store->cache->all[i]) {
+            store->cache->all[i]->updatedOn = 0;
+        }
+    }
+
+    if (store->cache->initChecked) {
+        store->cache->initChecked->updatedOn = 0;
+    }
+
+    LD_ASSERT(LDi_rwlock_wrunlock(&store->cache->lock));
+}
+
+static void
+memoryDestructor(struct MemoryContext *const context)
+{
+    unsigned int i;
+
+    LD_ASSERT(context);
+
+    memoryCacheFlush(context);
+
+    HASH_CLEAR(hh, context->handleIndex);
+
+    for (i = 0; i < context->handleCount; i++) {
+        LDFree(context->handles[i]->key);
+        LDFree(context->handles[i]);
+    }
+
+    LDFree(context->handles);
+
+    LDi_rwlock_destroy(&context->lock);
+
+    LDFree(context);
+}
+
+struct LDStore *
+LDStoreNew(const struct LDConfig *const config)
+{
+    struct LDStore *      store;
+    struct MemoryContext *cache;
+
+    LD_ASSERT(config);
+
+    store = NULL;
+    cache = NULL;
+
+    if (!(store = (struct LDStore *)LDAlloc(sizeof(struct LDStore)))) {
+        goto error;
+    }
+
+    if (!(cache =
+              (struct MemoryContext *)LDAlloc(sizeof(struct MemoryContext)))) {
+        goto error;
+    }
+
+    memset(cache, 0, sizeof(struct MemoryContext));
+
+    LDi_rwlock_init(&cache->lock);
+
+    cache->initialized = LDBooleanFalse;
+
+    memset(store, 0, sizeof(struct LDStore));
+
+    LDi_mutex_init(&store->fetchLock);
+    LDi_mutex_init(&store->usageLock);
+    LDi_cond_init(&store->fetchCondition);
+    LDi_cond_init(&store->refreshCondition);
+    LDi_mutex_init(&store->dispatchLock);
+    LDi_cond_init(&store->dispatchCondition);
+    LDi_mutex_init(&store->listenerLock);
+    LDi_cond_init(&store->changeCondition);
+    LDi_mutex_init(&store->writeLock);
+    LDi_cond_init(&store->writeCondition);
+    LDi_mutex_init(&store->snapshotLock);
+    LDi_cond_init(&store->snapshotCondition);
+
+    store->cache             = cache;
+    store->backend           = config->storeBackend;
+    store->cacheMilliseconds = config->storeCacheMilliseconds;
+
+    if (store->backend && config->storeSoleWriter) {
+        if (config->useLDD) {
+            LD_LOG(
+                LD_LOG_WARNING,
+                "ignoring sole writer, the store backend is updated by the "
+                "relay");
+        } else {
+            store->soleWriter = LDBooleanTrue;
+        }
+    }
+
+    if (store->backend) {
+        /* memory must hold every item once authoritative, and is never
+        refreshed from the backend */
+        if (!store->soleWriter) {
+            store->staleMilliseconds = config->storeStaleMilliseconds;
+
+            if (store->cacheMilliseconds > 0) {
+                store->refreshAheadReads = config->storeRefreshAheadReads;
+            }
+
+            store->cacheCapacity = config->storeCacheCapacity;
+            store->cacheMaxBytes = config->storeCacheMaxBytes;
+        }
+
+        if (config->storeCompactItems) {
+            if (store->backend->compactItems) {
+                store->compactItems = LDBooleanTrue;
+            } else {
+                LD_LOG(
+                    LD_LOG_WARNING,
+                    "store backend does not support compact items, using "
+                    "JSON");
+            }
+        }
+
+        if (config->storeSnapshotPath) {
+            LD_LOG(
+                LD_LOG_WARNING,
+                "ignoring snapshot path, the store backend is persistent");
+        }
+    } else if (config->storeSnapshotPath) {
+        if (!(store->snapshotPath = LDStrDup(config->storeSnapshotPath))) {
+            goto error;
+        }
+
+        store->snapshotRunning = LDBooleanTrue;
+
+        if (!LDi_thread_create(
+                &store->snapshotThread, snapshotThread, store)) {
+            LD_LOG(LD_LOG_ERROR, "failed to start store snapshot thread");
+
+            store->snapshotRunning = LDBooleanFalse;
+        }
+    }
+
+    if (store->backend && config->storeWriteBehind) {
+        store->writeRunning = LDBooleanTrue;
+
+        if (LDi_thread_create(&store->writeThread, writeBehindThread, store)) {
+            store->writeBehind = LDBooleanTrue;
+        } else {
+            LD_LOG(LD_LOG_ERROR, "failed to start store write behind thread");
+
+            store->writeRunning = LDBooleanFalse;
+        }
+    }
+
+    if (store->backend && config->useLDD && config->storeWarmUp) {
+        if (store->cacheMilliseconds > 0) {
+            /* within the same window as refresh ahead, so that collections
+            are replaced before they expire */
+            store->reloadMilliseconds =
+                store->cacheMilliseconds -
+                store->cacheMilliseconds / REFRESH_AHEAD_WINDOW_DIVISOR;
+        } else {
+            LD_LOG(
+                LD_LOG_WARNING,
+                "store warm up has no effect without a cache TTL");
+        }
+    }
+
+    if (store->staleMilliseconds > 0 || store->refreshAheadReads > 0 ||
+        store->reloadMilliseconds > 0)
+    {
+        store->refreshRunning = LDBooleanTrue;
+
+        if (!LDi_thread_create(&store->refreshThread, refreshThread, store)) {
+            LD_LOG(LD_LOG_ERROR, "failed to start store refresh thread");
+
+            store->staleMilliseconds  = 0;
+            store->refreshAheadReads  = 0;
+            store->reloadMilliseconds = 0;
+            store->refreshRunning     = LDBooleanFalse;
+        }
+    }
+
+    return store;
+
+error:
+    LDFree(store);
+    LDFree(cache);
+
+    return NULL;
+}
+
+/* **** Store API Operations **** */
+
+LDBoolean
+LDStoreInit(struct LDStore *const store, struct LDJSON *const sets)
+{
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(sets);
+    LD_ASSERT(LDJSONGetType(sets) == LDObject);
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreInit");
+
+    /* with write behind memoryInit queues the items it builds */
+    if (!store->writeBehind && store->backend && !initBackend(store, sets)) {
+        LDJSONFree(sets);
+
+        return LDBooleanFalse;
+    }
+
+    if (!memoryInit(store, sets, store->writeBehind)) {
+        return LDBooleanFalse;
+    }
+
+    if (store->snapshotPath) {
+        requestSnapshot(store);
+    }
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDStoreWarmUp(struct LDStore *const store)
+{
+    unsigned int kind;
+
+    LD_ASSERT(store);
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreWarmUp");
+
+    if (store->reloadMilliseconds == 0) {
+        return LDBooleanTrue;
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        if (!coalescedGetAllBackend(store, (enum FeatureKind)kind, NULL)) {
+            return LDBooleanFalse;
+        }
+    }
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDStoreLoadSnapshot(struct LDStore *const store)
+{
+    struct LDJSON *sets;
+
+    LD_ASSERT(store);
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreLoadSnapshot");
+
+    if (!store->snapshotPath) {
+        return LDBooleanFalse;
+    }
+
+    if (!LDi_readSnapshot(store->snapshotPath, &sets)) {
+        return LDBooleanFalse;
+    }
+
+    /* not through LDStoreInit, which would write the same data back */
+    if (!memoryInit(store, sets, LDBooleanFalse)) {
+        LD_LOG(LD_LOG_ERROR, "failed to initialize store from snapshot");
+
+        return LDBooleanFalse;
+    }
+
+    LD_LOG_1(LD_LOG_INFO, "loaded snapshot: %s", store->snapshotPath);
+
+    return LDBooleanTrue;
+}
+
+/* expects read lock, which is released. item is the cached entry for key, or
+NULL when it is not cached */
+static LDBoolean
+getLocked(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct CacheItem *const item,
+    struct LDJSONRC **const result)
+{
+    if (item) {
+        int expired;
+
+        expired = isExpired(store, item);
+
+        if (expired < 0) {
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            return LDBooleanFalse;
+        } else if (expired == 0) {
+            if (LDi_isFeatureDeleted(LDJSONRCGet(item->feature))) {
+                LDi_rwlock_rdunlock(&store->cache->lock);
+
+                return LDBooleanTrue;
+            } else {
+                LDJSONRCIncrement(item->feature);
+
+                *result = item->feature;
+
+                recordRead(store, item);
+
+                LDi_rwlock_rdunlock(&store->cache->lock);
+
+                return LDBooleanTrue;
+            }
+        } else if (expired > 0) {
+            int servable;
+
+            if ((servable = isServableStale(store, item)) < 0) {
+                LDi_rwlock_rdunlock(&store->cache->lock);
+
+                return LDBooleanFalse;
+            } else if (servable > 0) {
+                if (!LDi_isFeatureDeleted(LDJSONRCGet(item->feature))) {
+                    LDJSONRCIncrement(item->feature);
+
+                    *result = item->feature;
+
+                    recordRead(store, item);
+                }
+
+                LDi_rwlock_rdunlock(&store->cache->lock);
+
+                scheduleRefresh(store, kind, key);
+
+                return LDBooleanTrue;
+            }
+
+            LDi_rwlock_rdunlock(&store->cache->lock);
+            /* When there is no backend a flag will never be expired */
+            return coalescedGetBackend(store, kind, key, result);
+        }
+    } else {
+        /* a miss is final when memory holds every item */
+        const LDBoolean fetch = store->backend && !store->authoritative;
+
+        LDi_rwlock_rdunlock(&store->cache->lock);
+
+        if (fetch) {
+            return coalescedGetBackend(store, kind, key, result);
+        } else {
+            return LDBooleanTrue;
+        }
+    }
+
+    return LDBooleanFalse;
+}
+
+LDBoolean
+LDStoreGet(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    const char *const       key,
+    struct LDJSONRC **const result)
+{
+    struct CacheItem *item;
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreGet");
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    item    = NULL;
+    *result = NULL;
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    HASH_FIND_STR(store->cache->items[kind], key, item);
+
+    return getLocked(store, kind, key, item, result);
+}
+
+LDBoolean
+LDStoreFlagHandle(
+    struct LDStore *const store,
+    const char *const     key,
+    LDFlagHandle *const   handle)
+{
+    struct FlagHandle *slot;
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(key);
+    LD_ASSERT(handle);
+
+    slot = NULL;
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+    HASH_FIND_STR(store->cache->handleIndex, key, slot);
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    if (slot) {
+        *handle = slot->handle;
+
+        return LDBooleanTrue;
+    }
+
+    LDi_rwlock_wrlock(&store->cache->lock);
+
+    /* another thread may have interned the key while unlocked */
+    HASH_FIND_STR(store->cache->handleIndex, key, slot);
+
+    if (!slot) {
+        if (store->cache->handleCount == store->cache->handleCapacity) {
+            const unsigned int capacity =
+                store->cache->handleCapacity ? store->cache->handleCapacity * 2
+                                             : 16;
+            struct FlagHandle **handles;
+
+            if (!(handles = (struct FlagHandle **)LDRealloc(
+                      store->cache->handles,
+                      sizeof(struct FlagHandle *) * capacity)))
+            {
+                LDi_rwlock_wrunlock(&store->cache->lock);
+
+                return LDBooleanFalse;
+            }
+
+            store->cache->handles        = handles;
+            store->cache->handleCapacity = capacity;
+        }
+
+        if (!(slot = (struct FlagHandle *)LDAlloc(sizeof(struct FlagHandle))))
+        {
+            LDi_rwlock_wrunlock(&store->cache->lock);
+
+            return LDBooleanFalse;
+        }
+
+        memset(slot, 0, sizeof(struct FlagHandle));
+
+        if (!(slot->key = LDStrDup(key))) {
+            LDFree(slot);
+
+            LDi_rwlock_wrunlock(&store->cache->lock);
+
+            return LDBooleanFalse;
+        }
+
+        store->cache->handles[store->cache->handleCount++] = slot;
+        slot->handle = store->cache->handleCount;
+
+        HASH_FIND_STR(store->cache->items[LD_FLAG], slot->key, slot->item);
+
+        HASH_ADD_KEYPTR(
+            hh,
+            store->cache->handleIndex,
+            slot->key,
+            strlen(slot->key),
+            slot);
+    }
+
+    *handle = slot->handle;
+
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDStoreGetByHandle(
+    struct LDStore *const   store,
+    const LDFlagHandle      handle,
+    const char **const      key,
+    struct LDJSONRC **const result)
+{
+    struct FlagHandle *slot;
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreGetByHandle");
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    *key    = NULL;
+    *result = NULL;
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    if (handle == 0 || handle > store->cache->handleCount) {
+        LDi_rwlock_rdunlock(&store->cache->lock);
+
+        return LDBooleanFalse;
+    }
+
+    slot = store->cache->handles[handle - 1];
+    /* the slot outlives the lock, it is only freed with the store */
+    *key = slot->key;
+
+    return getLocked(store, LD_FLAG, slot->key, slot->item, result);
+}
+
+LDBoolean
+LDStoreAll(
+    struct LDStore *const   store,
+    const enum FeatureKind  kind,
+    struct LDJSONRC **const result)
+{
+    struct LDStoreSnapshot *snapshot;
+    struct LDJSON *         all, *dupe;
+    unsigned int            i;
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreAll");
+
+    LD_ASSERT(store);
+    LD_ASSERT(result);
+
+    snapshot = NULL;
+    all      = NULL;
+    *result  = NULL;
+
+    if (!LDStoreSnapshotNew(store, kind, &snapshot)) {
+        return LDBooleanFalse;
+    }
+
+    if (!(all = LDNewObject())) {
+        goto error;
+    }
+
+    for (i = 0; i < snapshot->count; i++) {
+        const struct LDJSON *const feature = LDJSONRCGet(snapshot->items[i]);
+
+        if (!(dupe = LDJSONDuplicate(feature))) {
+            goto error;
+        }
+
+        if (!LDObjectSetKey(all, LDi_getFeatureKeyTrusted(feature), dupe)) {
+            LDJSONFree(dupe);
+
+            goto error;
+        }
+    }
+
+    if (!(*result = LDJSONRCNew(all))) {
+        goto error;
+    }
+
+    LDStoreSnapshotFree(snapshot);
+
+    return LDBooleanTrue;
+
+error:
+    LDJSONFree(all);
+    LDStoreSnapshotFree(snapshot);
+
+    return LDBooleanFalse;
+}
+
+/* expects read lock, which is released. the items of a kind in memory are
+completed with those evicted since it was loaded in full, which are read from
+the backend without being cached again */
+static LDBoolean
+snapshotWithEvicted(
+    struct LDStore *const          store,
+    const enum FeatureKind         kind,
+    struct LDStoreSnapshot **const result)
+{
+    struct LDStoreSnapshot *      snapshot;
+    struct LDStoreCollectionItem *collectionItems;
+    struct CacheItem *            entry, *tmp;
+    struct LDJSONRC **            items;
+    char **                       keys;
+    unsigned int                  count, copied, i;
+
+    LD_ASSERT(store);
+    LD_ASSERT(result);
+
+    snapshot        = NULL;
+    collectionItems = NULL;
+    entry           = NULL;
+    tmp             = NULL;
+    copied          = 0;
+    count           = HASH_COUNT(store->cache->evicted[kind]);
+
+    if (!(keys = (char **)LDAlloc(sizeof(char *) * count))) {
+        LDi_rwlock_rdunlock(&store->cache->lock);
+
+        return LDBooleanFalse;
+    }
+
+    HASH_ITER(hh, store->cache->evicted[kind], entry, tmp)
+    {
+        if (!(keys[copied] = LDStrDup(entry->key))) {
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            goto error;
+        }
+
+        copied++;
+    }
+
+    if (!memorySnapshot(store->cache, kind, &snapshot)) {
+        LDi_rwlock_rdunlock(&store->cache->lock);
+
+        goto error;
+    }
+
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    if (!getManyRaw(
+            store, kind, (const char *const *)keys, count, &collectionItems))
+    {
+        goto error;
+    }
+
+    if (!(items = (struct LDJSONRC **)LDRealloc(
+              snapshot->items,
+              sizeof(struct LDJSONRC *) * (snapshot->count + count))))
+    {
+        goto error;
+    }
+
+    snapshot->items = items;
+
+    for (i = 0; i < count; i++) {
+        struct LDJSON *  feature;
+        struct LDJSONRC *featureRef;
+
+        if (!collectionItems[i].buffer) {
+            continue;
+        }
+
+        if (!(feature = decodeItem(&collectionItems[i]))) {
+            goto error;
+        }
+
+        if (!LDi_validateFeature(feature)) {
+            LD_LOG(LD_LOG_ERROR, "LDStoreAll invalid feature from backend");
+
+            LDJSONFree(feature);
+
+            continue;
+        }
+
+        if (LDi_isFeatureDeleted(feature)) {
+            LDJSONFree(feature);
+
+            continue;
+        }
+
+        if (!(featureRef = LDJSONRCNew(feature))) {
+            LDJSONFree(feature);
+
+            goto error;
+        }
+
+        snapshot->items[snapshot->count++] = featureRef;
+    }
+
+    for (i = 0; i < count; i++) {
+        LDFree(collectionItems[i].buffer);
+        LDFree(keys[i]);
+    }
+
+    LDFree(collectionItems);
+    LDFree(keys);
+
+    *result = snapshot;
+
+    return LDBooleanTrue;
+
+error:
+    for (i = 0; i < count; i++) {
+        if (collectionItems) {
+            LDFree(collectionItems[i].buffer);
+        }
+
+        if (i < copied) {
+            LDFree(keys[i]);
+        }
+    }
+
+    LDFree(collectionItems);
+    LDFree(keys);
+
+    LDStoreSnapshotFree(snapshot);
+
+    return LDBooleanFalse;
+}
+
+LDBoolean
+LDStoreSnapshotNew(
+    struct LDStore *const          store,
+    const enum FeatureKind         kind,
+    struct LDStoreSnapshot **const result)
+{
+    LDBoolean status;
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreSnapshotNew");
+
+    LD_ASSERT(store);
+    LD_ASSERT(store->cache);
+    LD_ASSERT(result);
+
+    *result = NULL;
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+
+    if (store->backend) {
+        int expired;
+
+        if (store->cache->all[kind]) {
+            expired = isExpired(store, store->cache->all[kind]);
+
+            if (expired > 0) {
+                int servable;
+
+                if ((servable = isServableStale(
+                         store, store->cache->all[kind])) < 0) {
+                    expired = -1;
+                } else if (servable > 0) {
+                    scheduleRefresh(store, kind, NULL);
+
+                    expired = 0;
+                }
+            }
+        } else {
+            expired = 1;
+        }
+
+        if (expired < 0) {
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            return LDBooleanFalse;
+        } else if (expired > 0) {
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            if (!coalescedGetAllBackend(store, kind, result)) {
+                return LDBooleanFalse;
+            }
+
+            if (*result) {
+                return LDBooleanTrue;
+            }
+
+            LDi_rwlock_rdlock(&store->cache->lock);
+
+            /* the marker was dropped after another thread's fetch, memory
+            is partial */
+            if (!store->cache->all[kind]) {
+                LDi_rwlock_rdunlock(&store->cache->lock);
+
+                return tryGetAllBackend(store, kind, result);
+            }
+        }
+
+        if (store->cache->evicted[kind]) {
+            return snapshotWithEvicted(store, kind, result);
+        }
+    }
+
+    status = memorySnapshot(store->cache, kind, result);
+
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    return status;
+}
+
+unsigned int
+LDStoreSnapshotCount(const struct LDStoreSnapshot *const snapshot)
+{
+    LD_ASSERT(snapshot);
+
+    return snapshot->count;
+}
+
+struct LDJSONRC *
+LDStoreSnapshotItem(
+    const struct LDStoreSnapshot *const snapshot, const unsigned int index)
+{
+    LD_ASSERT(snapshot);
+    LD_ASSERT(index < snapshot->count);
+
+    return snapshot->items[index];
+}
+
+void
+LDStoreSnapshotFree(struct LDStoreSnapshot *const snapshot)
+{
+    unsigned int i;
+
+    if (snapshot) {
+        for (i = 0; i < snapshot->count; i++) {
+            LDJSONRCDecrement(snapshot->items[i]);
+        }
+
+        LDFree(snapshot->items);
+        LDFree(snapshot);
+    }
+}
+
+LDBoolean
+LDStoreRemove(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    const char *const      key,
+    const unsigned int     version)
+{
+    LDBoolean        status;
+    struct LDJSON *  placeholder;
+    struct LDJSONRC *changed;
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreRemove");
+
+    LD_ASSERT(store);
+    LD_ASSERT(key);
+
+    status      = LDBooleanFalse;
+    placeholder = NULL;
+
+    if (store->writeBehind) {
+        struct LDStoreCollectionItem item;
+
+        item.buffer     = NULL;
+        item.bufferSize = 0;
+        item.version    = version;
+
+        if (!(placeholder = LDi_makeDeleted(key, version))) {
+            return LDBooleanFalse;
+        }
+
+        return upsertWriteBehind(store, kind, placeholder, &item);
+    }
+
+    if (store->backend) {
+        struct LDStoreCollectionItem item;
+
+        LD_ASSERT(store->backend->upsert);
+
+        item.buffer     = NULL;
+        item.bufferSize = 0;
+        item.version    = version;
+
+        if (!store->backend->upsert(
+                store->backend->context, featureKindToString(kind), &item, key))
+        {
+            return LDBooleanFalse;
+        }
+    }
+
+    if (!(placeholder = LDi_makeDeleted(key, version))) {
+        return LDBooleanFalse;
+    }
+
+    LDi_rwlock_wrlock(&store->cache->lock);
+    status = upsertMemory(store, kind, placeholder, &changed, NULL);
+    recordChange(store, kind, changed, LDBooleanTrue);
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    return status;
+}
+
+LDBoolean
+LDStoreUpsert(
+    struct LDStore *const  store,
+    const enum FeatureKind kind,
+    struct LDJSON *const   feature)
+{
+    LDBoolean        status;
+    struct LDJSONRC *changed;
+
+    LD_ASSERT(store);
+    LD_ASSERT(feature);
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreUpsert");
+
+    if (!LDi_validateFeature(feature)) {
+        LD_LOG(LD_LOG_ERROR, "LDStoreUpsert failed to validate feature");
+
+        LDJSONFree(feature);
+
+        return LDBooleanFalse;
+    }
+
+    if (store->writeBehind) {
+        struct LDStoreCollectionItem collectionItem;
+
+        if (!encodeItem(store, feature, &collectionItem)) {
+            LDJSONFree(feature);
+
+            return LDBooleanFalse;
+        }
+
+        return upsertWriteBehind(store, kind, feature, &collectionItem);
+    }
+
+    if (store->backend) {
+        LDBoolean                    success;
+        struct LDStoreCollectionItem collectionItem;
+
+        success = LDBooleanFalse;
+
+        LD_ASSERT(store->backend->upsert);
+
+        if (!encodeItem(store, feature, &collectionItem)) {
+            LDJSONFree(feature);
+
+            return LDBooleanFalse;
+        }
+
+        success = store->backend->upsert(
+            store->backend->context,
+            featureKindToString(kind),
+            &collectionItem,
+            LDi_getFeatureKeyTrusted(feature));
+
+        LDFree(collectionItem.buffer);
+
+        if (!success) {
+            LDJSONFree(feature);
+
+            return LDBooleanFalse;
+        }
+    }
+
+    LDi_rwlock_wrlock(&store->cache->lock);
+    status = upsertMemory(store, kind, feature, &changed, NULL);
+    recordChange(store, kind, changed, LDBooleanTrue);
+    LDi_rwlock_wrunlock(&store->cache->lock);
+
+    return status;
+}
+
+LDBoolean
+LDStoreInitialized(struct LDStore *const store)
+{
+    LDBoolean         isInitialized;
+    struct CacheItem *item;
+
+    LD_ASSERT(store);
+
+    LD_LOG(LD_LOG_TRACE, "LDStoreInitialized");
+
+    LDi_rwlock_rdlock(&store->cache->lock);
+    isInitialized = store->cache->initialized;
+
+    if (isInitialized || !store->backend) {
+        LDi_rwlock_rdunlock(&store->cache->lock);
+
+        return isInitialized;
+    }
+
+    if ((item = store->cache->initChecked)) {
+        int expired = isExpired(store, item);
+
+        if (expired < 0) {
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            return LDBooleanFalse;
+        } else if (expired == 0) {
+            LDi_rwlock_rdunlock(&store->cache->lock);
+
+            return LDBooleanFalse;
+        }
+    }
 
-    return LDBooleanTrue;
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    isInitialized = store->backend->initialized(store->backend->context);
+
+    if (isInitialized) {
+        LDi_rwlock_wrlock(&store->cache->lock);
+        store->cache->initialized = LDBooleanTrue;
+        LDi_rwlock_wrunlock(&store->cache->lock);
+    } else {
+        if (!(item = makeCacheItem(INIT_CHECKED_KEY, NULL))) {
+            return LDBooleanFalse;
+        }
+
+        LDi_rwlock_wrlock(&store->cache->lock);
+        deleteCacheItem(store->cache->initChecked);
+        store->cache->initChecked = item;
+        LDi_rwlock_wrunlock(&store->cache->lock);
+    }
+
+    return isInitialized;
 }
 
-/* used for testing */
-void
-LDi_expireAll(struct LDStore *const store)
+/* expects every store thread to have exited */
+static void
+freeStore(struct LDStore *const store)
 {
-    struct CacheItem *item, *itemTmp;
+    struct ChangeBatch * batch, *batchTmp;
+    struct FlagListener *listener, *listenerTmp;
 
     LD_ASSERT(store);
 
-    item    = NULL;
-    itemTmp = NULL;
-
-    LD_ASSERT(LDi_rwlock_wrlock(&store->cache->lock));
+    /* changes that were never delivered */
+    LL_FOREACH_SAFE(store->changeQueue, batch, batchTmp)
+    {
+        LL_DELETE(store->changeQueue, batch);
+        LDJSONFree(batch->keys);
+        LDFree(batch);
+    }
 
-    HASH_ITER(hh, store->cache->items, item, itemTmp)
+    LL_FOREACH_SAFE(store->listeners, listener, listenerTmp)
     {
-        item->updatedOn = 0;
+        LL_DELETE(store->listeners, listener);
+        LDFree(listener);
     }
 
-    LD_ASSERT(LDi_rwlock_wrunlock(&store->cache->lock));
+    LDDependencyIndexFree(store->dependencies);
+
+    memoryDestructor(store->cache);
+
+    LDi_mutex_destroy(&store->fetchLock);
+    LDi_mutex_destroy(&store->usageLock);
+    LDi_cond_destroy(&store->fetchCondition);
+    LDi_cond_destroy(&store->refreshCondition);
+    LDi_mutex_destroy(&store->dispatchLock);
+    LDi_cond_destroy(&store->dispatchCondition);
+    LDi_mutex_destroy(&store->listenerLock);
+    LDi_cond_destroy(&store->changeCondition);
+    LDi_mutex_destroy(&store->writeLock);
+    LDi_cond_destroy(&store->writeCondition);
+    LDi_mutex_destroy(&store->snapshotLock);
+    LDi_cond_destroy(&store->snapshotCondition);
+
+    if (store->backend) {
+        if (store->backend->destructor) {
+            store->backend->destructor(store->backend->context);
+        }
+
+        LDFree(store->backend);
+    }
+
+    LDFree(store->snapshotPath);
+    LDFree(store);
 }
 
-static void
-memoryDestructor(struct MemoryContext *const context)
+void
+LDStoreDestroy(struct LDStore *const store)
 {
-    LD_ASSERT(context);
+    LD_LOG(LD_LOG_TRACE, "LDStoreDestroy");
 
-    memoryCacheFlush(context);
+    if (store) {
+        /* flushes what it can before the backend is destroyed */
+        LDi_mutex_lock(&store->writeLock);
 
-    LDi_rwlock_destroy(&context->lock);
+        if (store->writeRunning) {
+            store->writeRunning = LDBooleanFalse;
 
-    LDFree(context);
+            LDi_mutex_unlock(&store->writeLock);
+            LDi_cond_signal(&store->writeCondition);
+            LDi_thread_join(&store->writeThread);
+            LDi_mutex_lock(&store->writeLock);
+        }
+
+        dropPendingWrites(store);
+
+        LDi_mutex_unlock(&store->writeLock);
+
+        /* writes a pending snapshot before the data is freed */
+        LDi_mutex_lock(&store->snapshotLock);
+
+        if (store->snapshotRunning) {
+            store->snapshotRunning = LDBooleanFalse;
+
+            LDi_mutex_unlock(&store->snapshotLock);
+            LDi_cond_signal(&store->snapshotCondition);
+            LDi_thread_join(&store->snapshotThread);
+            LDi_mutex_lock(&store->snapshotLock);
+        }
+
+        LDi_mutex_unlock(&store->snapshotLock);
+
+        LDi_mutex_lock(&store->fetchLock);
+
+        if (store->refreshRunning) {
+            struct InFlightFetch *flight, *tmp;
+
+            store->refreshRunning = LDBooleanFalse;
+
+            LDi_mutex_unlock(&store->fetchLock);
+            LDi_cond_signal(&store->refreshCondition);
+            LDi_thread_join(&store->refreshThread);
+            LDi_mutex_lock(&store->fetchLock);
+
+            /* refreshes that never ran */
+            LL_FOREACH_SAFE(store->refreshQueue, flight, tmp)
+            {
+                LL_DELETE(store->refreshQueue, flight);
+                detachFetch(store, flight);
+                freeFetch(flight);
+            }
+        }
+
+        LDi_mutex_unlock(&store->fetchLock);
+
+        LDi_mutex_lock(&store->listenerLock);
+
+        if (store->dispatchRunning) {
+            store->dispatchRunning = LDBooleanFalse;
+
+            /* a listener can not wait for its own thread to exit */
+            if (LDi_thread_is_current(&store->dispatchThread)) {
+                store->dispatchDestroys = LDBooleanTrue;
+
+                LDi_mutex_unlock(&store->listenerLock);
+
+                return;
+            }
+
+            LDi_mutex_unlock(&store->listenerLock);
+            LDi_cond_signal(&store->changeCondition);
+            LDi_thread_join(&store->dispatchThread);
+            LDi_mutex_lock(&store->listenerLock);
+        }
+
+        LDi_mutex_unlock(&store->listenerLock);
+
+        freeStore(store);
+    }
 }
 
-struct LDStore *
-LDStoreNew(const struct LDConfig *const config)
+LDBoolean
+LDStoreInitEmpty(struct LDStore *const store)
 {
-    struct LDStore *      store;
-    struct MemoryContext *cache;
+    struct LDJSON *values;
+    LDBoolean      success;
 
-    LD_ASSERT(config);
+    LD_ASSERT(store);
 
-    store = NULL;
-    cache = NULL;
+    success = LDBooleanFalse;
 
-    if (!(store = (struct LDStore *)LDAlloc(sizeof(struct LDStore)))) {
+    if (!(values = LDNewObject())) {
+        goto cleanup;
+    }
+
+    success = LDStoreInit(store, values);
+    /* values consumed even on failure */
+    values = NULL;
+
+cleanup:
+    LDJSONFree(values);
+
+    return success;
+}
+
+static struct LDJSON *
+makeKindStats(const unsigned int items, const size_t bytes)
+{
+    struct LDJSON *stats, *tmp;
+
+    if (!(stats = LDNewObject())) {
+        return NULL;
+    }
+
+    if (!(tmp = LDNewNumber(items))) {
         goto error;
     }
 
-    if (!(cache =
-              (struct MemoryContext *)LDAlloc(sizeof(struct MemoryContext)))) {
+    if (!LDObjectSetKey(stats, "items", tmp)) {
+        LDJSONFree(tmp);
+
         goto error;
     }
 
-    LDi_rwlock_init(&cache->lock);
+    if (!(tmp = LDNewNumber(bytes))) {
+        goto error;
+    }
 
-    cache->initialized = LDBooleanFalse;
-    cache->items       = NULL;
+    if (!LDObjectSetKey(stats, "bytes", tmp)) {
+        LDJSONFree(tmp);
 
-    store->cache             = cache;
-    store->backend           = config->storeBackend;
-    store->cacheMilliseconds = config->storeCacheMilliseconds;
+        goto error;
+    }
 
-    return store;
+    return stats;
 
 error:
-    LDFree(store);
-    LDFree(cache);
+    LDJSONFree(stats);
 
     return NULL;
 }
 
-/* **** Store API Operations **** */
+static struct LDJSON *
+makeLargestStats(
+    struct CacheItem *const *const largest, const unsigned int largestCount)
+{
+    struct LDJSON *array, *entry, *tmp;
+    unsigned int   i;
+
+    entry = NULL;
+
+    if (!(array = LDNewArray())) {
+        return NULL;
+    }
+
+    for (i = 0; i < largestCount; i++) {
+        if (!(entry = LDNewObject())) {
+            goto error;
+        }
+
+        if (!(tmp = LDNewText(largest[i]->key))) {
+            goto error;
+        }
+
+        if (!LDObjectSetKey(entry, "key", tmp)) {
+            LDJSONFree(tmp);
+
+            goto error;
+        }
+
+        if (!(tmp = LDNewNumber(largest[i]->bytes))) {
+            goto error;
+        }
+
+        if (!LDObjectSetKey(entry, "bytes", tmp)) {
+            LDJSONFree(tmp);
+
+            goto error;
+        }
+
+        if (!LDArrayPush(array, entry)) {
+            goto error;
+        }
+
+        entry = NULL;
+    }
+
+    return array;
+
+error:
+    LDJSONFree(entry);
+    LDJSONFree(array);
+
+    return NULL;
+}
 
 LDBoolean
-LDStoreInit(struct LDStore *const store, struct LDJSON *const sets)
+LDStoreMemoryStats(
+    struct LDStore *const store,
+    const unsigned int    topCount,
+    struct LDJSON **const result)
 {
+    struct LDJSON *    stats, *tmp;
+    struct CacheItem **largest, *item, *itemTmp;
+    unsigned int       largestCount, kind;
+
     LD_ASSERT(store);
-    LD_ASSERT(store->cache);
-    LD_ASSERT(sets);
-    LD_ASSERT(LDJSONGetType(sets) == LDObject);
+    LD_ASSERT(result);
 
-    LD_LOG(LD_LOG_TRACE, "LDStoreInit");
+    stats        = NULL;
+    largest      = NULL;
+    largestCount = 0;
+    item         = NULL;
+    itemTmp      = NULL;
+    *result      = NULL;
 
-    if (store->backend) {
-        LDBoolean                      success;
-        struct LDJSON *                set, *setItem;
-        struct LDStoreCollectionState *collections, *collectionsIter;
-        unsigned int                   x;
-
-        LD_ASSERT(store->backend->init);
-
-        success         = LDBooleanFalse;
-        set             = NULL;
-        setItem         = NULL;
-        collections     = NULL;
-        collectionsIter = NULL;
-
-        if (!(collections = (struct LDStoreCollectionState *)LDAlloc(
-                  sizeof(struct LDStoreCollectionState) *
-                  LDCollectionGetSize(sets))))
+    if (topCount > 0) {
+        if (!(largest = (struct CacheItem **)LDAlloc(
+                  sizeof(struct CacheItem *) * topCount)))
         {
-            LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
-
-            goto cleanup;
+            return LDBooleanFalse;
         }
+    }
 
-        collectionsIter = collections;
+    if (!(stats = LDNewObject())) {
+        LDFree(largest);
 
-        for (set = LDGetIter(sets); set; set = LDIterNext(set)) {
-            struct LDStoreCollectionStateItem *itemIter;
+        return LDBooleanFalse;
+    }
 
-            LD_ASSERT(LDJSONGetType(set) == LDObject);
+    LDi_rwlock_rdlock(&store->cache->lock);
 
-            collectionsIter->kind      = LDIterKey(set);
-            collectionsIter->itemCount = LDCollectionGetSize(set);
-            collectionsIter->items     = NULL;
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        size_t bytes;
 
-            if (collectionsIter->itemCount > 0) {
-                unsigned int allocated;
+        bytes = 0;
 
-                allocated = sizeof(struct LDStoreCollectionStateItem) *
-                            LDCollectionGetSize(set);
+        HASH_ITER(hh, store->cache->items[kind], item, itemTmp)
+        {
+            bytes += item->bytes;
 
-                if (!(collectionsIter->items =
-                          (struct LDStoreCollectionStateItem *)LDAlloc(
-                              allocated)))
-                {
-                    LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
+            if (kind != LD_FLAG || topCount == 0) {
+                continue;
+            }
 
-                    goto cleanup;
+            /* insertion into the descending list of largest flags */
+            if (largestCount < topCount) {
+                largestCount++;
+            } else if (item->bytes <= largest[largestCount - 1]->bytes) {
+                continue;
+            }
+
+            {
+                unsigned int position;
+
+                for (position = largestCount - 1;
+                     position > 0 && largest[position - 1]->bytes < item->bytes;
+                     position--)
+                {
+                    largest[position] = largest[position - 1];
                 }
 
-                memset(collectionsIter->items, 0, allocated);
+                largest[position] = item;
+            }
+        }
+
+        if (!(tmp = makeKindStats(
+                  HASH_COUNT(store->cache->items[kind]), bytes))) {
+            goto error;
+        }
+
+        if (!LDObjectSetKey(
+                stats, featureKindToString((enum FeatureKind)kind), tmp)) {
+            LDJSONFree(tmp);
 
-                itemIter = collectionsIter->items;
+            goto error;
+        }
+    }
 
-                for (setItem = LDGetIter(set); setItem;
-                     setItem = LDIterNext(setItem)) {
-                    char *serialized;
+    /* built under the lock as it borrows item keys */
+    if (!(tmp = makeLargestStats(largest, largestCount))) {
+        goto error;
+    }
 
-                    serialized = NULL;
+    LDi_rwlock_rdunlock(&store->cache->lock);
 
-                    if (!LDi_validateFeature(setItem)) {
-                        LD_LOG(
-                            LD_LOG_ERROR,
-                            "LDStoreInit failed to validate feature");
+    if (!LDObjectSetKey(stats, "largestFlags", tmp)) {
+        LDJSONFree(tmp);
 
-                        goto next;
-                    }
+        goto cleanup;
+    }
 
-                    if (!(serialized = LDJSONSerialize(setItem))) {
-                        goto cleanup;
-                    }
+    LDFree(largest);
 
-                    itemIter->key = LDi_getFeatureKeyTrusted(setItem);
+    *result = stats;
 
-                    itemIter->item.buffer     = (void *)serialized;
-                    itemIter->item.bufferSize = strlen(serialized);
-                    itemIter->item.version    = LDi_getFeatureVersion(setItem);
+    return LDBooleanTrue;
 
-                next:
-                    itemIter++;
-                }
-            }
+error:
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+cleanup:
+    LDFree(largest);
+    LDJSONFree(stats);
+
+    return LDBooleanFalse;
+}
+
+static LDBoolean
+addStat(struct LDJSON *const stats, const char *const key, const double value)
+{
+    struct LDJSON *tmp;
+
+    if (!(tmp = LDNewNumber(value))) {
+        return LDBooleanFalse;
+    }
+
+    if (!LDObjectSetKey(stats, key, tmp)) {
+        LDJSONFree(tmp);
+
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
+}
+
+LDBoolean
+LDStoreWriteBehindStats(
+    struct LDStore *const store, struct LDJSON **const result)
+{
+    struct LDJSON *      stats;
+    struct PendingWrite *entry, *tmp;
+    unsigned int         queued, kind;
+    double               now, oldest, written, failed;
+
+    LD_ASSERT(store);
+    LD_ASSERT(result);
+
+    entry   = NULL;
+    tmp     = NULL;
+    *result = NULL;
+
+    if (!LDi_getMonotonicMilliseconds(&now)) {
+        return LDBooleanFalse;
+    }
+
+    LDi_mutex_lock(&store->writeLock);
 
-            collectionsIter++;
+    queued = store->writesInFlight;
+    oldest = queued > 0 ? store->inFlightSince : now;
+
+    if (store->pendingInit) {
+        queued++;
+
+        if (store->pendingInit->queuedOn < oldest) {
+            oldest = store->pendingInit->queuedOn;
+        }
+    }
+
+    for (kind = 0; kind < LD_FEATURE_KIND_COUNT; kind++) {
+        HASH_ITER(hh, store->pendingWrites[kind], entry, tmp)
+        {
+            queued++;
+
+            if (entry->queuedOn < oldest) {
+                oldest = entry->queuedOn;
+            }
         }
+    }
+
+    written = store->writesCompleted;
+    failed  = store->writesFailed;
+
+    LDi_mutex_unlock(&store->writeLock);
+
+    if (!(stats = LDNewObject())) {
+        return LDBooleanFalse;
+    }
+
+    if (!addStat(stats, "queued", queued) ||
+        !addStat(stats, "lagMilliseconds", now - oldest) ||
+        !addStat(stats, "written", written) ||
+        !addStat(stats, "failed", failed))
+    {
+        LDJSONFree(stats);
 
-        success = store->backend->init(
-            store->backend->context, collections, LDCollectionGetSize(sets));
+        return LDBooleanFalse;
+    }
 
-    cleanup:
-        if (collections) {
-            for (x = 0; x < LDCollectionGetSize(sets); x++) {
-                struct LDStoreCollectionState *collection;
-                unsigned int                   y;
+    *result = stats;
 
-                collection = &(collections[x]);
+    return LDBooleanTrue;
+}
 
-                for (y = 0; y < collection->itemCount; y++) {
-                    struct LDStoreCollectionStateItem *item;
+/* **** Flag Change Listeners **** */
 
-                    item = &(collection->items[y]);
-                    /* this function owns the buffer the cast is safe */
-                    LDFree((void *)item->item.buffer);
-                }
+/* the listeners registered when the batch is taken are called, unless
+removed before their turn. listeners may evaluate flags, register and remove
+listeners, or destroy the store, so no store locks are held during a call */
+static void
+dispatchBatch(struct LDStore *const store, const struct LDJSON *const keys)
+{
+    struct FlagListener **listeners, *listener;
+    struct LDJSON *       iter;
+    unsigned int          count, i;
 
-                LDFree(collection->items);
-            }
+    LD_ASSERT(store);
+    LD_ASSERT(keys);
 
-            LDFree(collections);
-        }
+    count = 0;
 
-        if (!success) {
-            LDJSONFree(sets);
+    LDi_mutex_lock(&store->dispatchLock);
 
-            return LDBooleanFalse;
-        }
-    }
+    LL_COUNT(store->listeners, listener, count);
 
-    return memoryInit(store, sets);
-}
+    if (count == 0) {
+        LDi_mutex_unlock(&store->dispatchLock);
 
-LDBoolean
-LDStoreGet(
-    struct LDStore *const   store,
-    const enum FeatureKind  kind,
-    const char *const       key,
-    struct LDJSONRC **const result)
-{
-    struct CacheItem *item;
+        return;
+    }
 
-    LD_LOG(LD_LOG_TRACE, "LDStoreGet");
+    if (!(listeners = (struct FlagListener **)LDAlloc(
+              sizeof(struct FlagListener *) * count)))
+    {
+        LDi_mutex_unlock(&store->dispatchLock);
 
-    LD_ASSERT(store);
-    LD_ASSERT(store->cache);
-    LD_ASSERT(key);
-    LD_ASSERT(result);
+        LD_LOG(LD_LOG_ERROR, "failed to dispatch flag changes");
 
-    item    = NULL;
-    *result = NULL;
+        return;
+    }
 
-    LDi_rwlock_rdlock(&store->cache->lock);
+    i = 0;
 
-    if (!memoryGetCollectionItem(
-            store->cache, featureKindToString(kind), key, &item))
+    LL_FOREACH(store->listeners, listener)
     {
-        LDi_rwlock_rdunlock(&store->cache->lock);
+        listener->calls++;
 
-        return LDBooleanFalse;
+        listeners[i++] = listener;
     }
 
-    if (item) {
-        int expired;
+    for (i = 0; i < count; i++) {
+        listener = listeners[i];
 
-        expired = isExpired(store, item);
+        if (!listener->removed && !store->dispatchDestroys) {
+            store->calling = listener;
 
-        if (expired < 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
+            LDi_mutex_unlock(&store->dispatchLock);
 
-            return LDBooleanFalse;
-        } else if (expired == 0) {
-            if (LDi_isFeatureDeleted(LDJSONRCGet(item->feature))) {
-                LDi_rwlock_rdunlock(&store->cache->lock);
+            for (iter = LDGetIter(keys); iter; iter = LDIterNext(iter)) {
+                listener->listener(LDGetText(iter), listener->userData);
 
-                return LDBooleanTrue;
-            } else {
-                LDJSONRCIncrement(item->feature);
+                if (store->dispatchDestroys) {
+                    break;
+                }
+            }
 
-                *result = item->feature;
+            LDi_mutex_lock(&store->dispatchLock);
 
-                LDi_rwlock_rdunlock(&store->cache->lock);
+            store->calling = NULL;
 
-                return LDBooleanTrue;
-            }
-        } else if (expired > 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
-            /* When there is no backend a flag will never be expired */
-            return tryGetBackend(store, featureKindToString(kind), key, result);
+            LDi_cond_signal(&store->dispatchCondition);
         }
-    } else {
-        LDi_rwlock_rdunlock(&store->cache->lock);
 
-        if (store->backend) {
-            return tryGetBackend(store, featureKindToString(kind), key, result);
-        } else {
-            return LDBooleanTrue;
+        if (--listener->calls == 0 && listener->removed) {
+            LDFree(listener);
         }
     }
 
-    return LDBooleanFalse;
+    LDi_mutex_unlock(&store->dispatchLock);
+
+    LDFree(listeners);
 }
 
-LDBoolean
-LDStoreAll(
-    struct LDStore *const   store,
-    const enum FeatureKind  kind,
-    struct LDJSONRC **const result)
+static THREAD_RETURN
+dispatchThread(void *const rawStore)
 {
-    struct CacheItem *item;
+    struct LDStore *store;
 
-    LD_LOG(LD_LOG_TRACE, "LDStoreAll");
+    LD_ASSERT(rawStore);
 
-    LD_ASSERT(store);
-    LD_ASSERT(store->cache);
-    LD_ASSERT(result);
+    store = (struct LDStore *)rawStore;
 
-    item    = NULL;
-    *result = NULL;
+    LDi_mutex_lock(&store->listenerLock);
 
-    LDi_rwlock_rdlock(&store->cache->lock);
+    while (store->dispatchRunning) {
+        struct ChangeBatch *batch;
 
-    if (!memoryAllCollectionItem(
-            store->cache, featureKindToString(kind), &item)) {
-        LDi_rwlock_rdunlock(&store->cache->lock);
+        if (!(batch = store->changeQueue)) {
+            LDi_cond_wait(
+                &store->changeCondition, &store->listenerLock, 1000);
 
-        return LDBooleanFalse;
-    }
+            continue;
+        }
 
-    if (item) {
-        int expired;
+        LL_DELETE(store->changeQueue, batch);
 
-        expired = isExpired(store, item);
+        LDi_mutex_unlock(&store->listenerLock);
 
-        if (expired < 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
+        dispatchBatch(store, batch->keys);
 
-            return LDBooleanFalse;
-        } else if (expired == 0) {
-            LDJSONRCIncrement(item->feature);
+        LDJSONFree(batch->keys);
+        LDFree(batch);
 
-            *result = item->feature;
+        LDi_mutex_lock(&store->listenerLock);
+    }
 
-            LDi_rwlock_rdunlock(&store->cache->lock);
+    LDi_mutex_unlock(&store->listenerLock);
 
-            return LDBooleanTrue;
-        } else if (expired > 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
-            /* When there is no backend a flag will never be expired */
-            return tryGetAllBackend(store, featureKindToString(kind), result);
-        }
-    } else {
-        LDi_rwlock_rdunlock(&store->cache->lock);
+    /* destroyed by a listener, finished here as nothing can join this
+    thread */
+    if (store->dispatchDestroys) {
+        LDi_thread_detach(&store->dispatchThread);
 
-        return tryGetAllBackend(store, featureKindToString(kind), result);
+        freeStore(store);
     }
 
-    /* work around invalid warning, execution should never get here  */
-    LD_ASSERT(LDBooleanFalse);
-
-    return LDBooleanFalse;
+    return THREAD_RETURN_DEFAULT;
 }
 
-LDBoolean
-LDStoreRemove(
-    struct LDStore *const  store,
-    const enum FeatureKind kind,
-    const char *const      key,
-    const unsigned int     version)
+/* with a backend every flag is loaded before the first listener is
+registered, flags read from it later keep the index current. the load is not
+made under dispatchLock so listeners are not held up by the backend */
+static void
+loadListenedFlags(struct LDStore *const store)
 {
-    LDBoolean      status;
-    struct LDJSON *placeholder;
-
-    LD_LOG(LD_LOG_TRACE, "LDStoreRemove");
+    LDBoolean load;
 
     LD_ASSERT(store);
-    LD_ASSERT(key);
-
-    status      = LDBooleanFalse;
-    placeholder = NULL;
-
-    if (store->backend) {
-        struct LDStoreCollectionItem item;
 
-        LD_ASSERT(store->backend->upsert);
-
-        item.buffer     = NULL;
-        item.bufferSize = 0;
-        item.version    = version;
+    LDi_mutex_lock(&store->dispatchLock);
+    load = store->backend && !store->dependencies;
+    LDi_mutex_unlock(&store->dispatchLock);
 
-        if (!store->backend->upsert(
-                store->backend->context, featureKindToString(kind), &item, key))
-        {
-            return LDBooleanFalse;
-        }
+    if (load) {
+        LDi_rwlock_rdlock(&store->cache->lock);
+        load = !store->authoritative;
+        LDi_rwlock_rdunlock(&store->cache->lock);
     }
 
-    if (!(placeholder = LDi_makeDeleted(key, version))) {
-        return LDBooleanFalse;
+    if (load && !coalescedGetAllBackend(store, LD_FLAG, NULL)) {
+        LD_LOG(LD_LOG_WARNING, "failed to load flags for change listeners");
     }
-
-    LDi_rwlock_wrlock(&store->cache->lock);
-    status = upsertMemory(store, featureKindToString(kind), placeholder);
-    LDi_rwlock_wrunlock(&store->cache->lock);
-
-    return status;
 }
 
-LDBoolean
-LDStoreUpsert(
-    struct LDStore *const  store,
-    const enum FeatureKind kind,
-    struct LDJSON *const   feature)
+/* expects dispatchLock. the index is built from the flags currently in memory
+and the dispatcher is started, both only once */
+static LDBoolean
+startListening(struct LDStore *const store)
 {
-    LDBoolean status;
+    struct LDDependencyIndex *index;
+    struct CacheItem *        item, *itemTmp;
 
     LD_ASSERT(store);
-    LD_ASSERT(feature);
-
-    LD_LOG(LD_LOG_TRACE, "LDStoreUpsert");
 
-    if (!LDi_validateFeature(feature)) {
-        LD_LOG(LD_LOG_ERROR, "LDStoreUpsert failed to validate feature");
+    item    = NULL;
+    itemTmp = NULL;
 
-        LDJSONFree(feature);
+    if (store->dependencies) {
+        return LDBooleanTrue;
+    }
 
+    if (!(index = LDDependencyIndexNew())) {
         return LDBooleanFalse;
     }
 
-    if (store->backend) {
-        LDBoolean                    success;
-        char *                       serialized;
-        struct LDStoreCollectionItem collectionItem;
-
-        success    = LDBooleanFalse;
-        serialized = NULL;
+    LDi_rwlock_rdlock(&store->cache->lock);
 
-        LD_ASSERT(store->backend->upsert);
+    HASH_ITER(hh, store->cache->items[LD_FLAG], item, itemTmp)
+    {
+        if (isLiveItem(item) &&
+            !LDDependencyIndexUpdate(
+                index, item->key, LDJSONRCGet(item->feature)))
+        {
+            LDi_rwlock_rdunlock(&store->cache->lock);
 
-        if (!(serialized = LDJSONSerialize(feature))) {
-            LDJSONFree(feature);
+            LDDependencyIndexFree(index);
 
             return LDBooleanFalse;
         }
+    }
 
-        collectionItem.buffer     = (void *)serialized;
-        collectionItem.bufferSize = strlen(serialized);
-        collectionItem.version    = LDi_getFeatureVersionTrusted(feature);
+    LDi_mutex_lock(&store->listenerLock);
 
-        success = store->backend->upsert(
-            store->backend->context,
-            featureKindToString(kind),
-            &collectionItem,
-            LDi_getFeatureKeyTrusted(feature));
+    store->dispatchRunning = LDBooleanTrue;
 
-        LDFree(serialized);
+    if (!LDi_thread_create(&store->dispatchThread, dispatchThread, store)) {
+        LD_LOG(LD_LOG_ERROR, "failed to start flag change dispatch thread");
 
-        if (!success) {
-            LDJSONFree(feature);
+        store->dispatchRunning = LDBooleanFalse;
 
-            return LDBooleanFalse;
-        }
+        LDi_mutex_unlock(&store->listenerLock);
+        LDi_rwlock_rdunlock(&store->cache->lock);
+
+        LDDependencyIndexFree(index);
+
+        return LDBooleanFalse;
     }
 
-    LDi_rwlock_wrlock(&store->cache->lock);
-    status = upsertMemory(store, featureKindToString(kind), feature);
-    LDi_rwlock_wrunlock(&store->cache->lock);
+    store->dependencies = index;
 
-    return status;
+    LDi_mutex_unlock(&store->listenerLock);
+    LDi_rwlock_rdunlock(&store->cache->lock);
+
+    return LDBooleanTrue;
 }
 
 LDBoolean
-LDStoreInitialized(struct LDStore *const store)
+LDStoreRegisterListener(
+    struct LDStore *const      store,
+    const LDFlagChangeListener listener,
+    void *const                userData)
 {
-    LDBoolean         isInitialized;
-    struct CacheItem *item;
+    struct FlagListener *entry;
 
     LD_ASSERT(store);
+    LD_ASSERT(listener);
 
-    LD_LOG(LD_LOG_TRACE, "LDStoreInitialized");
-
-    LDi_rwlock_rdlock(&store->cache->lock);
-    isInitialized = store->cache->initialized;
-
-    if (isInitialized || !store->backend) {
-        LDi_rwlock_rdunlock(&store->cache->lock);
-
-        return isInitialized;
+    if (!(entry = (struct FlagListener *)LDAlloc(sizeof(struct FlagListener))))
+    {
+        return LDBooleanFalse;
     }
 
-    HASH_FIND_STR(store->cache->items, INIT_CHECKED_KEY, item);
-
-    if (item) {
-        int expired = isExpired(store, item);
+    entry->listener = listener;
+    entry->userData = userData;
+    entry->calls    = 0;
+    entry->removed  = LDBooleanFalse;
+    entry->next     = NULL;
 
-        if (expired < 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
+    loadListenedFlags(store);
 
-            return LDBooleanFalse;
-        } else if (expired == 0) {
-            LDi_rwlock_rdunlock(&store->cache->lock);
+    LDi_mutex_lock(&store->dispatchLock);
 
-            return LDBooleanFalse;
-        } else if (expired > 0) {
-            deleteAndRemoveCacheItem(&store->cache->items, item);
-        }
-    }
+    if (!startListening(store)) {
+        LDi_mutex_unlock(&store->dispatchLock);
 
-    LDi_rwlock_rdunlock(&store->cache->lock);
+        LDFree(entry);
 
-    isInitialized = store->backend->initialized(store->backend->context);
+        return LDBooleanFalse;
+    }
 
-    if (isInitialized) {
-        LDi_rwlock_wrlock(&store->cache->lock);
-        store->cache->initialized = LDBooleanTrue;
-        LDi_rwlock_wrunlock(&store->cache->lock);
-    } else {
-        if (!(item = makeCacheItem(INIT_CHECKED_KEY, NULL))) {
-            return LDBooleanFalse;
-        }
+    LL_APPEND(store->listeners, entry);
 
-        LDi_rwlock_wrlock(&store->cache->lock);
-        HASH_ADD_KEYPTR(
-            hh, store->cache->items, item->key, strlen(item->key), item);
-        LDi_rwlock_wrunlock(&store->cache->lock);
-    }
+    LDi_mutex_unlock(&store->dispatchLock);
 
-    return isInitialized;
+    return LDBooleanTrue;
 }
 
-void
-LDStoreDestroy(struct LDStore *const store)
+LDBoolean
+LDStoreUnregisterListener(
+    struct LDStore *const      store,
+    const LDFlagChangeListener listener,
+    void *const                userData)
 {
-    LD_LOG(LD_LOG_TRACE, "LDStoreDestroy");
+    struct FlagListener *entry;
 
-    if (store) {
-        memoryDestructor(store->cache);
+    LD_ASSERT(store);
+    LD_ASSERT(listener);
 
-        if (store->backend) {
-            if (store->backend->destructor) {
-                store->backend->destructor(store->backend->context);
-            }
+    LDi_mutex_lock(&store->dispatchLock);
 
-            LDFree(store->backend);
+    LL_FOREACH(store->listeners, entry)
+    {
+        if (entry->listener == listener && entry->userData == userData) {
+            break;
         }
-
-        LDFree(store);
     }
-}
 
-LDBoolean
-LDStoreInitEmpty(struct LDStore *const store)
-{
-    struct LDJSON *values;
-    LDBoolean      success;
+    if (!entry) {
+        LDi_mutex_unlock(&store->dispatchLock);
 
-    LD_ASSERT(store);
+        return LDBooleanFalse;
+    }
 
-    success = LDBooleanFalse;
+    LL_DELETE(store->listeners, entry);
 
-    if (!(values = LDNewObject())) {
-        goto cleanup;
+    entry->removed = LDBooleanTrue;
+
+    /* a call on the dispatch thread finishes before this returns, unless the
+    listener is removing itself */
+    while (store->calling == entry &&
+           !LDi_thread_is_current(&store->dispatchThread))
+    {
+        LDi_cond_wait(&store->dispatchCondition, &store->dispatchLock, 1000);
     }
 
-    success = LDStoreInit(store, values);
-    /* values consumed even on failure */
-    values = NULL;
+    /* otherwise freed by the dispatch holding it */
+    if (entry->calls == 0) {
+        LDFree(entry);
+    }
 
-cleanup:
-    LDJSONFree(values);
+    LDi_mutex_unlock(&store->dispatchLock);
 
-    return success;
+    return LDBooleanTrue;
 }
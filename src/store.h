@@ -68,6 +68,9 @@ enum FeatureKind
     LD_SEGMENT
 };
 
+/** @brief The number of values in `enum FeatureKind` */
+#define LD_FEATURE_KIND_COUNT 2
+
 /** @brief A convenience wrapper around `store->init`.
  *
  * Input is consumed even on failure.
@@ -75,6 +78,20 @@ enum FeatureKind
 LDBoolean
 LDStoreInit(struct LDStore *const store, struct LDJSON *const sets);
 
+/** @brief Initialize memory from the configured snapshot file.
+ *
+ * Returns false when no snapshot is configured or it could not be loaded.
+ */
+LDBoolean
+LDStoreLoadSnapshot(struct LDStore *const store);
+
+/** @brief Load every collection from the backend when warm up is configured.
+ *
+ * Returns true without loading anything otherwise.
+ */
+LDBoolean
+LDStoreWarmUp(struct LDStore *const store);
+
 /** @brief A convenience wrapper around `store->get`. */
 LDBoolean
 LDStoreGet(
@@ -83,7 +100,31 @@ LDStoreGet(
     const char *const       key,
     struct LDJSONRC **const result);
 
-/** @brief A convenience wrapper around `store->all`. */
+/** @brief Intern a flag key, returning a handle that stays valid for the
+ * life of the store. Interning the same key again returns the same handle.
+ */
+LDBoolean
+LDStoreFlagHandle(
+    struct LDStore *const store,
+    const char *const     key,
+    LDFlagHandle *const   handle);
+
+/** @brief `LDStoreGet` for a flag by handle, without hashing its key.
+ *
+ * `key` is set to the interned key, which lives as long as the store. Fails
+ * for a handle not returned by `LDStoreFlagHandle`.
+ */
+LDBoolean
+LDStoreGetByHandle(
+    struct LDStore *const   store,
+    const LDFlagHandle      handle,
+    const char **const      key,
+    struct LDJSONRC **const result);
+
+/** @brief Copy every item of a kind into a single object.
+ *
+ * Prefer `LDStoreSnapshotNew` which shares items instead of copying them.
+ */
 LDBoolean
 LDStoreAll(
     struct LDStore *const   store,
@@ -120,4 +161,85 @@ LDStoreDestroy(struct LDStore *const store);
 LDBoolean
 LDStoreInitEmpty(struct LDStore *const store);
 
+/** @brief Estimate the memory used by cached items.
+ *
+ * Reports the item count and bytes of each kind, and the `topCount` largest
+ * flags from largest to smallest.
+ */
+LDBoolean
+LDStoreMemoryStats(
+    struct LDStore *const  store,
+    const unsigned int     topCount,
+    struct LDJSON **const  result);
+
+/** @brief Report the progress of writing to the backend in the background.
+ *
+ * Reports the changes `queued` or being written, the age of the oldest of them
+ * as `lagMilliseconds`, and the number of backend writes `written` and
+ * `failed`.
+ */
+LDBoolean
+LDStoreWriteBehindStats(
+    struct LDStore *const store, struct LDJSON **const result);
+
+/** @brief Call `listener` with the key of each flag changed by an upsert,
+ * remove, or init, including flags that reference a changed prerequisite or
+ * segment.
+ *
+ * Listeners are called on a dedicated thread without store locks held. They
+ * may register and unregister listeners, and may destroy the store.
+ * Dependencies are indexed from the flags in memory when the first listener
+ * is registered.
+ */
+LDBoolean
+LDStoreRegisterListener(
+    struct LDStore *const      store,
+    const LDFlagChangeListener listener,
+    void *const                userData);
+
+/** @brief Remove a listener registered with the same `userData`.
+ *
+ * Returns false if it was not registered.
+ */
+LDBoolean
+LDStoreUnregisterListener(
+    struct LDStore *const      store,
+    const LDFlagChangeListener listener,
+    void *const                userData);
+
+/*@}*/
+
+/*******************************************************************************
+ * @name Store snapshots
+ * A consistent view of every live item of a kind. Items are shared with the
+ * store by reference count rather than copied.
+ * @{
+ *******************************************************************************/
+
+struct LDStoreSnapshot;
+
+/** @brief Capture the current items of a kind.
+ *
+ * When a backend is configured the kind is first reloaded from the backend if
+ * the cached collection has expired.
+ */
+LDBoolean
+LDStoreSnapshotNew(
+    struct LDStore *const          store,
+    const enum FeatureKind         kind,
+    struct LDStoreSnapshot **const result);
+
+/** @brief The number of items in the snapshot. */
+unsigned int
+LDStoreSnapshotCount(const struct LDStoreSnapshot *const snapshot);
+
+/** @brief Get an item by index. The reference is owned by the snapshot. */
+struct LDJSONRC *
+LDStoreSnapshotItem(
+    const struct LDStoreSnapshot *const snapshot, const unsigned int index);
+
+/** @brief Release the snapshot. May be `NULL`. */
+void
+LDStoreSnapshotFree(struct LDStoreSnapshot *const snapshot);
+
 /*@}*/
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
@@ -117,72 +118,270 @@ validatePutBody(const struct LDJSON *const put)
     return LDBooleanTrue;
 }
 
-/* consumes input even on failure */
+/* a put is read member by member, each flag and segment is parsed on its own
+and moved straight into its set, so no tree of the whole body is built */
+struct PutReader
+{
+    const char *cursor;
+    const char *end;
+};
+
 static LDBoolean
-onPut(struct LDClient *const client, const char *const eventBuffer)
+consumeCharacter(struct PutReader *const reader, const char expected)
 {
-    struct LDJSON *data, *features, *put;
-    LDBoolean      success;
+    while (reader->cursor < reader->end &&
+           isspace((unsigned char)*reader->cursor)) {
+        reader->cursor++;
+    }
 
-    LD_ASSERT(client);
-    LD_ASSERT(eventBuffer);
+    if (reader->cursor < reader->end && *reader->cursor == expected) {
+        reader->cursor++;
 
-    data     = NULL;
-    features = NULL;
-    success  = LDBooleanFalse;
-    put      = NULL;
+        return LDBooleanTrue;
+    }
 
-    if (!(put = LDJSONDeserialize(eventBuffer))) {
-        LD_LOG(LD_LOG_ERROR, "sse delete failed to decode event body");
+    return LDBooleanFalse;
+}
 
-        goto cleanup;
+static struct LDJSON *
+readValue(struct PutReader *const reader)
+{
+    return LDi_JSONDeserializePrefix(
+        reader->cursor, reader->end - reader->cursor, &reader->cursor);
+}
+
+/* reads the key of the next member of an object, key is NULL after the last
+member */
+static LDBoolean
+readKey(
+    struct PutReader *const reader,
+    LDBoolean *const        first,
+    struct LDJSON **const   key)
+{
+    *key = NULL;
+
+    if (consumeCharacter(reader, '}')) {
+        return LDBooleanTrue;
     }
 
-    if (LDJSONGetType(put) != LDObject) {
-        LD_LOG(LD_LOG_ERROR, "sse delete body should be object, discarding");
+    if (!*first && !consumeCharacter(reader, ',')) {
+        return LDBooleanFalse;
+    }
 
-        goto cleanup;
+    *first = LDBooleanFalse;
+
+    if (!(*key = readValue(reader))) {
+        return LDBooleanFalse;
     }
 
-    if (!(data = LDObjectDetachKey(put, "data"))) {
-        LD_LOG(LD_LOG_ERROR, "put.data does not exist");
+    if (LDJSONGetType(*key) != LDText || !consumeCharacter(reader, ':')) {
+        LDJSONFree(*key);
+        *key = NULL;
 
-        goto cleanup;
+        return LDBooleanFalse;
     }
 
-    if (!validatePutBody(data)) {
-        LD_LOG(LD_LOG_ERROR, "put.data failed validation");
+    return LDBooleanTrue;
+}
 
-        goto cleanup;
+static LDBoolean
+readSet(struct PutReader *const reader, struct LDJSON *const set)
+{
+    struct LDJSON *key, *item;
+    LDBoolean      first;
+
+    first = LDBooleanTrue;
+
+    if (!consumeCharacter(reader, '{')) {
+        return LDBooleanFalse;
     }
 
-    features = LDObjectDetachKey(data, "flags");
-    LD_ASSERT(features);
+    while (LDBooleanTrue) {
+        if (!readKey(reader, &first, &key)) {
+            return LDBooleanFalse;
+        }
 
-    if (!LDObjectSetKey(data, "features", features)) {
-        LD_LOG(LD_LOG_ERROR, "alloc error");
+        if (!key) {
+            return LDBooleanTrue;
+        }
 
-        goto cleanup;
+        if (!(item = readValue(reader))) {
+            LDJSONFree(key);
+
+            return LDBooleanFalse;
+        }
+
+        /* duplicate keys are resolved by version in the store */
+        if (!LDi_objectAppendKey(set, LDGetText(key), item)) {
+            LDJSONFree(item);
+            LDJSONFree(key);
+
+            return LDBooleanFalse;
+        }
+
+        LDJSONFree(key);
     }
-    features = NULL;
+}
 
-    if (!(success = LDStoreInit(client->store, data))) {
-        LD_LOG(LD_LOG_ERROR, "LDStoreInit error");
+/* reads an object of flags and segments, or when member is provided the
+object holding them under that key. found has a bit set for each set read */
+static LDBoolean
+readPutObject(
+    struct PutReader *const reader,
+    const char *const       member,
+    struct LDJSON *const    sets,
+    unsigned int *const     found)
+{
+    struct LDJSON *key, *skipped;
+    LDBoolean      first, success;
 
-        data = NULL;
+    first = LDBooleanTrue;
 
-        goto cleanup;
+    if (!consumeCharacter(reader, '{')) {
+        return LDBooleanFalse;
     }
-    data = NULL;
 
-    success = LDBooleanTrue;
+    while (LDBooleanTrue) {
+        if (!readKey(reader, &first, &key)) {
+            return LDBooleanFalse;
+        }
 
-cleanup:
-    LDJSONFree(put);
-    LDJSONFree(data);
-    LDJSONFree(features);
+        if (!key) {
+            return LDBooleanTrue;
+        }
 
-    return success;
+        if (member) {
+            if (strcmp(LDGetText(key), member) == 0) {
+                success = readPutObject(reader, NULL, sets, found);
+            } else if ((skipped = readValue(reader))) {
+                LDJSONFree(skipped);
+
+                success = LDBooleanTrue;
+            } else {
+                success = LDBooleanFalse;
+            }
+        } else if (strcmp(LDGetText(key), "flags") == 0) {
+            success = readSet(reader, LDObjectLookup(sets, "features"));
+
+            *found |= 1;
+        } else if (strcmp(LDGetText(key), "segments") == 0) {
+            success = readSet(reader, LDObjectLookup(sets, "segments"));
+
+            *found |= 2;
+        } else if ((skipped = readValue(reader))) {
+            LDJSONFree(skipped);
+
+            success = LDBooleanTrue;
+        } else {
+            success = LDBooleanFalse;
+        }
+
+        LDJSONFree(key);
+
+        if (!success) {
+            return LDBooleanFalse;
+        }
+    }
+}
+
+LDBoolean
+LDi_parsePut(
+    const char *const     text,
+    const char *const     member,
+    struct LDJSON **const result)
+{
+    struct PutReader reader;
+    struct LDJSON *  sets, *tmp;
+    unsigned int     found;
+
+    LD_ASSERT(text);
+    LD_ASSERT(result);
+
+    *result       = NULL;
+    reader.cursor = text;
+    reader.end    = text + strlen(text);
+    found         = 0;
+
+    if (!(sets = LDNewObject())) {
+        return LDBooleanFalse;
+    }
+
+    if (!(tmp = LDNewObject())) {
+        goto error;
+    }
+
+    if (!LDi_objectAppendKey(sets, "features", tmp)) {
+        LDJSONFree(tmp);
+
+        goto error;
+    }
+
+    if (!(tmp = LDNewObject())) {
+        goto error;
+    }
+
+    if (!LDi_objectAppendKey(sets, "segments", tmp)) {
+        LDJSONFree(tmp);
+
+        goto error;
+    }
+
+    if (!readPutObject(&reader, member, sets, &found)) {
+        LD_LOG(LD_LOG_ERROR, "failed to parse put");
+
+        goto error;
+    }
+
+    /* nothing may follow the body */
+    while (reader.cursor < reader.end &&
+           isspace((unsigned char)*reader.cursor)) {
+        reader.cursor++;
+    }
+
+    if (reader.cursor != reader.end) {
+        LD_LOG(LD_LOG_ERROR, "put has trailing data");
+
+        goto error;
+    }
+
+    if (found != 3) {
+        LD_LOG(LD_LOG_ERROR, "put does not have flags and segments");
+
+        goto error;
+    }
+
+    *result = sets;
+
+    return LDBooleanTrue;
+
+error:
+    LDJSONFree(sets);
+
+    return LDBooleanFalse;
+}
+
+/* consumes input even on failure */
+static LDBoolean
+onPut(struct LDClient *const client, const char *const eventBuffer)
+{
+    struct LDJSON *sets;
+
+    LD_ASSERT(client);
+    LD_ASSERT(eventBuffer);
+
+    if (!LDi_parsePut(eventBuffer, "data", &sets)) {
+        LD_LOG(LD_LOG_ERROR, "sse put failed to decode event body");
+
+        return LDBooleanFalse;
+    }
+
+    if (!LDStoreInit(client->store, sets)) {
+        LD_LOG(LD_LOG_ERROR, "LDStoreInit error");
+
+        return LDBooleanFalse;
+    }
+
+    return LDBooleanTrue;
 }
 
 /* consumes input even on failure */
@@ -218,7 +218,8 @@ static struct LDJSON *
 variation(
     struct LDClient *const     client,
     const struct LDUser *const user,
-    const char *const          key,
+    const char *               key,
+    const LDFlagHandle         handle,
     struct LDJSON *const       fallback,
     LDBoolean (*const checkType)(const LDJSONType type),
     struct LDDetails *const o_details)
@@ -231,7 +232,7 @@ variation(
 
     LD_ASSERT_API(client);
     LD_ASSERT_API(user);
-    LD_ASSERT_API(key);
+    LD_ASSERT_API(key || handle != LD_INVALID_FLAG_HANDLE);
 
     LD_ASSERT(fallback);
     LD_ASSERT(checkType);
@@ -267,7 +268,7 @@ variation(
         detailsRef->extra.errorKind = LD_USER_NOT_SPECIFIED;
 
         goto error;
-    } else if (key == NULL) {
+    } else if (key == NULL && handle == LD_INVALID_FLAG_HANDLE) {
         LD_LOG(LD_LOG_WARNING, "variation NULL key");
 
         detailsRef->reason          = LD_ERROR;
@@ -287,7 +288,10 @@ variation(
     store = client->store;
     LD_ASSERT(store);
 
-    if (!LDStoreGet(store, LD_FLAG, key, &flagrc)) {
+    /* a handle also provides the key for events */
+    if (key ? !LDStoreGet(store, LD_FLAG, key, &flagrc)
+            : !LDStoreGetByHandle(store, handle, &key, &flagrc))
+    {
         detailsRef->reason          = LD_ERROR;
         detailsRef->extra.errorKind = LD_STORE_ERROR;
 
@@ -382,11 +386,12 @@ isBool(const LDJSONType type)
     return type == LDBool;
 }
 
-LDBoolean
-LDBoolVariation(
+static LDBoolean
+boolVariation(
     struct LDClient *const     client,
     const struct LDUser *const user,
     const char *const          key,
+    const LDFlagHandle         handle,
     const LDBoolean            fallback,
     struct LDDetails *const    details)
 {
@@ -402,7 +407,8 @@ LDBoolVariation(
         return fallback;
     }
 
-    result = variation(client, user, key, fallbackJSON, isBool, details);
+    result =
+        variation(client, user, key, handle, fallbackJSON, isBool, details);
 
     if (result) {
         value = LDGetBool(result);
@@ -415,17 +421,41 @@ LDBoolVariation(
     }
 }
 
+LDBoolean
+LDBoolVariation(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const char *const          key,
+    const LDBoolean            fallback,
+    struct LDDetails *const    details)
+{
+    return boolVariation(
+        client, user, key, LD_INVALID_FLAG_HANDLE, fallback, details);
+}
+
+LDBoolean
+LDBoolVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const LDBoolean            fallback,
+    struct LDDetails *const    details)
+{
+    return boolVariation(client, user, NULL, handle, fallback, details);
+}
+
 static LDBoolean
 isNumber(const LDJSONType type)
 {
     return type == LDNumber;
 }
 
-int
-LDIntVariation(
+static int
+intVariation(
     struct LDClient *const     client,
     const struct LDUser *const user,
     const char *const          key,
+    const LDFlagHandle         handle,
     const int                  fallback,
     struct LDDetails *const    details)
 {
@@ -441,7 +471,8 @@ LDIntVariation(
         return fallback;
     }
 
-    result = variation(client, user, key, fallbackJSON, isNumber, details);
+    result = variation(
+        client, user, key, handle, fallbackJSON, isNumber, details);
 
     if (result) {
         value = LDGetNumber(result);
@@ -454,11 +485,35 @@ LDIntVariation(
     }
 }
 
-double
-LDDoubleVariation(
+int
+LDIntVariation(
     struct LDClient *const     client,
     const struct LDUser *const user,
     const char *const          key,
+    const int                  fallback,
+    struct LDDetails *const    details)
+{
+    return intVariation(
+        client, user, key, LD_INVALID_FLAG_HANDLE, fallback, details);
+}
+
+int
+LDIntVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const int                  fallback,
+    struct LDDetails *const    details)
+{
+    return intVariation(client, user, NULL, handle, fallback, details);
+}
+
+static double
+doubleVariation(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const char *const          key,
+    const LDFlagHandle         handle,
     const double               fallback,
     struct LDDetails *const    details)
 {
@@ -474,7 +529,8 @@ LDDoubleVariation(
         return fallback;
     }
 
-    result = variation(client, user, key, fallbackJSON, isNumber, details);
+    result = variation(
+        client, user, key, handle, fallbackJSON, isNumber, details);
 
     if (result) {
         value = LDGetNumber(result);
@@ -487,17 +543,41 @@ LDDoubleVariation(
     }
 }
 
+double
+LDDoubleVariation(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const char *const          key,
+    const double               fallback,
+    struct LDDetails *const    details)
+{
+    return doubleVariation(
+        client, user, key, LD_INVALID_FLAG_HANDLE, fallback, details);
+}
+
+double
+LDDoubleVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const double               fallback,
+    struct LDDetails *const    details)
+{
+    return doubleVariation(client, user, NULL, handle, fallback, details);
+}
+
 static LDBoolean
 isText(const LDJSONType type)
 {
     return type == LDText;
 }
 
-char *
-LDStringVariation(
+static char *
+stringVariation(
     struct LDClient *const     client,
     const struct LDUser *const user,
     const char *const          key,
+    const LDFlagHandle         handle,
     const char *const          fallback,
     struct LDDetails *const    details)
 {
@@ -520,7 +600,8 @@ LDStringVariation(
         }
     }
 
-    result = variation(client, user, key, fallbackJSON, isText, details);
+    result =
+        variation(client, user, key, handle, fallbackJSON, isText, details);
 
     if (result == NULL) {
         return NULL;
@@ -542,17 +623,41 @@ LDStringVariation(
     }
 }
 
+char *
+LDStringVariation(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const char *const          key,
+    const char *const          fallback,
+    struct LDDetails *const    details)
+{
+    return stringVariation(
+        client, user, key, LD_INVALID_FLAG_HANDLE, fallback, details);
+}
+
+char *
+LDStringVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const char *const          fallback,
+    struct LDDetails *const    details)
+{
+    return stringVariation(client, user, NULL, handle, fallback, details);
+}
+
 static LDBoolean
 isArrayOrObject(const LDJSONType type)
 {
     return type == LDArray || type == LDObject;
 }
 
-struct LDJSON *
-LDJSONVariation(
+static struct LDJSON *
+jsonVariation(
     struct LDClient *const     client,
     const struct LDUser *const user,
     const char *const          key,
+    const LDFlagHandle         handle,
     const struct LDJSON *const fallback,
     struct LDDetails *const    details)
 {
@@ -573,8 +678,8 @@ LDJSONVariation(
         }
     }
 
-    result =
-        variation(client, user, key, fallbackJSON, isArrayOrObject, details);
+    result = variation(
+        client, user, key, handle, fallbackJSON, isArrayOrObject, details);
 
     if (fallback == NULL && result == fallbackJSON) {
         LDJSONFree(fallbackJSON);
@@ -585,18 +690,40 @@ LDJSONVariation(
     return result;
 }
 
+struct LDJSON *
+LDJSONVariation(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const char *const          key,
+    const struct LDJSON *const fallback,
+    struct LDDetails *const    details)
+{
+    return jsonVariation(
+        client, user, key, LD_INVALID_FLAG_HANDLE, fallback, details);
+}
+
+struct LDJSON *
+LDJSONVariationByHandle(
+    struct LDClient *const     client,
+    const struct LDUser *const user,
+    const LDFlagHandle         handle,
+    const struct LDJSON *const fallback,
+    struct LDDetails *const    details)
+{
+    return jsonVariation(client, user, NULL, handle, fallback, details);
+}
+
 struct LDJSON *
 LDAllFlags(struct LDClient *const client, const struct LDUser *const user)
 {
-    struct LDJSON *  evaluatedFlags, *rawFlags, *rawFlagsIter;
-    struct LDJSONRC *rawFlagsRC;
+    struct LDJSON *         evaluatedFlags;
+    struct LDStoreSnapshot *snapshot;
+    unsigned int            i;
 
     LD_ASSERT_API(client);
     LD_ASSERT_API(user);
 
-    rawFlags       = NULL;
-    rawFlagsIter   = NULL;
-    rawFlagsRC     = NULL;
+    snapshot       = NULL;
     evaluatedFlags = NULL;
 
 #ifdef LAUNCHDARKLY_DEFENSIVE
@@ -631,7 +758,7 @@ LDAllFlags(struct LDClient *const client, const struct LDUser *const user)
         return NULL;
     }
 
-    if (!LDStoreAll(client->store, LD_FLAG, &rawFlagsRC)) {
+    if (!LDStoreSnapshotNew(client->store, LD_FLAG, &snapshot)) {
         LD_LOG(LD_LOG_ERROR, "LDAllFlags failed to fetch flags");
 
         LDJSONFree(evaluatedFlags);
@@ -639,12 +766,7 @@ LDAllFlags(struct LDClient *const client, const struct LDUser *const user)
         return NULL;
     }
 
-    rawFlags = LDJSONRCGet(rawFlagsRC);
-    LD_ASSERT(rawFlags);
-
-    for (rawFlagsIter = LDGetIter(rawFlags); rawFlagsIter;
-         rawFlagsIter = LDIterNext(rawFlagsIter))
-    {
+    for (i = 0; i < LDStoreSnapshotCount(snapshot); i++) {
         struct LDJSON *  value, *events;
         EvalStatus       status;
         struct LDDetails details;
@@ -655,7 +777,7 @@ LDAllFlags(struct LDClient *const client, const struct LDUser *const user)
         events = NULL;
         key    = NULL;
 
-        flag = rawFlagsIter;
+        flag = LDJSONRCGet(LDStoreSnapshotItem(snapshot, i));
         LD_ASSERT(flag);
 
         LDDetailsInit(&details);
@@ -694,12 +816,12 @@ LDAllFlags(struct LDClient *const client, const struct LDUser *const user)
         LDDetailsClear(&details);
     }
 
-    LDJSONRCDecrement(rawFlagsRC);
+    LDStoreSnapshotFree(snapshot);
 
     return evaluatedFlags;
 
 error:
-    LDJSONRCDecrement(rawFlagsRC);
+    LDStoreSnapshotFree(snapshot);
     LDJSONFree(evaluatedFlags);
 
     return NULL;
@@ -1,8 +1,10 @@
+#include <stdio.h>
 #include <string.h>
 
 #include <launchdarkly/store/redis.h>
 
 #include "assertion.h"
+#include "compact_item.h"
 #include "concurrency.h"
 #include "redis.h"
 #include "store.h"
@@ -13,6 +15,9 @@ static const char *const defaultHost   = "127.0.0.1";
 static const char *const defaultPrefix = "launchdarkly";
 static const char *const initedKey     = "$inited";
 
+/* the most fields written by one HSET command in storeInit */
+#define INIT_CHUNK_SIZE 512
+
 struct LDRedisConfig
 {
     char *         host;
@@ -301,6 +306,102 @@ resetReply(redisReply **const reply)
     *reply = NULL;
 }
 
+/* returns "prefix:kind" */
+static char *
+makeHashKey(
+    const struct Context *const context, const char *const kind)
+{
+    char * hashKey;
+    size_t length;
+
+    LD_ASSERT(context);
+    LD_ASSERT(kind);
+
+    length = strlen(LDRedisConfigGetPrefix(context->config)) + 1 + strlen(kind);
+
+    if (!(hashKey = (char *)LDAlloc(length + 1))) {
+        return NULL;
+    }
+
+    if (snprintf(
+            hashKey,
+            length + 1,
+            "%s:%s",
+            LDRedisConfigGetPrefix(context->config),
+            kind) < 0)
+    {
+        LDFree(hashKey);
+
+        return NULL;
+    }
+
+    return hashKey;
+}
+
+/* queue HSET commands writing each item of a collection, with up to
+INIT_CHUNK_SIZE fields per command. counts the commands appended */
+static LDBoolean
+appendInitHash(
+    redisContext *const                        connection,
+    const char *const                          hash,
+    const struct LDStoreCollectionState *const collection,
+    const char **const                         argv,
+    size_t *const                              argvlen,
+    unsigned int *const                        commands)
+{
+    unsigned int y, fields;
+
+    argv[0]    = "HSET";
+    argvlen[0] = strlen(argv[0]);
+    argv[1]    = hash;
+    argvlen[1] = strlen(hash);
+    fields     = 0;
+
+    for (y = 0; y < collection->itemCount; y++) {
+        const struct LDStoreCollectionStateItem *const item =
+            &(collection->items[y]);
+        const unsigned int field = 2 + fields * 2;
+
+        /* items that failed validation are left empty */
+        if (!item->item.buffer) {
+            continue;
+        }
+
+        argv[field]        = item->key;
+        argvlen[field]     = strlen(item->key);
+        argv[field + 1]    = (const char *)item->item.buffer;
+        argvlen[field + 1] = item->item.bufferSize;
+
+        if (++fields < INIT_CHUNK_SIZE && y + 1 < collection->itemCount) {
+            continue;
+        }
+
+        if (redisAppendCommandArgv(connection, 2 + fields * 2, argv, argvlen) !=
+            REDIS_OK)
+        {
+            return LDBooleanFalse;
+        }
+
+        (*commands)++;
+        fields = 0;
+    }
+
+    /* the last items may have been empty */
+    if (fields > 0) {
+        if (redisAppendCommandArgv(connection, 2 + fields * 2, argv, argvlen) !=
+            REDIS_OK)
+        {
+            return LDBooleanFalse;
+        }
+
+        (*commands)++;
+    }
+
+    return LDBooleanTrue;
+}
+
+/* the transaction is pipelined, every command is sent before any reply is
+read */
 static LDBoolean
 storeInit(
     void *const                          contextRaw,
@@ -310,8 +411,11 @@ storeInit(
     struct Context *   context;
     redisReply *       reply;
     struct Connection *connection;
-    LDBoolean          success;
-    unsigned int       x;
+    const char **      argv;
+    size_t *           argvlen;
+    char *             itemsHash;
+    LDBoolean          success, appended;
+    unsigned int       x, commands;
 
     LD_LOG(LD_LOG_TRACE, "redis storeInit");
 
@@ -321,116 +425,158 @@ storeInit(
     connection = NULL;
     context    = (struct Context *)contextRaw;
     reply      = NULL;
+    argv       = NULL;
+    argvlen    = NULL;
+    itemsHash  = NULL;
     success    = LDBooleanFalse;
+    appended   = LDBooleanFalse;
+    commands   = 0;
 
-    if (!(connection = borrowConnection(context))) {
+    if (!(argv = (const char **)LDAlloc(
+              sizeof(char *) * (2 + INIT_CHUNK_SIZE * 2))))
+    {
+        goto cleanup;
+    }
+
+    if (!(argvlen =
+              (size_t *)LDAlloc(sizeof(size_t) * (2 + INIT_CHUNK_SIZE * 2))))
+    {
         goto cleanup;
     }
 
-    reply = redisCommand(connection->connection, "MULTI");
+    if (!(connection = borrowConnection(context))) {
+        goto cleanup;
+    }
 
-    if (!redisCheckStatus(reply, "OK")) {
+    if (redisAppendCommand(connection->connection, "MULTI") != REDIS_OK) {
         goto cleanup;
     }
 
-    resetReply(&reply);
+    commands++;
 
     for (x = 0; x < collectionCount; x++) {
         const struct LDStoreCollectionState *collection;
-        unsigned int                         y;
 
         collection = &(collections[x]);
 
-        reply = redisCommand(
-            connection->connection,
-            "DEL %s:%s",
-            LDRedisConfigGetPrefix(context->config),
-            collection->kind);
-
-        if (!redisCheckStatus(reply, "QUEUED")) {
+        if (!(itemsHash = makeHashKey(context, collection->kind))) {
             goto cleanup;
         }
 
-        resetReply(&reply);
+        argv[0]    = "DEL";
+        argvlen[0] = strlen(argv[0]);
+        argv[1]    = itemsHash;
+        argvlen[1] = strlen(itemsHash);
 
-        for (y = 0; y < collection->itemCount; y++) {
-            struct LDStoreCollectionStateItem *item;
+        if (redisAppendCommandArgv(connection->connection, 2, argv, argvlen) !=
+            REDIS_OK)
+        {
+            goto cleanup;
+        }
 
-            item = &(collection->items[y]);
+        commands++;
 
-            reply = redisCommand(
+        if (!appendInitHash(
                 connection->connection,
-                "HSET %s:%s %s %s",
-                LDRedisConfigGetPrefix(context->config),
-                collection->kind,
-                item->key,
-                item->item.buffer);
+                itemsHash,
+                collection,
+                argv,
+                argvlen,
+                &commands))
+        {
+            goto cleanup;
+        }
 
-            if (!redisCheckStatus(reply, "QUEUED")) {
-                goto cleanup;
-            }
+        LDFree(itemsHash);
+        itemsHash = NULL;
+    }
 
-            resetReply(&reply);
-        }
+    if (redisAppendCommand(
+            connection->connection,
+            "SET %s:%s %s",
+            LDRedisConfigGetPrefix(context->config),
+            initedKey,
+            "") != REDIS_OK)
+    {
+        goto cleanup;
     }
 
-    reply = redisCommand(
-        connection->connection,
-        "SET %s:%s %s",
-        LDRedisConfigGetPrefix(context->config),
-        initedKey,
-        "");
+    commands++;
 
-    if (!redisCheckStatus(reply, "QUEUED")) {
+    if (redisAppendCommand(connection->connection, "EXEC") != REDIS_OK) {
         goto cleanup;
     }
 
-    resetReply(&reply);
+    commands++;
+    appended = LDBooleanTrue;
+    success  = LDBooleanTrue;
 
-    reply = redisCommand(connection->connection, "EXEC");
+    /* every reply is read, even after a failure, so none are left for the
+    next user of the connection */
+    for (x = 0; x < commands; x++) {
+        LDBoolean expected;
 
-    if (!redisCheckReply(reply, REDIS_REPLY_ARRAY)) {
-        goto cleanup;
-    }
+        if (redisGetReply(connection->connection, (void **)&reply) !=
+            REDIS_OK)
+        {
+            /* the connection is in error and will not be reused */
+            success = LDBooleanFalse;
 
-    success = LDBooleanTrue;
+            goto cleanup;
+        }
+
+        if (x == 0) {
+            expected = redisCheckStatus(reply, "OK");
+        } else if (x + 1 == commands) {
+            expected = redisCheckReply(reply, REDIS_REPLY_ARRAY);
+        } else {
+            expected = redisCheckStatus(reply, "QUEUED");
+        }
+
+        if (!expected) {
+            success = LDBooleanFalse;
+        }
+
+        resetReply(&reply);
+    }
 
 cleanup:
     resetReply(&reply);
 
+    /* commands partially appended must never be sent by another user */
+    if (connection && !appended && connection->connection->err == 0) {
+        connection->connection->err = REDIS_ERR_OTHER;
+    }
+
     returnConnection(context, connection);
 
+    LDFree(argv);
+    LDFree(argvlen);
+    LDFree(itemsHash);
+
     return success;
 }
 
+/* returns a string or nil reply for the item */
 static LDBoolean
-storeGet(
-    void *const                         contextRaw,
-    const char *const                   kind,
-    const char *const                   key,
-    struct LDStoreCollectionItem *const result)
+commandGet(
+    struct Context *const context,
+    const char *const     kind,
+    const char *const     key,
+    redisReply **const    result)
 {
-    struct Context *   context;
     struct Connection *connection;
-    struct LDJSON *    feature;
     redisReply *       reply;
-    LDBoolean          success;
-
-    LD_LOG(LD_LOG_TRACE, "redis storeGet");
 
-    LD_ASSERT(contextRaw);
+    LD_ASSERT(context);
     LD_ASSERT(kind);
     LD_ASSERT(key);
     LD_ASSERT(result);
 
-    context    = (struct Context *)contextRaw;
-    connection = NULL;
-    feature    = NULL;
-    reply      = NULL;
-    success    = LDBooleanFalse;
+    *result = NULL;
 
     if (!(connection = borrowConnection(context))) {
-        goto cleanup;
+        return LDBooleanFalse;
     }
 
     reply = redisCommand(
@@ -440,42 +586,332 @@ storeGet(
         kind,
         key);
 
+    returnConnection(context, connection);
+
+    if (reply && reply->type != REDIS_REPLY_NIL &&
+        !redisCheckReply(reply, REDIS_REPLY_STRING))
+    {
+        resetReply(&reply);
+    }
+
     if (!reply) {
-        goto cleanup;
-    } else if (reply->type == REDIS_REPLY_NIL) {
-        result->buffer = NULL;
+        return LDBooleanFalse;
+    }
 
-        success = LDBooleanTrue;
+    *result = reply;
+
+    return LDBooleanTrue;
+}
+
+/* returns an array reply of alternating field names and items */
+static LDBoolean
+commandAll(
+    struct Context *const context,
+    const char *const     kind,
+    redisReply **const    result)
+{
+    struct Connection *connection;
+    redisReply *       reply;
+    size_t             i;
+
+    LD_ASSERT(context);
+    LD_ASSERT(kind);
+    LD_ASSERT(result);
+
+    *result = NULL;
+
+    if (!(connection = borrowConnection(context))) {
+        return LDBooleanFalse;
+    }
+
+    reply = redisCommand(
+        connection->connection,
+        "HGETALL %s:%s",
+        LDRedisConfigGetPrefix(context->config),
+        kind);
+
+    returnConnection(context, connection);
+
+    if (!redisCheckReply(reply, REDIS_REPLY_ARRAY)) {
+        goto error;
+    }
 
+    for (i = 1; i < reply->elements; i += 2) {
+        if (!redisCheckReply(reply->element[i], REDIS_REPLY_STRING)) {
+            LD_LOG(LD_LOG_ERROR, "not a string");
+
+            goto error;
+        }
+    }
+
+    *result = reply;
+
+    return LDBooleanTrue;
+
+error:
+    if (reply) {
+        resetReply(&reply);
+    }
+
+    return LDBooleanFalse;
+}
+
+/* items may be binary, so they are copied by length. the copy stays NUL
+terminated for items that are JSON text */
+static void *
+copyBuffer(const redisReply *const reply)
+{
+    char *buffer;
+
+    LD_ASSERT(reply);
+
+    if (!(buffer = (char *)LDAlloc(reply->len + 1))) {
+        return NULL;
+    }
+
+    memcpy(buffer, reply->str, reply->len);
+    buffer[reply->len] = '\0';
+
+    return buffer;
+}
+
+/* reads the version of a stored item from its compact header, parsing the
+item only when it is JSON text */
+static LDBoolean
+readVersion(const redisReply *const itemReply, unsigned int *const version)
+{
+    struct LDJSON *feature;
+
+    LD_ASSERT(itemReply);
+    LD_ASSERT(version);
+
+    if (LDi_compactItemVersion(itemReply->str, itemReply->len, version)) {
+        return LDBooleanTrue;
+    }
+
+    if (!(feature = LDJSONDeserialize(itemReply->str))) {
+        return LDBooleanFalse;
+    }
+
+    *version = LDi_getFeatureVersion(feature);
+
+    LDJSONFree(feature);
+
+    return LDBooleanTrue;
+}
+
+/* HMGET fields from the items hash. the reply is an array of keyCount
+elements */
+static LDBoolean
+commandGetMany(
+    struct Context *const    context,
+    const char *const        kind,
+    const char *const *const keys,
+    const unsigned int       keyCount,
+    redisReply **const       result)
+{
+    struct Connection *connection;
+    redisReply *       reply;
+    const char **      argv;
+    size_t *           argvlen;
+    char *             itemsHash;
+    unsigned int       i;
+    LDBoolean          success;
+
+    LD_ASSERT(context);
+    LD_ASSERT(kind);
+    LD_ASSERT(keys);
+    LD_ASSERT(result);
+
+    connection = NULL;
+    reply      = NULL;
+    argv       = NULL;
+    argvlen    = NULL;
+    itemsHash  = NULL;
+    success    = LDBooleanFalse;
+    *result    = NULL;
+
+    if (!(itemsHash = makeHashKey(context, kind))) {
         goto cleanup;
-    } else if (!redisCheckReply(reply, REDIS_REPLY_STRING)) {
+    }
+
+    if (!(argv = (const char **)LDAlloc(sizeof(char *) * (keyCount + 2)))) {
         goto cleanup;
-    } else if (!(feature = LDJSONDeserialize(reply->str))) {
+    }
+
+    if (!(argvlen = (size_t *)LDAlloc(sizeof(size_t) * (keyCount + 2)))) {
         goto cleanup;
-    } else if (!(result->buffer = LDStrDup(reply->str))) {
+    }
+
+    argv[0]    = "HMGET";
+    argvlen[0] = strlen(argv[0]);
+    argv[1]    = itemsHash;
+    argvlen[1] = strlen(itemsHash);
+
+    for (i = 0; i < keyCount; i++) {
+        argv[i + 2]    = keys[i];
+        argvlen[i + 2] = strlen(keys[i]);
+    }
+
+    if (!(connection = borrowConnection(context))) {
         goto cleanup;
     }
 
-    if (result->buffer) {
-        result->bufferSize = strlen(reply->str);
-        result->version    = LDi_getFeatureVersion(feature);
-    } else {
-        result->bufferSize = 0;
-        result->version    = 0;
+    reply = redisCommandArgv(
+        connection->connection, (int)keyCount + 2, argv, argvlen);
+
+    if (!redisCheckReply(reply, REDIS_REPLY_ARRAY) ||
+        reply->elements != keyCount)
+    {
+        LD_LOG(LD_LOG_ERROR, "redis HMGET returned an unexpected reply");
+
+        goto cleanup;
     }
 
+    *result = reply;
+    reply   = NULL;
     success = LDBooleanTrue;
 
 cleanup:
-    LDJSONFree(feature);
+    returnConnection(context, connection);
+    resetReply(&reply);
+
+    LDFree(argv);
+    LDFree(argvlen);
+    LDFree(itemsHash);
+
+    return success;
+}
+
+static LDBoolean
+storeGetMany(
+    void *const                         contextRaw,
+    const char *const                   kind,
+    const char *const *const            keys,
+    const unsigned int                  keyCount,
+    struct LDStoreCollectionItem *const results)
+{
+    redisReply * reply;
+    LDBoolean    success;
+    unsigned int i;
+
+    LD_LOG(LD_LOG_TRACE, "redis storeGetMany");
+
+    LD_ASSERT(contextRaw);
+    LD_ASSERT(kind);
+    LD_ASSERT(keys);
+    LD_ASSERT(results);
+
+    reply   = NULL;
+    success = LDBooleanFalse;
+
+    memset(results, 0, sizeof(struct LDStoreCollectionItem) * keyCount);
+
+    if (!commandGetMany(
+            (struct Context *)contextRaw, kind, keys, keyCount, &reply)) {
+        return LDBooleanFalse;
+    }
+
+    /* the version is only read by the store for missing items */
+    for (i = 0; i < keyCount; i++) {
+        redisReply *const element = reply->element[i];
+
+        if (element->type == REDIS_REPLY_NIL) {
+            continue;
+        } else if (!redisCheckReply(element, REDIS_REPLY_STRING)) {
+            goto cleanup;
+        } else if (!(results[i].buffer = copyBuffer(element))) {
+            goto cleanup;
+        }
+
+        results[i].bufferSize = element->len;
+    }
 
+    success = LDBooleanTrue;
+
+cleanup:
     resetReply(&reply);
 
-    returnConnection(context, connection);
+    if (!success) {
+        for (i = 0; i < keyCount; i++) {
+            LDFree(results[i].buffer);
+            results[i].buffer = NULL;
+        }
+    }
 
     return success;
 }
 
+static LDBoolean
+storeGet(
+    void *const                         contextRaw,
+    const char *const                   kind,
+    const char *const                   key,
+    struct LDStoreCollectionItem *const result)
+{
+    LD_LOG(LD_LOG_TRACE, "redis storeGet");
+
+    LD_ASSERT(contextRaw);
+    LD_ASSERT(kind);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+
+    return storeGetMany(contextRaw, kind, &key, 1, result);
+}
+
+/* items lent out by the borrowed functions, freed by storeRelease */
+struct Borrowed
+{
+    redisReply *                  reply;
+    struct LDStoreCollectionItem *items;
+};
+
+static LDBoolean
+storeGetBorrowed(
+    void *const                         contextRaw,
+    const char *const                   kind,
+    const char *const                   key,
+    struct LDStoreCollectionItem *const result,
+    void **const                        token)
+{
+    struct Borrowed *borrowed;
+
+    LD_LOG(LD_LOG_TRACE, "redis storeGetBorrowed");
+
+    LD_ASSERT(contextRaw);
+    LD_ASSERT(kind);
+    LD_ASSERT(key);
+    LD_ASSERT(result);
+    LD_ASSERT(token);
+
+    if (!(borrowed = (struct Borrowed *)LDAlloc(sizeof(struct Borrowed)))) {
+        return LDBooleanFalse;
+    }
+
+    borrowed->items = NULL;
+
+    if (!commandGet(
+            (struct Context *)contextRaw, kind, key, &borrowed->reply)) {
+        LDFree(borrowed);
+
+        return LDBooleanFalse;
+    }
+
+    /* the version is only read by the store for missing items */
+    if (borrowed->reply->type == REDIS_REPLY_NIL) {
+        result->buffer     = NULL;
+        result->bufferSize = 0;
+    } else {
+        result->buffer     = borrowed->reply->str;
+        result->bufferSize = borrowed->reply->len;
+    }
+
+    result->version = 0;
+    *token          = borrowed;
+
+    return LDBooleanTrue;
+}
+
 static LDBoolean
 storeAll(
     void *const                          contextRaw,
@@ -485,18 +921,17 @@ storeAll(
 {
     struct Context *              context;
     redisReply *                  reply;
-    struct Connection *           connection;
     LDBoolean                     success;
-    unsigned int                  i;
-    struct LDStoreCollectionItem *collection, *collectionIter;
+    unsigned int                  i, count;
+    struct LDStoreCollectionItem *collection;
     size_t                        resultBytes;
-    struct LDJSON *               feature;
 
     LD_LOG(LD_LOG_TRACE, "redis storeAll");
 
     LD_ASSERT(contextRaw);
     LD_ASSERT(kind);
     LD_ASSERT(result);
+    LD_ASSERT(resultCount);
 
     context      = (struct Context *)contextRaw;
     reply        = NULL;
@@ -504,32 +939,20 @@ storeAll(
     *result      = NULL;
     *resultCount = 0;
     collection   = NULL;
-    resultBytes  = 0;
-    feature      = NULL;
 
-    if (!(connection = borrowConnection(context))) {
-        goto cleanup;
+    if (!commandAll(context, kind, &reply)) {
+        return LDBooleanFalse;
     }
 
-    reply = redisCommand(
-        connection->connection,
-        "HGETALL %s:%s",
-        LDRedisConfigGetPrefix(context->config),
-        kind);
+    count       = reply->elements / 2;
+    resultBytes = sizeof(struct LDStoreCollectionItem) * count;
 
-    if (reply->type == REDIS_REPLY_NIL) {
+    if (count == 0) {
         success = LDBooleanTrue;
 
         goto cleanup;
     }
 
-    if (!redisCheckReply(reply, REDIS_REPLY_ARRAY)) {
-        goto cleanup;
-    }
-
-    *resultCount = reply->elements / 2;
-    resultBytes  = sizeof(struct LDStoreCollectionItem) * (*resultCount);
-
     if (!(collection = (struct LDStoreCollectionItem *)LDAlloc(resultBytes))) {
         LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
 
@@ -538,56 +961,121 @@ storeAll(
 
     memset(collection, 0, resultBytes);
 
-    collectionIter = collection;
-
-    for (i = 0; i < reply->elements; i++) {
-        const char *raw;
+    /* the version is only read by the store for missing items */
+    for (i = 0; i < count; i++) {
         /* skip name field */
-        i++;
+        const redisReply *const element = reply->element[i * 2 + 1];
 
-        if (!redisCheckReply(reply->element[i], REDIS_REPLY_STRING)) {
-            LD_LOG(LD_LOG_ERROR, "not a string");
+        LD_ASSERT(element->str);
 
+        if (!(collection[i].buffer = copyBuffer(element))) {
             goto cleanup;
         }
 
-        raw = reply->element[i]->str;
-        LD_ASSERT(raw);
+        collection[i].bufferSize = element->len;
+    }
 
-        if (!(feature = LDJSONDeserialize(raw))) {
-            goto cleanup;
-        }
+    *result      = collection;
+    *resultCount = count;
+    success      = LDBooleanTrue;
 
-        if (!(collectionIter->buffer = LDStrDup(raw))) {
-            goto cleanup;
+cleanup:
+    resetReply(&reply);
+
+    if (!success && collection) {
+        for (i = 0; i < count; i++) {
+            LDFree(collection[i].buffer);
         }
 
-        collectionIter->bufferSize = strlen(raw);
-        collectionIter->version    = LDi_getFeatureVersion(feature);
+        LDFree(collection);
+    }
+
+    return success;
+}
+
+static LDBoolean
+storeAllBorrowed(
+    void *const                          contextRaw,
+    const char *const                    kind,
+    struct LDStoreCollectionItem **const result,
+    unsigned int *const                  resultCount,
+    void **const                         token)
+{
+    struct Borrowed *borrowed;
+    unsigned int     i, count;
+    size_t           resultBytes;
+
+    LD_LOG(LD_LOG_TRACE, "redis storeAllBorrowed");
 
-        LDJSONFree(feature);
-        feature = NULL;
+    LD_ASSERT(contextRaw);
+    LD_ASSERT(kind);
+    LD_ASSERT(result);
+    LD_ASSERT(resultCount);
+    LD_ASSERT(token);
+
+    *result      = NULL;
+    *resultCount = 0;
 
-        collectionIter++;
+    if (!(borrowed = (struct Borrowed *)LDAlloc(sizeof(struct Borrowed)))) {
+        return LDBooleanFalse;
     }
 
-    *result = collection;
-    success = LDBooleanTrue;
+    borrowed->items = NULL;
 
-cleanup:
-    LDJSONFree(feature);
+    if (!commandAll((struct Context *)contextRaw, kind, &borrowed->reply)) {
+        LDFree(borrowed);
 
-    resetReply(&reply);
-    returnConnection(context, connection);
+        return LDBooleanFalse;
+    }
 
-    if (!success) {
-        for (i = 0; i < *resultCount; i++) {
-            LDFree(collection[i].buffer);
+    count       = borrowed->reply->elements / 2;
+    resultBytes = sizeof(struct LDStoreCollectionItem) * count;
+
+    if (count > 0) {
+        if (!(borrowed->items =
+                  (struct LDStoreCollectionItem *)LDAlloc(resultBytes))) {
+            LD_LOG(LD_LOG_ERROR, "LDAlloc failed");
+
+            resetReply(&borrowed->reply);
+            LDFree(borrowed);
+
+            return LDBooleanFalse;
         }
-        LDFree(collection);
     }
 
-    return success;
+    /* items point into the reply, the store only reads versions of missing
+    items */
+    for (i = 0; i < count; i++) {
+        const redisReply *const element = borrowed->reply->element[i * 2 + 1];
+
+        borrowed->items[i].buffer     = element->str;
+        borrowed->items[i].bufferSize = element->len;
+        borrowed->items[i].version    = 0;
+    }
+
+    *result      = borrowed->items;
+    *resultCount = count;
+    *token       = borrowed;
+
+    return LDBooleanTrue;
+}
+
+static void
+storeRelease(void *const contextRaw, void *const token)
+{
+    struct Borrowed *borrowed;
+
+    LD_LOG(LD_LOG_TRACE, "redis storeRelease");
+
+    LD_ASSERT(token);
+
+    (void)contextRaw;
+
+    borrowed = (struct Borrowed *)token;
+
+    resetReply(&borrowed->reply);
+    LDFree(borrowed->items);
+    LDFree(borrowed);
 }
 
 LDBoolean
@@ -600,10 +1088,11 @@ storeUpsertInternal(
 {
     struct Context *   context;
     redisReply *       reply;
-    struct LDJSON *    existing;
     struct Connection *connection;
     char *             serialized;
-    LDBoolean          success;
+    size_t             serializedSize;
+    LDBoolean          success, exists;
+    unsigned int       existingVersion;
 
     LD_LOG(LD_LOG_TRACE, "redis storeUpsertInternal");
 
@@ -612,12 +1101,12 @@ storeUpsertInternal(
     LD_ASSERT(feature);
     LD_ASSERT(featureKey);
 
-    context    = (struct Context *)contextRaw;
-    reply      = NULL;
-    serialized = NULL;
-    existing   = NULL;
-    connection = NULL;
-    success    = LDBooleanFalse;
+    context        = (struct Context *)contextRaw;
+    reply          = NULL;
+    serialized     = NULL;
+    serializedSize = 0;
+    connection     = NULL;
+    success        = LDBooleanFalse;
 
     if (!(connection = borrowConnection(context))) {
         goto cleanup;
@@ -646,32 +1135,27 @@ storeUpsertInternal(
         if (!reply) {
             goto cleanup;
         } else if (reply->type == REDIS_REPLY_NIL) {
-            /* does not exist */
+            exists = LDBooleanFalse;
         } else if (!redisCheckReply(reply, REDIS_REPLY_STRING)) {
             goto cleanup;
-        } else if ((existing = LDJSONDeserialize(reply->str))) {
-            if (LDi_isFeatureDeleted(existing)) {
-                LDJSONFree(existing);
-
-                existing = NULL;
-            }
-        } else {
+        } else if (!readVersion(reply, &existingVersion)) {
             goto cleanup;
+        } else {
+            exists = LDBooleanTrue;
         }
 
         resetReply(&reply);
 
-        if (existing && LDi_getFeatureVersion(existing) >= feature->version) {
+        /* deleted items keep their version so older updates stay ignored */
+        if (exists && existingVersion >= feature->version) {
             success = LDBooleanTrue;
 
             goto cleanup;
         }
 
-        LDJSONFree(existing);
-        existing = NULL;
-
         if (feature->buffer) {
-            serialized = feature->buffer;
+            serialized     = feature->buffer;
+            serializedSize = feature->bufferSize;
         } else {
             struct LDJSON *placeholder;
 
@@ -687,6 +1171,8 @@ storeUpsertInternal(
             if (!serialized) {
                 goto cleanup;
             }
+
+            serializedSize = strlen(serialized);
         }
 
         if (hook) {
@@ -705,11 +1191,12 @@ storeUpsertInternal(
 
         reply = redisCommand(
             connection->connection,
-            "HSET %s:%s %s %s",
+            "HSET %s:%s %s %b",
             LDRedisConfigGetPrefix(context->config),
             kind,
             featureKey,
-            serialized);
+            serialized,
+            serializedSize);
 
         if (!redisCheckStatus(reply, "QUEUED")) {
             LD_LOG(LD_LOG_ERROR, "Redis expected OK");
@@ -747,8 +1234,6 @@ cleanup:
         LDFree(serialized);
     }
 
-    LDJSONFree(existing);
-
     resetReply(&reply);
 
     returnConnection(context, connection);
@@ -867,13 +1352,18 @@ LDStoreInterfaceRedisNew(struct LDRedisConfig *const config)
     LDi_mutex_init(&context->lock);
     LDi_cond_init(&context->condition);
 
-    handle->context     = context;
-    handle->init        = storeInit;
-    handle->get         = storeGet;
-    handle->all         = storeAll;
-    handle->upsert      = storeUpsert;
-    handle->initialized = storeInitialized;
-    handle->destructor  = storeDestructor;
+    handle->context      = context;
+    handle->init         = storeInit;
+    handle->get          = storeGet;
+    handle->all          = storeAll;
+    handle->upsert       = storeUpsert;
+    handle->initialized  = storeInitialized;
+    handle->destructor   = storeDestructor;
+    handle->getMany      = storeGetMany;
+    handle->getBorrowed  = storeGetBorrowed;
+    handle->allBorrowed  = storeAllBorrowed;
+    handle->release      = storeRelease;
+    handle->compactItems = LDBooleanTrue;
 
     return handle;
 
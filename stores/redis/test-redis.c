@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <string.h>
 
 #include <launchdarkly/api.h>
@@ -35,7 +36,7 @@ prepareEmptyStore()
     flushDB();
 
     LD_ASSERT(config = LDConfigNew(""));
-    LD_ASSERT(redisConfig = LDRedisConfigNew())
+    LD_ASSERT(redisConfig = LDRedisConfigNew());
     LD_ASSERT(interface = LDStoreInterfaceRedisNew(redisConfig));
     LDConfigSetFeatureStoreBackend(config, interface);
     LD_ASSERT(store = LDStoreNew(config));
@@ -74,7 +75,7 @@ testWriteConflict()
     flushDB();
 
     LD_ASSERT(config = LDConfigNew(""));
-    LD_ASSERT(redisConfig = LDRedisConfigNew())
+    LD_ASSERT(redisConfig = LDRedisConfigNew());
     LD_ASSERT(interface = LDStoreInterfaceRedisNew(redisConfig));
     LDConfigSetFeatureStoreBackend(config, interface);
     LD_ASSERT(concurrentStore = LDStoreNew(config));
@@ -107,6 +108,194 @@ testWriteConflict()
     LDConfigFree(config);
 }
 
+/* -1 when absent */
+static int
+storedVersion(redisContext *const connection, const char *const key)
+{
+    redisReply *   reply;
+    struct LDJSON *flag;
+    int            version;
+
+    LD_ASSERT(
+        reply = redisCommand(
+            connection, "HGET launchdarkly:features %s", key));
+
+    if (reply->type == REDIS_REPLY_NIL) {
+        freeReplyObject(reply);
+
+        return -1;
+    }
+
+    LD_ASSERT(reply->type == REDIS_REPLY_STRING);
+    LD_ASSERT(flag = LDJSONDeserialize(reply->str));
+    version = LDi_getFeatureVersion(flag);
+
+    LDJSONFree(flag);
+    freeReplyObject(reply);
+
+    return version;
+}
+
+static void
+testUpsertComparesStoredVersion()
+{
+    struct LDStore *  store;
+    struct LDJSONRC * lookup;
+    redisContext *    connection;
+    redisReply *      reply;
+    char *            serialized;
+    struct LDJSON *   flag;
+
+    store = prepareEmptyStore();
+
+    LD_ASSERT(LDStoreInitEmpty(store));
+    LD_ASSERT(LDStoreUpsert(
+        store,
+        LD_FLAG,
+        makeMinimalFlag("abc", 50, LDBooleanTrue, LDBooleanFalse)));
+
+    LD_ASSERT(connection = redisConnect("127.0.0.1", 6379));
+    LD_ASSERT(!connection->err);
+
+    LD_ASSERT(storedVersion(connection, "abc") == 50);
+
+    /* an item written by another writer is compared by its own version */
+    LD_ASSERT(flag = makeMinimalFlag("def", 20, LDBooleanTrue, LDBooleanFalse));
+    LD_ASSERT(serialized = LDJSONSerialize(flag));
+    LD_ASSERT(
+        reply = redisCommand(
+            connection, "HSET launchdarkly:features def %s", serialized));
+    freeReplyObject(reply);
+    LDFree(serialized);
+    LDJSONFree(flag);
+
+    LD_ASSERT(LDStoreUpsert(
+        store,
+        LD_FLAG,
+        makeMinimalFlag("def", 10, LDBooleanTrue, LDBooleanFalse)));
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "def", &lookup));
+    LD_ASSERT(lookup);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(lookup)) == 20);
+    LDJSONRCDecrement(lookup);
+
+    /* an older update does not replace a newer item from another writer */
+    LD_ASSERT(flag = makeMinimalFlag("abc", 70, LDBooleanTrue, LDBooleanFalse));
+    LD_ASSERT(serialized = LDJSONSerialize(flag));
+    LD_ASSERT(
+        reply = redisCommand(
+            connection, "HSET launchdarkly:features abc %s", serialized));
+    freeReplyObject(reply);
+    LDFree(serialized);
+    LDJSONFree(flag);
+
+    LD_ASSERT(LDStoreUpsert(
+        store,
+        LD_FLAG,
+        makeMinimalFlag("abc", 60, LDBooleanTrue, LDBooleanFalse)));
+
+    LD_ASSERT(storedVersion(connection, "abc") == 70);
+
+    redisFree(connection);
+
+    LDStoreDestroy(store);
+}
+
+static void
+testCompactItems()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *interface;
+    struct LDRedisConfig *   redisConfig;
+    struct LDConfig *        config;
+    struct LDJSONRC *        lookup;
+    struct LDJSON *          flag;
+
+    flushDB();
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LD_ASSERT(redisConfig = LDRedisConfigNew());
+    LD_ASSERT(interface = LDStoreInterfaceRedisNew(redisConfig));
+    LDConfigSetFeatureStoreBackend(config, interface);
+    LDConfigSetFeatureStoreBackendCompactItems(config, LDBooleanTrue);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    LD_ASSERT(flag = makeMinimalFlag("abc", 50, LDBooleanTrue, LDBooleanFalse));
+    LD_ASSERT(LDStoreInitEmpty(store));
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, LDJSONDuplicate(flag)));
+
+    /* the stored version is read from the compact item header */
+    LD_ASSERT(LDStoreUpsert(
+        store,
+        LD_FLAG,
+        makeMinimalFlag("abc", 40, LDBooleanTrue, LDBooleanFalse)));
+
+    LDi_expireAll(store);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &lookup));
+    LD_ASSERT(lookup);
+    LD_ASSERT(LDJSONCompare(LDJSONRCGet(lookup), flag));
+    LDJSONRCDecrement(lookup);
+
+    LDJSONFree(flag);
+    LDStoreDestroy(store);
+}
+
+static void
+testInitPipelined()
+{
+    struct LDStore * store;
+    struct LDJSONRC *lookup;
+    struct LDJSON *  sets, *flags;
+    redisContext *   connection;
+    redisReply *     reply;
+    unsigned int     i;
+    char             key[16];
+
+    store = prepareEmptyStore();
+
+    /* more items than one HSET command holds */
+    LD_ASSERT(sets = LDNewObject());
+    LD_ASSERT(flags = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(sets, "features", flags));
+    LD_ASSERT(LDObjectSetKey(sets, "segments", LDNewObject()));
+
+    for (i = 0; i < 1200; i++) {
+        snprintf(key, sizeof(key), "flag%u", i);
+
+        LD_ASSERT(LDObjectSetKey(
+            flags,
+            key,
+            makeMinimalFlag(key, i + 1, LDBooleanTrue, LDBooleanFalse)));
+    }
+
+    LD_ASSERT(LDStoreInit(store, sets));
+
+    LD_ASSERT(connection = redisConnect("127.0.0.1", 6379));
+    LD_ASSERT(!connection->err);
+
+    LD_ASSERT(reply = redisCommand(connection, "HLEN launchdarkly:features"));
+    LD_ASSERT(reply->type == REDIS_REPLY_INTEGER);
+    LD_ASSERT(reply->integer == 1200);
+    freeReplyObject(reply);
+
+    LD_ASSERT(storedVersion(connection, "flag1199") == 1200);
+
+    redisFree(connection);
+
+    /* the connection is left usable */
+    LDi_expireAll(store);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "flag600", &lookup));
+    LD_ASSERT(lookup);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(lookup)) == 601);
+    LDJSONRCDecrement(lookup);
+
+    LDStoreDestroy(store);
+}
+
 int
 main()
 {
@@ -114,6 +303,9 @@ main()
 
     runSharedStoreTests(prepareEmptyStore);
     testWriteConflict();
+    testUpsertComparesStoredVersion();
+    testCompactItems();
+    testInitPipelined();
 
     return 0;
 }
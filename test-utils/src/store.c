@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
@@ -60,6 +62,37 @@ getAll(struct LDStore *const store)
     LD_ASSERT(LDStoreInitialized(store));
 }
 
+static void
+initKindsSeparate(struct LDStore *const store)
+{
+    struct LDJSON *  all, *flags, *segments;
+    struct LDJSONRC *lookup;
+
+    LD_ASSERT(all = LDNewObject());
+    LD_ASSERT(flags = LDNewObject());
+    LD_ASSERT(segments = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(all, "features", flags));
+    LD_ASSERT(LDObjectSetKey(all, "segments", segments));
+    LD_ASSERT(LDObjectSetKey(flags, "a", makeVersioned("a", 3)));
+    LD_ASSERT(LDObjectSetKey(segments, "a", makeVersioned("a", 5)));
+    LD_ASSERT(LDObjectSetKey(segments, "b", makeVersioned("b", 7)));
+
+    LD_ASSERT(LDStoreInit(store, all));
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "a", &lookup));
+    LD_ASSERT(lookup);
+    LD_ASSERT(LDi_getFeatureVersionTrusted(LDJSONRCGet(lookup)) == 3);
+    LDJSONRCDecrement(lookup);
+
+    LD_ASSERT(LDStoreGet(store, LD_SEGMENT, "a", &lookup));
+    LD_ASSERT(lookup);
+    LD_ASSERT(LDi_getFeatureVersionTrusted(LDJSONRCGet(lookup)) == 5);
+    LDJSONRCDecrement(lookup);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "b", &lookup));
+    LD_ASSERT(!lookup);
+}
+
 static void
 testUpsertUpdatesAll(struct LDStore *const store)
 {
@@ -96,6 +129,125 @@ testUpsertUpdatesAll(struct LDStore *const store)
     LDJSONFree(all);
 }
 
+static void
+allEmptyAfterInit(struct LDStore *const store)
+{
+    struct LDJSONRC *result;
+
+    LD_ASSERT(LDStoreInitEmpty(store));
+
+    LD_ASSERT(LDStoreAll(store, LD_SEGMENT, &result));
+    LD_ASSERT(result);
+    LD_ASSERT(LDJSONGetType(LDJSONRCGet(result)) == LDObject);
+    LD_ASSERT(LDCollectionGetSize(LDJSONRCGet(result)) == 0);
+    LDJSONRCDecrement(result);
+}
+
+static void
+snapshotIsConsistent(struct LDStore *const store)
+{
+    struct LDStoreSnapshot *snapshot;
+    struct LDJSON *         feature;
+
+    LD_ASSERT(LDStoreInitEmpty(store));
+
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, makeVersioned("a", 1)));
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, makeVersioned("b", 1)));
+    LD_ASSERT(LDStoreRemove(store, LD_FLAG, "b", 2));
+
+    LD_ASSERT(LDStoreSnapshotNew(store, LD_FLAG, &snapshot));
+    LD_ASSERT(LDStoreSnapshotCount(snapshot) == 1);
+
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, makeVersioned("a", 2)));
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, makeVersioned("c", 1)));
+
+    feature = LDJSONRCGet(LDStoreSnapshotItem(snapshot, 0));
+    LD_ASSERT(strcmp(LDGetText(LDObjectLookup(feature, "key")), "a") == 0);
+    LD_ASSERT(LDi_getFeatureVersionTrusted(feature) == 1);
+
+    LDStoreSnapshotFree(snapshot);
+
+    LD_ASSERT(LDStoreSnapshotNew(store, LD_FLAG, &snapshot));
+    LD_ASSERT(LDStoreSnapshotCount(snapshot) == 2);
+    LDStoreSnapshotFree(snapshot);
+}
+
+static void
+initReplacesGeneration(struct LDStore *const store)
+{
+    struct LDJSON *  all, *flags;
+    struct LDJSONRC *held, *lookup;
+
+    LD_ASSERT(all = LDNewObject());
+    LD_ASSERT(flags = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(all, "features", flags));
+    LD_ASSERT(LDObjectSetKey(flags, "a", makeVersioned("a", 1)));
+    LD_ASSERT(LDObjectSetKey(flags, "b", makeVersioned("b", 1)));
+    LD_ASSERT(LDStoreInit(store, all));
+
+    /* replace one item of the generation individually */
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, makeVersioned("b", 2)));
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "a", &held));
+    LD_ASSERT(held);
+
+    LD_ASSERT(all = LDNewObject());
+    LD_ASSERT(flags = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(all, "features", flags));
+    LD_ASSERT(LDObjectSetKey(flags, "c", makeVersioned("c", 1)));
+    LD_ASSERT(LDStoreInit(store, all));
+
+    /* references outlive the generation that produced them */
+    LD_ASSERT(LDi_getFeatureVersionTrusted(LDJSONRCGet(held)) == 1);
+    LDJSONRCDecrement(held);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "a", &lookup));
+    LD_ASSERT(!lookup);
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "b", &lookup));
+    LD_ASSERT(!lookup);
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "c", &lookup));
+    LD_ASSERT(lookup);
+    LDJSONRCDecrement(lookup);
+}
+
+static void
+memoryStats(struct LDStore *const store)
+{
+    struct LDJSON *stats, *big, *tmp, *largest;
+
+    LD_ASSERT(LDStoreInitEmpty(store));
+
+    LD_ASSERT(big = makeVersioned("big", 1));
+    LD_ASSERT(
+        tmp = LDNewText("a much longer string value than any other flag has"));
+    LD_ASSERT(LDObjectSetKey(big, "padding", tmp));
+
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, makeVersioned("a", 1)));
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, big));
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, makeVersioned("b", 1)));
+    LD_ASSERT(LDStoreUpsert(store, LD_SEGMENT, makeVersioned("s", 1)));
+
+    LD_ASSERT(LDStoreMemoryStats(store, 2, &stats));
+
+    tmp = LDObjectLookup(stats, "features");
+    LD_ASSERT(LDGetNumber(LDObjectLookup(tmp, "items")) == 3);
+    LD_ASSERT(LDGetNumber(LDObjectLookup(tmp, "bytes")) > 0);
+
+    tmp = LDObjectLookup(stats, "segments");
+    LD_ASSERT(LDGetNumber(LDObjectLookup(tmp, "items")) == 1);
+
+    largest = LDObjectLookup(stats, "largestFlags");
+    LD_ASSERT(LDCollectionGetSize(largest) == 2);
+
+    tmp = LDArrayLookup(largest, 0);
+    LD_ASSERT(strcmp(LDGetText(LDObjectLookup(tmp, "key")), "big") == 0);
+    LD_ASSERT(
+        LDGetNumber(LDObjectLookup(tmp, "bytes")) >
+        LDGetNumber(LDObjectLookup(LDArrayLookup(largest, 1), "bytes")));
+
+    LDJSONFree(stats);
+}
+
 static void
 deletedOnly(struct LDStore *const store)
 {
@@ -351,7 +503,12 @@ runSharedStoreTests(struct LDStore *(*const prepareEmptyStore)())
         allocateAndFree,
         initializeEmpty,
         getAll,
+        initKindsSeparate,
         testUpsertUpdatesAll,
+        allEmptyAfterInit,
+        snapshotIsConsistent,
+        memoryStats,
+        initReplacesGeneration,
         deletedOnly,
         basicExists,
         basicDoesNotExist,
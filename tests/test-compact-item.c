@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "compact_item.h"
+#include "utility.h"
+
+static const char *const flagJSON =
+    "{\"key\": \"flag\", \"version\": 3000000000, \"on\": true,"
+    "\"salt\": \"s\\u00e9l\", \"offVariation\": null,"
+    "\"variations\": [-1, 0.1, -2.5e-300, 1e300, 1617000000000, \"\", {}],"
+    "\"rules\": [{\"clauses\": [{\"attribute\": \"custom\","
+    "\"op\": \"semVerLessThan\", \"values\": [\"1.0.0\"],"
+    "\"negate\": false}]}], \"custom\": {\"nested\": [[], [[]]]}}";
+
+static void
+testRoundTrip()
+{
+    struct LDJSON *flag, *decoded;
+    void *         buffer;
+    size_t         size;
+    unsigned int   version;
+
+    LD_ASSERT(flag = LDJSONDeserialize(flagJSON));
+    LD_ASSERT(LDi_encodeCompactItem(flag, &buffer, &size));
+
+    LD_ASSERT(LDi_isCompactItem(buffer, size));
+    LD_ASSERT(LDi_compactItemVersion(buffer, size, &version));
+    LD_ASSERT(version == 3000000000U);
+
+    LD_ASSERT(decoded = LDi_decodeCompactItem(buffer, size));
+    LD_ASSERT(LDJSONCompare(flag, decoded));
+
+    LDJSONFree(flag);
+    LDJSONFree(decoded);
+    LDFree(buffer);
+}
+
+static void
+testRejectsMalformed()
+{
+    struct LDJSON *flag;
+    unsigned char *buffer;
+    size_t         size, i;
+    unsigned int   version;
+
+    LD_ASSERT(!LDi_isCompactItem(flagJSON, strlen(flagJSON)));
+    LD_ASSERT(!LDi_compactItemVersion(flagJSON, strlen(flagJSON), &version));
+
+    LD_ASSERT(flag = LDJSONDeserialize(flagJSON));
+    LD_ASSERT(LDi_encodeCompactItem(flag, (void **)&buffer, &size));
+
+    /* every truncation fails instead of reading past the end */
+    for (i = 0; i < size; i++) {
+        LD_ASSERT(!LDi_decodeCompactItem(buffer, i));
+    }
+
+    /* as do trailing bytes */
+    LD_ASSERT(buffer = (unsigned char *)LDRealloc(buffer, size + 1));
+    buffer[size] = 0;
+    LD_ASSERT(!LDi_decodeCompactItem(buffer, size + 1));
+
+    LDJSONFree(flag);
+    LDFree(buffer);
+}
+
+int
+main()
+{
+    LDBasicLoggerThreadSafeInitialize();
+    LDConfigureGlobalLogger(LD_LOG_TRACE, LDBasicLoggerThreadSafe);
+    LDGlobalInit();
+
+    testRoundTrip();
+    testRejectsMalformed();
+
+    LDBasicLoggerThreadSafeShutdown();
+
+    return 0;
+}
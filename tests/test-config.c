@@ -98,6 +98,54 @@ testDefaultAndReplace()
     LDConfigSetFeatureStoreBackendCacheTTL(config, 100);
     LD_ASSERT(config->storeCacheMilliseconds == 100);
 
+    LD_ASSERT(config->storeStaleMilliseconds == 0);
+    LDConfigSetFeatureStoreBackendStaleTTL(config, 200);
+    LD_ASSERT(config->storeStaleMilliseconds == 200);
+
+    LD_ASSERT(config->storeRefreshAheadReads == 0);
+    LDConfigSetFeatureStoreBackendRefreshAhead(config, 3);
+    LD_ASSERT(config->storeRefreshAheadReads == 3);
+
+    LD_ASSERT(config->storeCacheCapacity == 0);
+    LDConfigSetFeatureStoreBackendCacheCapacity(config, 500);
+    LD_ASSERT(config->storeCacheCapacity == 500);
+
+    LD_ASSERT(config->storeCacheMaxBytes == 0);
+    LDConfigSetFeatureStoreBackendCacheMaxBytes(config, 4096);
+    LD_ASSERT(config->storeCacheMaxBytes == 4096);
+
+    LD_ASSERT(config->storeCompactItems == LDBooleanFalse);
+    LDConfigSetFeatureStoreBackendCompactItems(config, LDBooleanTrue);
+    LD_ASSERT(config->storeCompactItems == LDBooleanTrue);
+
+    LD_ASSERT(config->storeWriteBehind == LDBooleanFalse);
+    LDConfigSetFeatureStoreBackendWriteBehind(config, LDBooleanTrue);
+    LD_ASSERT(config->storeWriteBehind == LDBooleanTrue);
+
+    LD_ASSERT(config->storeSoleWriter == LDBooleanFalse);
+    LDConfigSetFeatureStoreBackendSoleWriter(config, LDBooleanTrue);
+    LD_ASSERT(config->storeSoleWriter == LDBooleanTrue);
+
+    LD_ASSERT(config->storeWarmUp == LDBooleanFalse);
+    LDConfigSetFeatureStoreBackendWarmUp(config, LDBooleanTrue);
+    LD_ASSERT(config->storeWarmUp == LDBooleanTrue);
+
+    LD_ASSERT(config->storeSnapshotPath == NULL);
+    LD_ASSERT(LDConfigSetFeatureStoreSnapshotPath(config, "a.snapshot"));
+    LD_ASSERT(strcmp(config->storeSnapshotPath, "a.snapshot") == 0);
+    LD_ASSERT(LDConfigSetFeatureStoreSnapshotPath(config, "b.snapshot"));
+    LD_ASSERT(strcmp(config->storeSnapshotPath, "b.snapshot") == 0);
+    LD_ASSERT(LDConfigSetFeatureStoreSnapshotPath(config, NULL));
+    LD_ASSERT(config->storeSnapshotPath == NULL);
+
+    LD_ASSERT(config->fileDataSourcePath == NULL);
+    LD_ASSERT(LDConfigSetFileDataSource(config, "a.json"));
+    LD_ASSERT(strcmp(config->fileDataSourcePath, "a.json") == 0);
+    LD_ASSERT(LDConfigSetFileDataSource(config, "b.json"));
+    LD_ASSERT(strcmp(config->fileDataSourcePath, "b.json") == 0);
+    LD_ASSERT(LDConfigSetFileDataSource(config, NULL));
+    LD_ASSERT(config->fileDataSourcePath == NULL);
+
     LD_ASSERT(config->wrapperName == NULL);
     LD_ASSERT(config->wrapperVersion == NULL);
     LD_ASSERT(LDConfigSetWrapperInfo(config, "a", "b"));
@@ -0,0 +1,141 @@
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "dependencies.h"
+#include "utility.h"
+
+static struct LDJSON *
+makeFlag(const char *const raw)
+{
+    struct LDJSON *flag;
+
+    LD_ASSERT(flag = LDJSONDeserialize(raw));
+
+    return flag;
+}
+
+static LDBoolean
+containsKey(const struct LDJSON *const keys, const char *const key)
+{
+    const struct LDJSON *iter;
+
+    for (iter = LDGetIter(keys); iter; iter = LDIterNext(iter)) {
+        if (strcmp(LDGetText(iter), key) == 0) {
+            return LDBooleanTrue;
+        }
+    }
+
+    return LDBooleanFalse;
+}
+
+static void
+updateIndex(
+    struct LDDependencyIndex *const index,
+    const char *const               key,
+    const char *const               raw)
+{
+    struct LDJSON *flag;
+
+    flag = raw ? makeFlag(raw) : NULL;
+
+    LD_ASSERT(LDDependencyIndexUpdate(index, key, flag));
+
+    LDJSONFree(flag);
+}
+
+static void
+testTransitiveChanges()
+{
+    struct LDDependencyIndex *index;
+    struct LDJSON *           changed;
+
+    LD_ASSERT(index = LDDependencyIndexNew());
+
+    updateIndex(
+        index,
+        "a",
+        "{\"key\": \"a\", \"version\": 1, "
+        "\"prerequisites\": [{\"key\": \"b\", \"variation\": 0}]}");
+    updateIndex(
+        index,
+        "b",
+        "{\"key\": \"b\", \"version\": 1, \"rules\": [{\"clauses\": "
+        "[{\"attribute\": \"\", \"op\": \"segmentMatch\", "
+        "\"values\": [\"s\"]}]}]}");
+    updateIndex(index, "c", "{\"key\": \"c\", \"version\": 1}");
+
+    LD_ASSERT(LDDependencyIndexMarkChanged(index, LD_SEGMENT, "s"));
+    LD_ASSERT(changed = LDDependencyIndexTakeChanged(index));
+    LD_ASSERT(LDCollectionGetSize(changed) == 2);
+    LD_ASSERT(containsKey(changed, "a"));
+    LD_ASSERT(containsKey(changed, "b"));
+    LDJSONFree(changed);
+
+    /* taking clears the set */
+    LD_ASSERT(changed = LDDependencyIndexTakeChanged(index));
+    LD_ASSERT(LDCollectionGetSize(changed) == 0);
+    LDJSONFree(changed);
+
+    /* updating a flag replaces its references */
+    updateIndex(index, "b", "{\"key\": \"b\", \"version\": 2}");
+
+    LD_ASSERT(LDDependencyIndexMarkChanged(index, LD_SEGMENT, "s"));
+    LD_ASSERT(changed = LDDependencyIndexTakeChanged(index));
+    LD_ASSERT(LDCollectionGetSize(changed) == 0);
+    LDJSONFree(changed);
+
+    /* removed flags no longer depend on anything */
+    updateIndex(index, "a", NULL);
+
+    LD_ASSERT(LDDependencyIndexMarkChanged(index, LD_FLAG, "b"));
+    LD_ASSERT(changed = LDDependencyIndexTakeChanged(index));
+    LD_ASSERT(LDCollectionGetSize(changed) == 1);
+    LD_ASSERT(containsKey(changed, "b"));
+    LDJSONFree(changed);
+
+    LDDependencyIndexFree(index);
+}
+
+static void
+testPrerequisiteCycle()
+{
+    struct LDDependencyIndex *index;
+    struct LDJSON *           changed;
+
+    LD_ASSERT(index = LDDependencyIndexNew());
+
+    updateIndex(
+        index,
+        "x",
+        "{\"key\": \"x\", \"version\": 1, "
+        "\"prerequisites\": [{\"key\": \"y\", \"variation\": 0}]}");
+    updateIndex(
+        index,
+        "y",
+        "{\"key\": \"y\", \"version\": 1, "
+        "\"prerequisites\": [{\"key\": \"x\", \"variation\": 0}]}");
+
+    LD_ASSERT(LDDependencyIndexMarkChanged(index, LD_FLAG, "x"));
+    LD_ASSERT(changed = LDDependencyIndexTakeChanged(index));
+    LD_ASSERT(LDCollectionGetSize(changed) == 2);
+    LDJSONFree(changed);
+
+    LDDependencyIndexFree(index);
+}
+
+int
+main()
+{
+    LDBasicLoggerThreadSafeInitialize();
+    LDConfigureGlobalLogger(LD_LOG_TRACE, LDBasicLoggerThreadSafe);
+    LDGlobalInit();
+
+    testTransitiveChanges();
+    testPrerequisiteCycle();
+
+    LDBasicLoggerThreadSafeShutdown();
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <launchdarkly/api.h>
+
+#include "assertion.h"
+#include "concurrency.h"
+#include "file_source.h"
+#include "utility.h"
+
+static const char *const FLAG_FILE = "test-file-source.json";
+
+static void
+writeFlagFile(const char *const contents)
+{
+    FILE *file;
+
+    LD_ASSERT(file = fopen(FLAG_FILE, "wb"));
+    LD_ASSERT(fputs(contents, file) >= 0);
+    LD_ASSERT(fclose(file) == 0);
+}
+
+static unsigned int initCount;
+static unsigned int upsertCount;
+
+static LDBoolean
+mockInit(
+    void *const                          context,
+    const struct LDStoreCollectionState *collections,
+    const unsigned int                   collectionCount)
+{
+    (void)context;
+    (void)collections;
+    (void)collectionCount;
+
+    initCount++;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockGet(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result)
+{
+    (void)context;
+    (void)kind;
+    (void)featureKey;
+
+    result->buffer     = NULL;
+    result->bufferSize = 0;
+    result->version    = 0;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockAll(
+    void *const                          context,
+    const char *const                    kind,
+    struct LDStoreCollectionItem **const result,
+    unsigned int *const                  resultCount)
+{
+    (void)context;
+    (void)kind;
+
+    *result      = NULL;
+    *resultCount = 0;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockUpsert(
+    void *const                               context,
+    const char *const                         kind,
+    const struct LDStoreCollectionItem *const feature,
+    const char *const                         featureKey)
+{
+    (void)context;
+    (void)kind;
+    (void)feature;
+    (void)featureKey;
+
+    upsertCount++;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockInitialized(void *const context)
+{
+    (void)context;
+
+    return LDBooleanTrue;
+}
+
+static void
+mockDestructor(void *const context)
+{
+    (void)context;
+}
+
+/* a store whose backend counts the writes made through it */
+static struct LDStore *
+prepareCountingStore()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+
+    initCount   = 0;
+    upsertCount = 0;
+
+    LD_ASSERT(
+        handle = (struct LDStoreInterface *)LDAlloc(
+            sizeof(struct LDStoreInterface)));
+    memset(handle, 0, sizeof(struct LDStoreInterface));
+
+    handle->init        = mockInit;
+    handle->get         = mockGet;
+    handle->all         = mockAll;
+    handle->upsert      = mockUpsert;
+    handle->initialized = mockInitialized;
+    handle->destructor  = mockDestructor;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+
+    LDConfigFree(config);
+
+    return store;
+}
+
+static struct LDStore *
+prepareEmptyStore()
+{
+    struct LDStore * store;
+    struct LDConfig *config;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LD_ASSERT(store = LDStoreNew(config));
+
+    LDConfigFree(config);
+
+    return store;
+}
+
+/* -1 when absent */
+static int
+flagVersion(struct LDStore *const store, const char *const key)
+{
+    struct LDJSONRC *lookup;
+    int              version;
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, key, &lookup));
+
+    if (!lookup) {
+        return -1;
+    }
+
+    version = LDi_getFeatureVersion(LDJSONRCGet(lookup));
+
+    LDJSONRCDecrement(lookup);
+
+    return version;
+}
+
+static void
+awaitFlagVersion(
+    struct LDStore *const store, const char *const key, const int version)
+{
+    unsigned int attempts;
+
+    for (attempts = 0; attempts < 200; attempts++) {
+        if (flagVersion(store, key) == version) {
+            return;
+        }
+
+        LDi_sleepMilliseconds(10);
+    }
+
+    LD_ASSERT(LDBooleanFalse);
+}
+
+/* wait for the source to read the file again after the given reloads */
+static void
+awaitReload(struct LDFileSource *const source, const unsigned int reloads)
+{
+    unsigned int attempts;
+
+    for (attempts = 0; attempts < 200; attempts++) {
+        if (LDi_fileSourceReloads(source) > reloads) {
+            return;
+        }
+
+        LDi_sleepMilliseconds(10);
+    }
+
+    LD_ASSERT(LDBooleanFalse);
+}
+
+static void
+testLoadAndIncrementalReload()
+{
+    struct LDStore *     store;
+    struct LDFileSource *source;
+    unsigned int         reloads;
+
+    writeFlagFile(
+        "{\"flags\": {"
+        "\"a\": {\"key\": \"a\", \"version\": 1},"
+        "\"b\": {\"key\": \"b\", \"version\": 1}},"
+        "\"segments\": {}}");
+
+    LD_ASSERT(store = prepareCountingStore());
+    LD_ASSERT(source = LDi_startFileSource(store, FLAG_FILE));
+
+    /* the initial load happens before returning */
+    LD_ASSERT(LDStoreInitialized(store));
+    LD_ASSERT(flagVersion(store, "a") == 1);
+    LD_ASSERT(flagVersion(store, "b") == 1);
+    LD_ASSERT(initCount == 1);
+    LD_ASSERT(upsertCount == 0);
+
+    /* only the changed, added and removed items are written */
+    reloads = LDi_fileSourceReloads(source);
+
+    writeFlagFile(
+        "{\"flags\": {"
+        "\"a\": {\"key\": \"a\", \"version\": 2},"
+        "\"c\": {\"key\": \"c\", \"version\": 1}},"
+        "\"segments\": {}}");
+
+    awaitReload(source, reloads);
+
+    LD_ASSERT(flagVersion(store, "c") == 1);
+    LD_ASSERT(flagVersion(store, "a") == 2);
+    LD_ASSERT(flagVersion(store, "b") == -1);
+    LD_ASSERT(initCount == 1);
+    LD_ASSERT(upsertCount == 3);
+
+    /* a restored item is not hidden by the tombstone of its removal */
+    reloads = LDi_fileSourceReloads(source);
+
+    writeFlagFile(
+        "{\"flags\": {"
+        "\"a\": {\"key\": \"a\", \"version\": 2},"
+        "\"b\": {\"key\": \"b\", \"version\": 1},"
+        "\"c\": {\"key\": \"c\", \"version\": 1}},"
+        "\"segments\": {}}");
+
+    awaitReload(source, reloads);
+
+    LD_ASSERT(flagVersion(store, "b") == 1);
+    LD_ASSERT(flagVersion(store, "a") == 2);
+    LD_ASSERT(initCount == 2);
+    LD_ASSERT(upsertCount == 3);
+
+    /* an unparsable rewrite keeps the previous data */
+    reloads = LDi_fileSourceReloads(source);
+
+    writeFlagFile("{\"flags\": ");
+
+    awaitReload(source, reloads);
+
+    LD_ASSERT(flagVersion(store, "a") == 2);
+    LD_ASSERT(initCount == 2);
+    LD_ASSERT(upsertCount == 3);
+
+    LDi_stopFileSource(source);
+    LDStoreDestroy(store);
+
+    remove(FLAG_FILE);
+}
+
+static void
+testMissingFile()
+{
+    struct LDStore *     store;
+    struct LDFileSource *source;
+
+    remove(FLAG_FILE);
+
+    LD_ASSERT(store = prepareEmptyStore());
+    LD_ASSERT(source = LDi_startFileSource(store, FLAG_FILE));
+    LD_ASSERT(!LDStoreInitialized(store));
+
+    /* picked up once it appears */
+    writeFlagFile(
+        "{\"flags\": {\"a\": {\"key\": \"a\", \"version\": 4}},"
+        "\"segments\": {}}");
+
+    awaitFlagVersion(store, "a", 4);
+    LD_ASSERT(LDStoreInitialized(store));
+
+    LDi_stopFileSource(source);
+    LDStoreDestroy(store);
+
+    remove(FLAG_FILE);
+}
+
+int
+main()
+{
+    LDBasicLoggerThreadSafeInitialize();
+    LDConfigureGlobalLogger(LD_LOG_TRACE, LDBasicLoggerThreadSafe);
+    LDGlobalInit();
+
+    testLoadAndIncrementalReload();
+    testMissingFile();
+
+    LDBasicLoggerThreadSafeShutdown();
+
+    return 0;
+}
@@ -3,6 +3,8 @@
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "compact_item.h"
+#include "concurrency.h"
 #include "store.h"
 #include "utility.h"
 
@@ -88,13 +90,18 @@ makeMockFailInterface()
         handle = (struct LDStoreInterface *)LDAlloc(
             sizeof(struct LDStoreInterface)));
 
-    handle->context     = NULL;
-    handle->init        = mockFailInit;
-    handle->get         = mockFailGet;
-    handle->all         = mockFailAll;
-    handle->upsert      = mockFailUpsert;
-    handle->initialized = mockFailInitialized;
-    handle->destructor  = mockFailDestructor;
+    handle->context      = NULL;
+    handle->init         = mockFailInit;
+    handle->get          = mockFailGet;
+    handle->all          = mockFailAll;
+    handle->upsert       = mockFailUpsert;
+    handle->initialized  = mockFailInitialized;
+    handle->destructor   = mockFailDestructor;
+    handle->getMany      = NULL;
+    handle->getBorrowed  = NULL;
+    handle->allBorrowed  = NULL;
+    handle->release      = NULL;
+    handle->compactItems = LDBooleanFalse;
 
     return handle;
 }
@@ -479,6 +486,8 @@ testGetCache()
     LD_ASSERT(staticGetCount == 2);
 
     LD_ASSERT(LDJSONCompare(LDJSONRCGet(item1), LDJSONRCGet(item2)));
+    /* the fetched item is the one published to the cache */
+    LD_ASSERT(item1 == item2);
 
     LDJSONFree(staticGetValue);
     LDJSONRCDecrement(item1);
@@ -653,6 +662,1350 @@ testAllCache()
     LDStoreDestroy(store);
 }
 
+static unsigned int slowGetCount;
+static unsigned int slowAllCount;
+
+static LDBoolean
+mockSlowGet(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result)
+{
+    struct LDJSON *flag;
+
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+
+    slowGetCount++;
+
+    LDi_sleepMilliseconds(200);
+
+    LD_ASSERT(
+        flag = makeMinimalFlag(featureKey, 3, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(result->buffer = LDJSONSerialize(flag));
+    result->bufferSize = strlen(result->buffer) + 1;
+    result->version    = 3;
+
+    LDJSONFree(flag);
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockSlowAll(
+    void *const                          context,
+    const char *const                    kind,
+    struct LDStoreCollectionItem **const result,
+    unsigned int *const                  resultCount)
+{
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(result);
+    LD_ASSERT(resultCount);
+
+    slowAllCount++;
+
+    LDi_sleepMilliseconds(200);
+
+    *result      = NULL;
+    *resultCount = 0;
+
+    return LDBooleanTrue;
+}
+
+static THREAD_RETURN
+fetchConcurrently(void *const rawStore)
+{
+    struct LDStore *const store = (struct LDStore *)rawStore;
+    struct LDJSONRC *     item;
+    struct LDJSONRC *     all;
+
+    item = NULL;
+    all  = NULL;
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LDJSONRCDecrement(item);
+
+    LD_ASSERT(LDStoreAll(store, LD_SEGMENT, &all));
+    LD_ASSERT(all);
+    LDJSONRCDecrement(all);
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+static void
+testFetchCoalesced()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    ld_thread_t              threads[8];
+    unsigned int             i;
+
+    slowGetCount = 0;
+    slowAllCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get = mockSlowGet;
+    handle->all = mockSlowAll;
+    LD_ASSERT(store = prepareStore(handle));
+
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        LD_ASSERT(LDi_thread_create(&threads[i], fetchConcurrently, store));
+    }
+
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        LD_ASSERT(LDi_thread_join(&threads[i]));
+    }
+
+    LD_ASSERT(slowGetCount == 1);
+    LD_ASSERT(slowAllCount == 1);
+
+    LDStoreDestroy(store);
+}
+
+/* a backend get that blocks while the gate is closed. each call returns the
+flag at the next version, so a read shows which call it waited on */
+static ld_mutex_t   gateLock;
+static ld_cond_t    gateOpened;
+static ld_cond_t    gateChanged;
+static LDBoolean    gateOpen;
+static unsigned int gatedGetCount;
+static unsigned int gateWaiting;
+
+static void
+initGate()
+{
+    LD_ASSERT(LDi_mutex_init(&gateLock));
+    LD_ASSERT(LDi_cond_init(&gateOpened));
+    LD_ASSERT(LDi_cond_init(&gateChanged));
+
+    gateOpen      = LDBooleanTrue;
+    gatedGetCount = 0;
+    gateWaiting   = 0;
+}
+
+static void
+destroyGate()
+{
+    LD_ASSERT(LDi_cond_destroy(&gateOpened));
+    LD_ASSERT(LDi_cond_destroy(&gateChanged));
+    LD_ASSERT(LDi_mutex_destroy(&gateLock));
+}
+
+static void
+setGate(const LDBoolean open)
+{
+    LDi_mutex_lock(&gateLock);
+    gateOpen = open;
+    LDi_mutex_unlock(&gateLock);
+
+    LDi_cond_signal(&gateOpened);
+}
+
+/* wait for the backend to have been called count times in total */
+static void
+awaitGatedGets(const unsigned int count)
+{
+    LDi_mutex_lock(&gateLock);
+
+    while (gatedGetCount < count) {
+        LDi_cond_wait(&gateChanged, &gateLock, 1000);
+    }
+
+    LDi_mutex_unlock(&gateLock);
+}
+
+/* wait for every call held at the gate to return */
+static void
+awaitGateIdle()
+{
+    LDi_mutex_lock(&gateLock);
+
+    while (gateWaiting > 0) {
+        LDi_cond_wait(&gateChanged, &gateLock, 1000);
+    }
+
+    LDi_mutex_unlock(&gateLock);
+}
+
+static LDBoolean
+mockGatedGet(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result)
+{
+    struct LDJSON *flag;
+    unsigned int   version;
+
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+
+    LDi_mutex_lock(&gateLock);
+
+    version = ++gatedGetCount;
+    gateWaiting++;
+    LDi_cond_signal(&gateChanged);
+
+    while (!gateOpen) {
+        LDi_cond_wait(&gateOpened, &gateLock, 1000);
+    }
+
+    gateWaiting--;
+    LDi_cond_signal(&gateChanged);
+
+    LDi_mutex_unlock(&gateLock);
+
+    /* pass the opening on to any other held call */
+    LDi_cond_signal(&gateOpened);
+
+    LD_ASSERT(
+        flag = makeMinimalFlag(
+            featureKey, version, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(result->buffer = LDJSONSerialize(flag));
+    result->bufferSize = strlen(result->buffer) + 1;
+    result->version    = version;
+
+    LDJSONFree(flag);
+
+    return LDBooleanTrue;
+}
+
+/* the version of the flag read by readGated */
+static int gatedReadVersion;
+
+static THREAD_RETURN
+readGated(void *const rawStore)
+{
+    struct LDStore *const store = (struct LDStore *)rawStore;
+    struct LDJSONRC *     item;
+
+    item = NULL;
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "def", &item));
+    LD_ASSERT(item);
+
+    gatedReadVersion = LDi_getFeatureVersion(LDJSONRCGet(item));
+
+    LDJSONRCDecrement(item);
+
+    return THREAD_RETURN_DEFAULT;
+}
+
+static void
+testStaleWhileRevalidate()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSONRC *        item;
+    ld_thread_t              reader;
+
+    item = NULL;
+
+    initGate();
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get = mockGatedGet;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 0);
+    LDConfigSetFeatureStoreBackendStaleTTL(config, 250);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    /* a miss is always fetched synchronously */
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(item)) == 1);
+    LD_ASSERT(gatedGetCount == 1);
+    LDJSONRCDecrement(item);
+
+    /* the expired item is served while its refresh is held at the gate */
+    setGate(LDBooleanFalse);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(item)) == 1);
+    LDJSONRCDecrement(item);
+
+    awaitGatedGets(2);
+    setGate(LDBooleanTrue);
+    awaitGateIdle();
+
+    /* past the stale window a read waits on the backend */
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "def", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(gatedGetCount == 3);
+    LDJSONRCDecrement(item);
+
+    LDi_expireAll(store);
+    setGate(LDBooleanFalse);
+
+    gatedReadVersion = 0;
+    LD_ASSERT(LDi_thread_create(&reader, readGated, store));
+
+    awaitGatedGets(4);
+    setGate(LDBooleanTrue);
+
+    LD_ASSERT(LDi_thread_join(&reader));
+    LD_ASSERT(gatedReadVersion == 4);
+    LD_ASSERT(gatedGetCount == 4);
+
+    LDStoreDestroy(store);
+
+    destroyGate();
+}
+
+static void
+testRefreshAhead()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSONRC *        item;
+
+    item = NULL;
+
+    initGate();
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get = mockGatedGet;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 2000);
+    LDConfigSetFeatureStoreBackendRefreshAhead(config, 1);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(gatedGetCount == 1);
+    LDJSONRCDecrement(item);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(gatedGetCount == 1);
+    LDJSONRCDecrement(item);
+
+    /* with no further reads the frequently read item is refreshed before it
+    expires */
+    setGate(LDBooleanFalse);
+    awaitGatedGets(2);
+
+    /* reads are served from memory while the refresh is held */
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(item)) == 1);
+    LDJSONRCDecrement(item);
+
+    setGate(LDBooleanTrue);
+    awaitGateIdle();
+
+    LD_ASSERT(gatedGetCount == 2);
+
+    LDStoreDestroy(store);
+
+    destroyGate();
+}
+
+static unsigned int anyGetCount;
+
+static LDBoolean
+mockAnyGet(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result)
+{
+    struct LDJSON *flag;
+
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+
+    LD_ASSERT(
+        flag = makeMinimalFlag(featureKey, 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(result->buffer = LDJSONSerialize(flag));
+    result->bufferSize = strlen(result->buffer) + 1;
+    result->version    = 1;
+
+    LDJSONFree(flag);
+
+    anyGetCount++;
+
+    return LDBooleanTrue;
+}
+
+static void
+getAny(struct LDStore *const store, const char *const key)
+{
+    struct LDJSONRC *item;
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, key, &item));
+    LD_ASSERT(item);
+    LDJSONRCDecrement(item);
+}
+
+static void
+testCacheCapacity()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSONRC *        values, *item;
+    struct LDJSON *          full, *tmp;
+    LDFlagHandle             flagHandle;
+    const char *             key;
+
+    anyGetCount    = 0;
+    staticAllCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get = mockAnyGet;
+    handle->all = mockStaticAll;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheCapacity(config, 2);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    LD_ASSERT(LDStoreFlagHandle(store, "b", &flagHandle));
+
+    getAny(store, "a");
+    getAny(store, "b");
+    LD_ASSERT(anyGetCount == 2);
+
+    /* a is read again so b is evicted to make room for c */
+    getAny(store, "a");
+    LD_ASSERT(anyGetCount == 2);
+    getAny(store, "c");
+    LD_ASSERT(anyGetCount == 3);
+
+    getAny(store, "a");
+    LD_ASSERT(anyGetCount == 3);
+
+    /* the handle no longer points at the evicted item */
+    LD_ASSERT(LDStoreGetByHandle(store, flagHandle, &key, &item));
+    LD_ASSERT(item);
+    LD_ASSERT(strcmp(key, "b") == 0);
+    LDJSONRCDecrement(item);
+    LD_ASSERT(anyGetCount == 4);
+
+    /* a kind larger than the capacity is still returned whole. the evicted
+    items are read by key, the kind is not loaded again until it expires */
+    LD_ASSERT(full = LDNewObject());
+    LD_ASSERT(tmp = makeMinimalFlag("x", 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDObjectSetKey(full, "x", tmp));
+    LD_ASSERT(tmp = makeMinimalFlag("y", 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDObjectSetKey(full, "y", tmp));
+    LD_ASSERT(tmp = makeMinimalFlag("z", 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDObjectSetKey(full, "z", tmp));
+    staticAllValue = full;
+
+    LD_ASSERT(LDStoreAll(store, LD_FLAG, &values));
+    LD_ASSERT(LDJSONCompare(LDJSONRCGet(values), full));
+    LD_ASSERT(staticAllCount == 1);
+    LDJSONRCDecrement(values);
+    LD_ASSERT(anyGetCount == 4);
+
+    LD_ASSERT(LDStoreAll(store, LD_FLAG, &values));
+    LD_ASSERT(LDJSONCompare(LDJSONRCGet(values), full));
+    LD_ASSERT(staticAllCount == 1);
+    LDJSONRCDecrement(values);
+    LD_ASSERT(anyGetCount == 5);
+
+    LD_ASSERT(LDStoreAll(store, LD_FLAG, &values));
+    LD_ASSERT(LDJSONCompare(LDJSONRCGet(values), full));
+    LD_ASSERT(staticAllCount == 1);
+    LDJSONRCDecrement(values);
+    LD_ASSERT(anyGetCount == 6);
+
+    LDi_expireAll(store);
+
+    LD_ASSERT(LDStoreAll(store, LD_FLAG, &values));
+    LD_ASSERT(LDJSONCompare(LDJSONRCGet(values), full));
+    LD_ASSERT(staticAllCount == 2);
+    LDJSONRCDecrement(values);
+
+    staticAllValue = NULL;
+    LDJSONFree(full);
+
+    LDStoreDestroy(store);
+}
+
+static LDBoolean    batchSlow;
+static unsigned int batchGetCount;
+static unsigned int batchGetManyCount;
+static unsigned int batchGetManyKeys;
+
+static void
+makeBatchItem(
+    const char *const key, struct LDStoreCollectionItem *const result)
+{
+    struct LDJSON *flag;
+
+    LD_ASSERT(flag = makeMinimalFlag(key, 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(result->buffer = LDJSONSerialize(flag));
+    result->bufferSize = strlen(result->buffer) + 1;
+    result->version    = 1;
+
+    LDJSONFree(flag);
+}
+
+static LDBoolean
+mockBatchGet(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result)
+{
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+
+    if (batchSlow) {
+        LDi_sleepMilliseconds(100);
+    }
+
+    makeBatchItem(featureKey, result);
+
+    batchGetCount++;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockBatchGetMany(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const *const            featureKeys,
+    const unsigned int                  keyCount,
+    struct LDStoreCollectionItem *const results)
+{
+    unsigned int i;
+
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKeys);
+    LD_ASSERT(results);
+
+    for (i = 0; i < keyCount; i++) {
+        makeBatchItem(featureKeys[i], &results[i]);
+    }
+
+    batchGetManyKeys += keyCount;
+    batchGetManyCount++;
+
+    return LDBooleanTrue;
+}
+
+static void
+testRefreshBatched()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    unsigned int             attempts, refreshed;
+
+    batchSlow         = LDBooleanFalse;
+    batchGetCount     = 0;
+    batchGetManyCount = 0;
+    batchGetManyKeys  = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get     = mockBatchGet;
+    handle->getMany = mockBatchGetMany;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 0);
+    LDConfigSetFeatureStoreBackendStaleTTL(config, 5000);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    getAny(store, "a");
+    getAny(store, "b");
+    getAny(store, "c");
+    LD_ASSERT(batchGetCount == 3);
+
+    /* the first refresh is slow, so the others queue behind it and are
+    fetched together */
+    batchSlow = LDBooleanTrue;
+
+    getAny(store, "a");
+    getAny(store, "b");
+    getAny(store, "c");
+
+    for (attempts = 0; attempts < 100; attempts++) {
+        refreshed = batchGetCount - 3 + batchGetManyKeys;
+
+        if (refreshed == 3) {
+            break;
+        }
+
+        LDi_sleepMilliseconds(10);
+    }
+
+    LD_ASSERT(refreshed == 3);
+    LD_ASSERT(batchGetManyCount == 1);
+    LD_ASSERT(batchGetManyKeys >= 2);
+
+    LDStoreDestroy(store);
+}
+
+static unsigned int dependencyReadCount;
+
+static const char *
+lookupDependency(const char *const kind, const char *const key)
+{
+    if (strcmp(kind, "segments") == 0) {
+        return strcmp(key, "s1") == 0
+                   ? "{\"key\": \"s1\", \"version\": 1}"
+                   : "{\"key\": \"s2\", \"version\": 1}";
+    } else if (strcmp(key, "root") == 0) {
+        return "{\"key\": \"root\", \"version\": 1, "
+               "\"prerequisites\": [{\"key\": \"mid\", \"variation\": 0}], "
+               "\"rules\": [{\"clauses\": [{\"attribute\": \"\", "
+               "\"op\": \"segmentMatch\", \"values\": [\"s1\"]}]}]}";
+    } else if (strcmp(key, "mid") == 0) {
+        return "{\"key\": \"mid\", \"version\": 1, "
+               "\"prerequisites\": [{\"key\": \"leaf\", \"variation\": 0}, "
+               "{\"key\": \"root\", \"variation\": 0}], "
+               "\"rules\": [{\"clauses\": [{\"attribute\": \"\", "
+               "\"op\": \"segmentMatch\", \"values\": [\"s2\"]}]}]}";
+    } else {
+        return "{\"key\": \"leaf\", \"version\": 1}";
+    }
+}
+
+static LDBoolean
+mockDependencyGet(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result)
+{
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+
+    LD_ASSERT(result->buffer = LDStrDup(lookupDependency(kind, featureKey)));
+    result->bufferSize = strlen(result->buffer) + 1;
+    result->version    = 1;
+
+    dependencyReadCount++;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockDependencyGetMany(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const *const            featureKeys,
+    const unsigned int                  keyCount,
+    struct LDStoreCollectionItem *const results)
+{
+    unsigned int i;
+
+    for (i = 0; i < keyCount; i++) {
+        LD_ASSERT(
+            mockDependencyGet(context, kind, featureKeys[i], &results[i]));
+    }
+
+    return LDBooleanTrue;
+}
+
+static void
+testPrefetchDependencies()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSONRC *        item;
+
+    dependencyReadCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get     = mockDependencyGet;
+    handle->getMany = mockDependencyGetMany;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    /* reading the flag also loads everything its evaluation depends on, the
+    cycle back to root is not fetched again */
+    getAny(store, "root");
+    LD_ASSERT(dependencyReadCount == 5);
+
+    getAny(store, "mid");
+    getAny(store, "leaf");
+
+    LD_ASSERT(LDStoreGet(store, LD_SEGMENT, "s1", &item));
+    LD_ASSERT(item);
+    LDJSONRCDecrement(item);
+
+    LD_ASSERT(LDStoreGet(store, LD_SEGMENT, "s2", &item));
+    LD_ASSERT(item);
+    LDJSONRCDecrement(item);
+
+    LD_ASSERT(dependencyReadCount == 5);
+
+    LDStoreDestroy(store);
+}
+static void
+testPrefetchCycleUncached()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+
+    dependencyReadCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get     = mockDependencyGet;
+    handle->getMany = mockDependencyGetMany;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 0);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    /* nothing stays cached, so the cycle through root is not prefetched */
+    getAny(store, "root");
+    LD_ASSERT(dependencyReadCount == 1);
+
+    getAny(store, "mid");
+    LD_ASSERT(dependencyReadCount == 2);
+
+    LDStoreDestroy(store);
+}
+
+
+struct RecordedChanges
+{
+    ld_mutex_t     lock;
+    struct LDJSON *keys;
+};
+
+static void
+recordChangedFlag(const char *const flagKey, void *const userData)
+{
+    struct RecordedChanges *recorded;
+
+    recorded = (struct RecordedChanges *)userData;
+
+    LDi_mutex_lock(&recorded->lock);
+    LD_ASSERT(
+        LDObjectSetKey(recorded->keys, flagKey, LDNewBool(LDBooleanTrue)));
+    LDi_mutex_unlock(&recorded->lock);
+}
+
+static void
+testListenerBackendFlags()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDJSON *          flags, *flag;
+    struct LDJSONRC *        values;
+    struct RecordedChanges   recorded;
+    unsigned int             attempts, count;
+
+    staticAllCount = 0;
+
+    LD_ASSERT(flags = LDNewObject());
+    LD_ASSERT(
+        flag = LDJSONDeserialize(
+            "{\"key\": \"a\", \"version\": 1, \"prerequisites\": "
+            "[{\"key\": \"b\", \"variation\": 0}]}"));
+    LD_ASSERT(LDObjectSetKey(flags, "a", flag));
+    LD_ASSERT(flag = makeMinimalFlag("b", 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDObjectSetKey(flags, "b", flag));
+
+    staticAllValue = flags;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->all = mockStaticAll;
+    LD_ASSERT(store = prepareStore(handle));
+
+    LDi_mutex_init(&recorded.lock);
+    LD_ASSERT(recorded.keys = LDNewObject());
+
+    /* the index covers flags that were never read */
+    LD_ASSERT(LDStoreRegisterListener(store, recordChangedFlag, &recorded));
+    LD_ASSERT(staticAllCount == 1);
+
+    LD_ASSERT(flag = makeMinimalFlag("b", 2, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDObjectSetKey(flags, "b", flag));
+    LD_ASSERT(flag = makeMinimalFlag("c", 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDObjectSetKey(flags, "c", flag));
+
+    LDi_expireAll(store);
+
+    /* another writer changed b, which a depends on */
+    LD_ASSERT(LDStoreAll(store, LD_FLAG, &values));
+    LD_ASSERT(staticAllCount == 2);
+    LDJSONRCDecrement(values);
+
+    count = 0;
+
+    for (attempts = 0; attempts < 100 && count < 2; attempts++) {
+        LDi_sleepMilliseconds(10);
+
+        LDi_mutex_lock(&recorded.lock);
+        count = LDCollectionGetSize(recorded.keys);
+        LDi_mutex_unlock(&recorded.lock);
+    }
+
+    LDStoreDestroy(store);
+
+    LD_ASSERT(LDCollectionGetSize(recorded.keys) == 2);
+    LD_ASSERT(LDObjectLookup(recorded.keys, "a"));
+    LD_ASSERT(LDObjectLookup(recorded.keys, "b"));
+
+    LDJSONFree(recorded.keys);
+    LDi_mutex_destroy(&recorded.lock);
+
+    staticAllValue = NULL;
+
+    LDJSONFree(flags);
+}
+
+static void
+testCacheMaxBytes()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+
+    anyGetCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get = mockAnyGet;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheMaxBytes(config, 4096);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    getAny(store, "a");
+    getAny(store, "a");
+    LD_ASSERT(anyGetCount == 1);
+
+    LDStoreDestroy(store);
+
+    /* no item fits, so every read goes to the backend */
+    anyGetCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->get = mockAnyGet;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheMaxBytes(config, 1);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    getAny(store, "a");
+    getAny(store, "a");
+    LD_ASSERT(anyGetCount == 2);
+
+    LDStoreDestroy(store);
+}
+
+static unsigned int borrowCount;
+static unsigned int releaseCount;
+
+static const char *const borrowedFlag =
+    "{\"key\": \"borrowed\", \"version\": 2}";
+static const char *const otherFlag = "{\"key\": \"other\", \"version\": 1}";
+
+static struct LDStoreCollectionItem borrowedItems[2];
+
+static LDBoolean
+mockGetBorrowed(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result,
+    void **const                        token)
+{
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+    LD_ASSERT(token);
+
+    if (strcmp(featureKey, "borrowed") == 0) {
+        result->buffer     = (void *)borrowedFlag;
+        result->bufferSize = strlen(borrowedFlag);
+    } else {
+        result->buffer     = NULL;
+        result->bufferSize = 0;
+    }
+
+    result->version = 0;
+    *token          = &borrowCount;
+
+    borrowCount++;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockAllBorrowed(
+    void *const                          context,
+    const char *const                    kind,
+    struct LDStoreCollectionItem **const result,
+    unsigned int *const                  resultCount,
+    void **const                         token)
+{
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(result);
+    LD_ASSERT(resultCount);
+    LD_ASSERT(token);
+
+    borrowedItems[0].buffer     = (void *)borrowedFlag;
+    borrowedItems[0].bufferSize = strlen(borrowedFlag);
+    borrowedItems[0].version    = 0;
+    borrowedItems[1].buffer     = (void *)otherFlag;
+    borrowedItems[1].bufferSize = strlen(otherFlag);
+    borrowedItems[1].version    = 0;
+
+    *result      = borrowedItems;
+    *resultCount = 2;
+    *token       = &borrowCount;
+
+    borrowCount++;
+
+    return LDBooleanTrue;
+}
+
+static void
+mockRelease(void *const context, void *const token)
+{
+    (void)context;
+
+    LD_ASSERT(token == &borrowCount);
+
+    releaseCount++;
+}
+
+static void
+testBorrowedItems()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDJSONRC *        item, *values;
+
+    borrowCount  = 0;
+    releaseCount = 0;
+
+    /* get and all fail, so only the borrowed variants can succeed */
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->getBorrowed = mockGetBorrowed;
+    handle->allBorrowed = mockAllBorrowed;
+    handle->release     = mockRelease;
+
+    LD_ASSERT(store = prepareStore(handle));
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "borrowed", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(item)) == 2);
+    LDJSONRCDecrement(item);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "missing", &item));
+    LD_ASSERT(!item);
+
+    LD_ASSERT(LDStoreAll(store, LD_SEGMENT, &values));
+    LD_ASSERT(LDCollectionGetSize(LDJSONRCGet(values)) == 2);
+    LD_ASSERT(LDObjectLookup(LDJSONRCGet(values), "other"));
+    LDJSONRCDecrement(values);
+
+    LD_ASSERT(borrowCount == 3);
+    LD_ASSERT(releaseCount == 3);
+
+    LDStoreDestroy(store);
+}
+
+static void * compactBuffer;
+static size_t compactBufferSize;
+
+static LDBoolean
+mockCompactUpsert(
+    void *const                               context,
+    const char *const                         kind,
+    const struct LDStoreCollectionItem *const feature,
+    const char *const                         featureKey)
+{
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(feature);
+    LD_ASSERT(featureKey);
+
+    LDFree(compactBuffer);
+    LD_ASSERT(compactBuffer = LDAlloc(feature->bufferSize));
+    memcpy(compactBuffer, feature->buffer, feature->bufferSize);
+    compactBufferSize = feature->bufferSize;
+
+    return LDBooleanTrue;
+}
+
+static LDBoolean
+mockCompactGet(
+    void *const                         context,
+    const char *const                   kind,
+    const char *const                   featureKey,
+    struct LDStoreCollectionItem *const result)
+{
+    (void)context;
+
+    LD_ASSERT(kind);
+    LD_ASSERT(featureKey);
+    LD_ASSERT(result);
+    LD_ASSERT(compactBuffer);
+
+    LD_ASSERT(result->buffer = LDAlloc(compactBufferSize));
+    memcpy(result->buffer, compactBuffer, compactBufferSize);
+    result->bufferSize = compactBufferSize;
+    result->version    = 0;
+
+    return LDBooleanTrue;
+}
+
+static void
+testCompactItems()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSON *          flag;
+    struct LDJSONRC *        item;
+    unsigned int             version;
+
+    compactBuffer = NULL;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->upsert       = mockCompactUpsert;
+    handle->get          = mockCompactGet;
+    handle->compactItems = LDBooleanTrue;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCompactItems(config, LDBooleanTrue);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    LD_ASSERT(flag = makeMinimalFlag("abc", 12, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDStoreUpsert(store, LD_FLAG, LDJSONDuplicate(flag)));
+
+    LD_ASSERT(LDi_isCompactItem(compactBuffer, compactBufferSize));
+    LD_ASSERT(
+        LDi_compactItemVersion(compactBuffer, compactBufferSize, &version));
+    LD_ASSERT(version == 12);
+
+    /* the cached copy is dropped so the item is read back from the backend */
+    LDi_expireAll(store);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(LDJSONCompare(LDJSONRCGet(item), flag));
+    LDJSONRCDecrement(item);
+
+    LDJSONFree(flag);
+    LDFree(compactBuffer);
+    LDStoreDestroy(store);
+}
+
+static unsigned int slowUpsertCount;
+static unsigned int slowUpsertVersion;
+static LDBoolean    slowUpsertDeleted;
+
+static LDBoolean
+mockSlowUpsert(
+    void *const                               context,
+    const char *const                         kind,
+    const struct LDStoreCollectionItem *const feature,
+    const char *const                         featureKey)
+{
+    (void)context;
+    LD_ASSERT(kind);
+    LD_ASSERT(feature);
+    LD_ASSERT(featureKey);
+
+    LDi_sleepMilliseconds(200);
+
+    slowUpsertCount++;
+    slowUpsertVersion = feature->version;
+    slowUpsertDeleted = feature->buffer == NULL;
+
+    return LDBooleanTrue;
+}
+
+static double
+writeStat(struct LDStore *const store, const char *const key)
+{
+    struct LDJSON *stats;
+    double         value;
+
+    LD_ASSERT(LDStoreWriteBehindStats(store, &stats));
+    value = LDGetNumber(LDObjectLookup(stats, key));
+    LDJSONFree(stats);
+
+    return value;
+}
+
+/* waits for the write behind thread to finish or fail count writes */
+static void
+waitForWrites(
+    struct LDStore *const store, const char *const key, const double count)
+{
+    unsigned int attempts;
+
+    for (attempts = 0; writeStat(store, key) < count; attempts++) {
+        LD_ASSERT(attempts < 100);
+
+        LDi_sleepMilliseconds(50);
+    }
+}
+
+static void
+testWriteBehind()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSONRC *        item;
+    unsigned int             version;
+
+    slowUpsertCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->upsert = mockSlowUpsert;
+
+    /* without a cache every read would go to the failing backend */
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 0);
+    LDConfigSetFeatureStoreBackendWriteBehind(config, LDBooleanTrue);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    /* changes made while the first is written are coalesced */
+    for (version = 1; version <= 4; version++) {
+        LD_ASSERT(LDStoreUpsert(
+            store,
+            LD_FLAG,
+            makeMinimalFlag("abc", version, LDBooleanTrue, LDBooleanTrue)));
+
+        if (version == 1) {
+            LDi_sleepMilliseconds(50);
+        }
+    }
+
+    LD_ASSERT(writeStat(store, "queued") == 2);
+
+    /* the unwritten item is served from memory */
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(item)) == 4);
+    LDJSONRCDecrement(item);
+
+    waitForWrites(store, "written", 2);
+
+    LD_ASSERT(slowUpsertCount == 2);
+    LD_ASSERT(slowUpsertVersion == 4);
+    LD_ASSERT(writeStat(store, "queued") == 0);
+    LD_ASSERT(writeStat(store, "lagMilliseconds") == 0);
+
+    /* once written the item expires as usual */
+    LD_ASSERT(!LDStoreGet(store, LD_FLAG, "abc", &item));
+
+    LD_ASSERT(LDStoreRemove(store, LD_FLAG, "abc", 5));
+    waitForWrites(store, "written", 3);
+    LD_ASSERT(slowUpsertVersion == 5);
+    LD_ASSERT(slowUpsertDeleted);
+
+    /* init is also written in the background, and retried on failure */
+    LD_ASSERT(LDStoreInitEmpty(store));
+    LD_ASSERT(LDStoreInitialized(store));
+    waitForWrites(store, "failed", 1);
+    LD_ASSERT(writeStat(store, "queued") == 1);
+
+    LDStoreDestroy(store);
+}
+
+static unsigned int succeedInitCount;
+
+static LDBoolean
+mockSucceedInit(
+    void *const                                context,
+    const struct LDStoreCollectionState *const collections,
+    const unsigned int                         collectionCount)
+{
+    (void)context;
+    (void)collectionCount;
+    LD_ASSERT(collections);
+
+    succeedInitCount++;
+
+    return LDBooleanTrue;
+}
+
+static void
+testSoleWriter()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSONRC *        item, *all;
+
+    succeedInitCount  = 0;
+    staticUpsertCount = 0;
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->init   = mockSucceedInit;
+    handle->upsert = mockStaticUpsert;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 0);
+    LDConfigSetFeatureStoreBackendCacheCapacity(config, 1);
+    LDConfigSetFeatureStoreBackendSoleWriter(config, LDBooleanTrue);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    /* before an init the backend is still read */
+    LD_ASSERT(!LDStoreGet(store, LD_FLAG, "abc", &item));
+
+    LD_ASSERT(LDStoreInitEmpty(store));
+    LD_ASSERT(succeedInitCount == 1);
+    LD_ASSERT(LDStoreInitialized(store));
+
+    /* then a miss is final */
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(!item);
+
+    /* updates are written through, and never expire or are evicted */
+    staticUpsertKey = "abc";
+    LD_ASSERT(LDStoreUpsert(
+        store,
+        LD_FLAG,
+        makeMinimalFlag("abc", 1, LDBooleanTrue, LDBooleanTrue)));
+
+    staticUpsertKey = "def";
+    LD_ASSERT(LDStoreUpsert(
+        store,
+        LD_FLAG,
+        makeMinimalFlag("def", 1, LDBooleanTrue, LDBooleanTrue)));
+
+    LD_ASSERT(staticUpsertCount == 2);
+
+    LDi_expireAll(store);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LDJSONRCDecrement(item);
+
+    LD_ASSERT(LDStoreAll(store, LD_FLAG, &all));
+    LD_ASSERT(LDCollectionGetSize(LDJSONRCGet(all)) == 2);
+    LDJSONRCDecrement(all);
+
+    LDStoreDestroy(store);
+}
+
+static void
+testWarmUp()
+{
+    struct LDStore *         store;
+    struct LDStoreInterface *handle;
+    struct LDConfig *        config;
+    struct LDJSONRC *        item;
+    struct LDJSON *          flag;
+    unsigned int             attempts;
+
+    staticAllCount = 0;
+
+    LD_ASSERT(staticAllValue = LDNewArray());
+    LD_ASSERT(flag = makeMinimalFlag("abc", 1, LDBooleanTrue, LDBooleanTrue));
+    LD_ASSERT(LDArrayPush(staticAllValue, flag));
+
+    LD_ASSERT(handle = makeMockFailInterface());
+    handle->all = mockStaticAll;
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LDConfigSetUseLDD(config, LDBooleanTrue);
+    LDConfigSetFeatureStoreBackend(config, handle);
+    LDConfigSetFeatureStoreBackendCacheTTL(config, 400);
+    LDConfigSetFeatureStoreBackendWarmUp(config, LDBooleanTrue);
+    LD_ASSERT(store = LDStoreNew(config));
+    config->storeBackend = NULL;
+    LDConfigFree(config);
+
+    LD_ASSERT(LDStoreWarmUp(store));
+    LD_ASSERT(staticAllCount == 2);
+
+    /* served from memory, fetching the item alone would fail */
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LDJSONRCDecrement(item);
+
+    /* both kinds are reloaded before they expire */
+    for (attempts = 0; staticAllCount < 4; attempts++) {
+        LD_ASSERT(attempts < 40);
+
+        LDi_sleepMilliseconds(50);
+    }
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "abc", &item));
+    LD_ASSERT(item);
+    LDJSONRCDecrement(item);
+
+    LDStoreDestroy(store);
+
+    LDJSONFree(staticAllValue);
+    staticAllValue = NULL;
+}
+
 int
 main()
 {
@@ -674,6 +2027,20 @@ main()
     testGetCache();
     testUpsertCache();
     testAllCache();
+    testFetchCoalesced();
+    testStaleWhileRevalidate();
+    testRefreshAhead();
+    testRefreshBatched();
+    testCacheCapacity();
+    testCacheMaxBytes();
+    testPrefetchDependencies();
+    testPrefetchCycleUncached();
+    testListenerBackendFlags();
+    testBorrowedItems();
+    testCompactItems();
+    testWriteBehind();
+    testSoleWriter();
+    testWarmUp();
 
     LDBasicLoggerThreadSafeShutdown();
 
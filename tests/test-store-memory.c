@@ -1,6 +1,9 @@
+#include <stdio.h>
+
 #include <launchdarkly/api.h>
 
 #include "assertion.h"
+#include "concurrency.h"
 #include "utility.h"
 
 #include "test-utils/store.h"
@@ -20,6 +23,355 @@ prepareEmptyStore()
     return store;
 }
 
+static void
+testInitSkipsInvalid()
+{
+    struct LDStore * store;
+    struct LDJSON *  all, *flags, *invalid, *tmp;
+    struct LDJSONRC *lookup;
+
+    LD_ASSERT(store = prepareEmptyStore());
+
+    LD_ASSERT(all = LDNewObject());
+    LD_ASSERT(flags = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(all, "features", flags));
+
+    LD_ASSERT(invalid = LDNewObject());
+    LD_ASSERT(tmp = LDNewText("a"));
+    LD_ASSERT(LDObjectSetKey(invalid, "key", tmp));
+    LD_ASSERT(LDObjectSetKey(flags, "a", invalid));
+
+    LD_ASSERT(tmp = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(flags, "b", tmp));
+    LD_ASSERT(tmp = LDNewText("b"));
+    LD_ASSERT(LDObjectSetKey(LDObjectLookup(flags, "b"), "key", tmp));
+    LD_ASSERT(tmp = LDNewNumber(1));
+    LD_ASSERT(LDObjectSetKey(LDObjectLookup(flags, "b"), "version", tmp));
+
+    LD_ASSERT(LDStoreInit(store, all));
+    LD_ASSERT(LDStoreInitialized(store));
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "a", &lookup));
+    LD_ASSERT(!lookup);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "b", &lookup));
+    LD_ASSERT(lookup);
+    LDJSONRCDecrement(lookup);
+
+    LDStoreDestroy(store);
+}
+
+struct RecordedChanges
+{
+    ld_mutex_t     lock;
+    struct LDJSON *keys;
+};
+
+static void
+recordChangedFlag(const char *const flagKey, void *const userData)
+{
+    struct RecordedChanges *recorded;
+
+    recorded = (struct RecordedChanges *)userData;
+
+    LDi_mutex_lock(&recorded->lock);
+    LD_ASSERT(
+        LDObjectSetKey(recorded->keys, flagKey, LDNewBool(LDBooleanTrue)));
+    LDi_mutex_unlock(&recorded->lock);
+}
+
+/* waits for the listener to see `count` flags, then clears them */
+static struct LDJSON *
+awaitChanges(struct RecordedChanges *const recorded, const unsigned int count)
+{
+    struct LDJSON *keys;
+    unsigned int   attempts;
+
+    for (attempts = 0; attempts < 100; attempts++) {
+        LDi_mutex_lock(&recorded->lock);
+
+        if (LDCollectionGetSize(recorded->keys) >= count) {
+            keys           = recorded->keys;
+            recorded->keys = LDNewObject();
+            LD_ASSERT(recorded->keys);
+
+            LDi_mutex_unlock(&recorded->lock);
+
+            return keys;
+        }
+
+        LDi_mutex_unlock(&recorded->lock);
+
+        LDi_sleepMilliseconds(10);
+    }
+
+    LD_ASSERT(LDBooleanFalse);
+
+    return NULL;
+}
+
+static struct LDJSON *
+makeItem(const char *const raw)
+{
+    struct LDJSON *item;
+
+    LD_ASSERT(item = LDJSONDeserialize(raw));
+
+    return item;
+}
+
+static void
+testFlagChangeListener()
+{
+    struct LDStore *       store;
+    struct LDJSON *        all, *keys;
+    struct RecordedChanges recorded;
+
+    LD_ASSERT(store = prepareEmptyStore());
+
+    LDi_mutex_init(&recorded.lock);
+    LD_ASSERT(recorded.keys = LDNewObject());
+
+    LD_ASSERT(
+        all = makeItem(
+            "{\"features\": {"
+            "\"a\": {\"key\": \"a\", \"version\": 1, \"prerequisites\": "
+            "[{\"key\": \"b\", \"variation\": 0}]},"
+            "\"b\": {\"key\": \"b\", \"version\": 1, \"rules\": [{"
+            "\"clauses\": [{\"attribute\": \"\", \"op\": \"segmentMatch\", "
+            "\"values\": [\"s\"]}]}]},"
+            "\"c\": {\"key\": \"c\", \"version\": 1}},"
+            "\"segments\": {\"s\": {\"key\": \"s\", \"version\": 1}}}"));
+    LD_ASSERT(LDStoreInit(store, all));
+
+    LD_ASSERT(LDStoreRegisterListener(store, recordChangedFlag, &recorded));
+
+    /* a segment change reaches b directly and a through its prerequisite */
+    LD_ASSERT(LDStoreUpsert(
+        store, LD_SEGMENT, makeItem("{\"key\": \"s\", \"version\": 2}")));
+
+    keys = awaitChanges(&recorded, 2);
+    LD_ASSERT(LDCollectionGetSize(keys) == 2);
+    LD_ASSERT(LDObjectLookup(keys, "a"));
+    LD_ASSERT(LDObjectLookup(keys, "b"));
+    LDJSONFree(keys);
+
+    /* an init only reports what differs */
+    LD_ASSERT(
+        all = makeItem(
+            "{\"features\": {"
+            "\"a\": {\"key\": \"a\", \"version\": 1, \"prerequisites\": "
+            "[{\"key\": \"b\", \"variation\": 0}]},"
+            "\"b\": {\"key\": \"b\", \"version\": 1, \"rules\": [{"
+            "\"clauses\": [{\"attribute\": \"\", \"op\": \"segmentMatch\", "
+            "\"values\": [\"s\"]}]}]}},"
+            "\"segments\": {\"s\": {\"key\": \"s\", \"version\": 2}}}"));
+    LD_ASSERT(LDStoreInit(store, all));
+
+    keys = awaitChanges(&recorded, 1);
+    LD_ASSERT(LDCollectionGetSize(keys) == 1);
+    LD_ASSERT(LDObjectLookup(keys, "c"));
+    LDJSONFree(keys);
+
+    LD_ASSERT(LDStoreRemove(store, LD_FLAG, "b", 2));
+
+    keys = awaitChanges(&recorded, 2);
+    LD_ASSERT(LDCollectionGetSize(keys) == 2);
+    LD_ASSERT(LDObjectLookup(keys, "a"));
+    LD_ASSERT(LDObjectLookup(keys, "b"));
+    LDJSONFree(keys);
+
+    LD_ASSERT(LDStoreUnregisterListener(store, recordChangedFlag, &recorded));
+    LD_ASSERT(!LDStoreUnregisterListener(store, recordChangedFlag, &recorded));
+
+    LDStoreDestroy(store);
+
+    LDJSONFree(recorded.keys);
+    LDi_mutex_destroy(&recorded.lock);
+}
+
+static struct LDStore *reentrantStore;
+static unsigned int    selfRemovingCalls;
+/* held by the test until it is done with the store */
+static ld_mutex_t destroyGate;
+
+static void
+removeSelf(const char *const flagKey, void *const userData)
+{
+    (void)flagKey;
+
+    selfRemovingCalls++;
+
+    LD_ASSERT(LDStoreUnregisterListener(reentrantStore, removeSelf, userData));
+}
+
+static void
+destroyStore(const char *const flagKey, void *const userData)
+{
+    struct RecordedChanges *recorded;
+
+    recorded = (struct RecordedChanges *)userData;
+
+    LDi_mutex_lock(&destroyGate);
+    LDi_mutex_unlock(&destroyGate);
+
+    LDStoreDestroy(reentrantStore);
+
+    recordChangedFlag(flagKey, recorded);
+}
+
+/* listeners are called without store locks, so they may remove themselves
+and destroy the store */
+static void
+testReentrantListeners()
+{
+    struct LDJSON *        keys;
+    struct RecordedChanges recorded;
+
+    LD_ASSERT(reentrantStore = prepareEmptyStore());
+
+    LDi_mutex_init(&recorded.lock);
+    LD_ASSERT(recorded.keys = LDNewObject());
+
+    LD_ASSERT(LDStoreInitEmpty(reentrantStore));
+
+    LD_ASSERT(LDStoreRegisterListener(reentrantStore, removeSelf, NULL));
+    LD_ASSERT(
+        LDStoreRegisterListener(reentrantStore, recordChangedFlag, &recorded));
+
+    /* listeners are called in registration order */
+    LD_ASSERT(LDStoreUpsert(
+        reentrantStore, LD_FLAG, makeItem("{\"key\": \"a\", \"version\": 1}")));
+
+    keys = awaitChanges(&recorded, 1);
+    LDJSONFree(keys);
+
+    LD_ASSERT(LDStoreUpsert(
+        reentrantStore, LD_FLAG, makeItem("{\"key\": \"b\", \"version\": 1}")));
+
+    keys = awaitChanges(&recorded, 1);
+    LD_ASSERT(LDObjectLookup(keys, "b"));
+    LDJSONFree(keys);
+
+    LD_ASSERT(selfRemovingCalls == 1);
+
+    LD_ASSERT(LDStoreUnregisterListener(
+        reentrantStore, recordChangedFlag, &recorded));
+    LD_ASSERT(LDStoreRegisterListener(reentrantStore, destroyStore, &recorded));
+
+    /* the store is freed by the dispatch thread once the listener returns */
+    LDi_mutex_init(&destroyGate);
+    LDi_mutex_lock(&destroyGate);
+
+    LD_ASSERT(LDStoreUpsert(
+        reentrantStore, LD_FLAG, makeItem("{\"key\": \"c\", \"version\": 1}")));
+
+    LDi_mutex_unlock(&destroyGate);
+
+    keys = awaitChanges(&recorded, 1);
+    LD_ASSERT(LDObjectLookup(keys, "c"));
+    LDJSONFree(keys);
+
+    LDi_mutex_destroy(&destroyGate);
+    LDJSONFree(recorded.keys);
+    LDi_mutex_destroy(&recorded.lock);
+}
+
+static void
+testSnapshotWarmStart()
+{
+    struct LDConfig *config;
+    struct LDStore * store;
+    struct LDJSONRC *lookup;
+    FILE *           file;
+    const char *const path = "test-store-memory.snapshot";
+
+    remove(path);
+
+    LD_ASSERT(config = LDConfigNew(""));
+    LD_ASSERT(LDConfigSetFeatureStoreSnapshotPath(config, path));
+
+    LD_ASSERT(store = LDStoreNew(config));
+    LD_ASSERT(!LDStoreLoadSnapshot(store));
+    LD_ASSERT(LDStoreInit(
+        store,
+        makeItem("{\"features\": {\"a\": {\"key\": \"a\", \"version\": 3}},"
+                 "\"segments\": {\"s\": {\"key\": \"s\", \"version\": 2}}}")));
+    LDStoreDestroy(store);
+
+    /* a new store starts from the data written by the last init */
+    LD_ASSERT(store = LDStoreNew(config));
+    LD_ASSERT(!LDStoreInitialized(store));
+    LD_ASSERT(LDStoreLoadSnapshot(store));
+    LD_ASSERT(LDStoreInitialized(store));
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "a", &lookup));
+    LD_ASSERT(lookup);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(lookup)) == 3);
+    LDJSONRCDecrement(lookup);
+
+    LD_ASSERT(LDStoreGet(store, LD_SEGMENT, "s", &lookup));
+    LD_ASSERT(lookup);
+    LDJSONRCDecrement(lookup);
+
+    LDStoreDestroy(store);
+
+    /* a damaged file is rejected */
+    LD_ASSERT(file = fopen(path, "wb"));
+    LD_ASSERT(fputs("LDSNAP", file) >= 0);
+    LD_ASSERT(fclose(file) == 0);
+
+    LD_ASSERT(store = LDStoreNew(config));
+    LD_ASSERT(!LDStoreLoadSnapshot(store));
+    LD_ASSERT(!LDStoreInitialized(store));
+    LDStoreDestroy(store);
+
+    remove(path);
+
+    LDConfigFree(config);
+}
+
+static void
+testInitKeepsUnchanged()
+{
+    struct LDStore * store;
+    struct LDJSONRC *before, *after, *changedBefore, *changedAfter;
+
+    LD_ASSERT(store = prepareEmptyStore());
+
+    LD_ASSERT(LDStoreInit(
+        store,
+        makeItem("{\"features\": {\"a\": {\"key\": \"a\", \"version\": 1},"
+                 "\"b\": {\"key\": \"b\", \"version\": 1},"
+                 "\"c\": {\"key\": \"c\", \"version\": 1}}}")));
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "a", &before));
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "b", &changedBefore));
+
+    LD_ASSERT(LDStoreInit(
+        store,
+        makeItem("{\"features\": {\"a\": {\"key\": \"a\", \"version\": 1},"
+                 "\"b\": {\"key\": \"b\", \"version\": 2}}}")));
+
+    /* the unchanged flag keeps its value, the others are replaced */
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "a", &after));
+    LD_ASSERT(after == before);
+    LDJSONRCDecrement(after);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "b", &changedAfter));
+    LD_ASSERT(changedAfter != changedBefore);
+    LD_ASSERT(LDi_getFeatureVersion(LDJSONRCGet(changedAfter)) == 2);
+    LDJSONRCDecrement(changedAfter);
+
+    LD_ASSERT(LDStoreGet(store, LD_FLAG, "c", &after));
+    LD_ASSERT(!after);
+
+    LDJSONRCDecrement(before);
+    LDJSONRCDecrement(changedBefore);
+
+    LDStoreDestroy(store);
+}
+
 int
 main()
 {
@@ -29,6 +381,12 @@ main()
 
     runSharedStoreTests(prepareEmptyStore);
 
+    testInitSkipsInvalid();
+    testFlagChangeListener();
+    testReentrantListeners();
+    testSnapshotWarmStart();
+    testInitKeepsUnchanged();
+
     LDBasicLoggerThreadSafeShutdown();
 
     return 0;
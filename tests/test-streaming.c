@@ -44,6 +44,42 @@ testParsePathUnknownKind()
     LD_ASSERT(!key);
 }
 
+static void
+testParsePut()
+{
+    struct LDJSON *sets, *flags;
+
+    LD_ASSERT(LDi_parsePut(
+        " { \"path\": \"/\", \"data\": {\"extra\": [1, {\"a\": 2}], "
+        "\"segments\": {}, \"flags\": {\"a\": {\"key\": \"a\"}, "
+        "\"b\": {\"key\": \"b\", \"rules\": [{}]}}}} ",
+        "data",
+        &sets));
+    LD_ASSERT(LDCollectionGetSize(sets) == 2);
+    LD_ASSERT(flags = LDObjectLookup(sets, "features"));
+    LD_ASSERT(LDCollectionGetSize(flags) == 2);
+    LD_ASSERT(LDObjectLookup(LDObjectLookup(flags, "b"), "rules"));
+    LD_ASSERT(LDCollectionGetSize(LDObjectLookup(sets, "segments")) == 0);
+    LDJSONFree(sets);
+
+    /* polling responses are not wrapped */
+    LD_ASSERT(LDi_parsePut(
+        "{\"flags\": {\"a\": {\"key\": \"a\"}}, \"segments\": {}}",
+        NULL,
+        &sets));
+    LD_ASSERT(LDCollectionGetSize(LDObjectLookup(sets, "features")) == 1);
+    LDJSONFree(sets);
+
+    LD_ASSERT(!LDi_parsePut("{\"flags\": {}}", NULL, &sets));
+    LD_ASSERT(!LDi_parsePut("{\"flags\": [], \"segments\": {}}", NULL, &sets));
+    LD_ASSERT(!LDi_parsePut(
+        "{\"flags\": {}, \"segments\": {}} x", NULL, &sets));
+    LD_ASSERT(!LDi_parsePut(
+        "{\"flags\": {\"a\": }, \"segments\": {}}", NULL, &sets));
+    LD_ASSERT(!LDi_parsePut("{\"flags\": {}, \"segments\": {},}", NULL, &sets));
+    LD_ASSERT(!LDi_parsePut("{\"flags\": {}, \"segments\": {}", NULL, &sets));
+}
+
 static void
 testInitialPut(struct StreamContext *const context)
 {
@@ -409,6 +445,7 @@ main()
     testParsePathFlags();
     testParsePathSegments();
     testParsePathUnknownKind();
+    testParsePut();
     testStreamContext(testStreamBundle);
     testStreamContext(testEventDataIsNotValidJSON);
     testStreamContext(testEventDataIsNotAnObject);
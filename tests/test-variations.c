@@ -267,6 +267,70 @@ testJSONVariationNullFallback()
     LDDetailsClear(&details);
 }
 
+static struct LDJSON *
+makeIntFlag(const unsigned int version, const int value)
+{
+    struct LDJSON *flag;
+
+    LD_ASSERT(flag = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(flag, "key", LDNewText("validFeatureKey")));
+    LD_ASSERT(LDObjectSetKey(flag, "version", LDNewNumber(version)));
+    LD_ASSERT(LDObjectSetKey(flag, "on", LDNewBool(LDBooleanTrue)));
+    setFallthrough(flag, 0);
+    addVariation(flag, LDNewNumber(value));
+
+    return flag;
+}
+
+static void
+testVariationByHandle()
+{
+    struct LDClient *client;
+    struct LDUser *  user;
+    struct LDJSON *  sets, *flags;
+    LDFlagHandle     handle;
+    struct LDDetails details;
+    /* setup */
+    LD_ASSERT(client = makeTestClient());
+    LD_ASSERT(user = LDUserNew("userkey"));
+    LD_ASSERT(LDStoreInitEmpty(client->store));
+    /* handles may be taken before the flag exists */
+    handle = LDClientGetFlagHandle(client, "validFeatureKey");
+    LD_ASSERT(handle != LD_INVALID_FLAG_HANDLE);
+    LD_ASSERT(LDClientGetFlagHandle(client, "validFeatureKey") == handle);
+    LD_ASSERT(LDClientGetFlagHandle(client, "otherFeatureKey") != handle);
+    LD_ASSERT(
+        LDIntVariationByHandle(client, user, handle, 1000, &details) == 1000);
+    LD_ASSERT(details.reason == LD_ERROR);
+    LD_ASSERT(details.extra.errorKind == LD_FLAG_NOT_FOUND);
+    LDDetailsClear(&details);
+    /* follows upserts */
+    LD_ASSERT(LDStoreUpsert(client->store, LD_FLAG, makeIntFlag(1, 100)));
+    LD_ASSERT(
+        LDIntVariationByHandle(client, user, handle, 1000, &details) == 100);
+    LD_ASSERT(details.reason == LD_FALLTHROUGH);
+    LDDetailsClear(&details);
+    LD_ASSERT(LDStoreUpsert(client->store, LD_FLAG, makeIntFlag(2, 200)));
+    LD_ASSERT(LDIntVariationByHandle(client, user, handle, 1000, NULL) == 200);
+    /* follows a new generation */
+    LD_ASSERT(flags = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(flags, "validFeatureKey", makeIntFlag(3, 300)));
+    LD_ASSERT(sets = LDNewObject());
+    LD_ASSERT(LDObjectSetKey(sets, "features", flags));
+    LD_ASSERT(LDObjectSetKey(sets, "segments", LDNewObject()));
+    LD_ASSERT(LDStoreInit(client->store, sets));
+    LD_ASSERT(LDIntVariationByHandle(client, user, handle, 1000, NULL) == 300);
+    /* and deletions */
+    LD_ASSERT(LDStoreRemove(client->store, LD_FLAG, "validFeatureKey", 4));
+    LD_ASSERT(
+        LDIntVariationByHandle(client, user, handle, 1000, &details) == 1000);
+    LD_ASSERT(details.extra.errorKind == LD_FLAG_NOT_FOUND);
+    /* cleanup */
+    LDUserFree(user);
+    LDClientClose(client);
+    LDDetailsClear(&details);
+}
+
 int
 main()
 {
@@ -282,6 +346,7 @@ main()
     testStringVariationNullFallback();
     testJSONVariation();
     testJSONVariationNullFallback();
+    testVariationByHandle();
 
     LDBasicLoggerThreadSafeShutdown();
 